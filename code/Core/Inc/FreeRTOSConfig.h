@@ -0,0 +1,97 @@
+/*
+ * FreeRTOSConfig.h
+ *
+ * @description: The kernel configuration of the FreeRTOS build
+ * (WAV_PLAYER_RTOS, see app_rtos.h). Only read by the FreeRTOS sources,
+ * the bare-metal build never includes it. The settings are the ones
+ * CubeMX writes for CMSIS-RTOS v1 on the STM32F407, with the features
+ * the player uses: mutexes with priority inheritance, recursive mutexes
+ * and direct task notifications.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+#include <stdint.h>
+extern uint32_t SystemCoreClock;
+#endif
+
+/***************************************
+* Kernel
+****************************************/
+#define configUSE_PREEMPTION					1
+#define configSUPPORT_STATIC_ALLOCATION			0
+#define configSUPPORT_DYNAMIC_ALLOCATION		1
+#define configUSE_IDLE_HOOK						1	/* WFI, see app_rtos.c */
+#define configUSE_TICK_HOOK						0
+#define configCPU_CLOCK_HZ						(SystemCoreClock)
+#define configTICK_RATE_HZ						((TickType_t)1000)	/* HAL tick rate */
+#define configMAX_PRIORITIES					(7)		/* CMSIS-RTOS v1 priorities */
+#define configMINIMAL_STACK_SIZE				((uint16_t)128)
+#define configTOTAL_HEAP_SIZE					((size_t)15360)
+#define configMAX_TASK_NAME_LEN					(16)
+#define configUSE_16_BIT_TICKS					0
+#define configUSE_MUTEXES						1
+#define configUSE_RECURSIVE_MUTEXES				1
+#define configUSE_COUNTING_SEMAPHORES			1
+#define configUSE_TASK_NOTIFICATIONS			1
+#define configQUEUE_REGISTRY_SIZE				8
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION	1
+#define configCHECK_FOR_STACK_OVERFLOW			2
+#define configUSE_MALLOC_FAILED_HOOK			0
+#define configUSE_CO_ROUTINES					0
+#define configUSE_TIMERS						0
+
+/***************************************
+* API functions included
+****************************************/
+#define INCLUDE_vTaskPrioritySet				1
+#define INCLUDE_uxTaskPriorityGet				1
+#define INCLUDE_vTaskDelete						1
+#define INCLUDE_vTaskCleanUpResources			0
+#define INCLUDE_vTaskSuspend					1
+#define INCLUDE_vTaskDelayUntil					0
+#define INCLUDE_vTaskDelay						1
+#define INCLUDE_xTaskGetSchedulerState			1
+#define INCLUDE_xTaskGetCurrentTaskHandle		1
+#define INCLUDE_uxTaskGetStackHighWaterMark		1
+
+/***************************************
+* Interrupt priorities
+****************************************/
+#ifdef __NVIC_PRIO_BITS
+#define configPRIO_BITS							__NVIC_PRIO_BITS
+#else
+#define configPRIO_BITS							4
+#endif
+
+// The lowest priority, the kernel runs SysTick and PendSV at it
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY			15
+
+// Interrupts at this priority or below (numerically higher) may call
+// the FromISR API: the I2S DMA and the OTG interrupt, see irq_prio.h.
+// Those above it are never masked by the kernel and must not call it.
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY	5
+
+#define configKERNEL_INTERRUPT_PRIORITY			(configLIBRARY_LOWEST_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY	(configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+
+#define configASSERT(x)							if((x) == 0) { taskDISABLE_INTERRUPTS(); for(;;); }
+
+/***************************************
+* Handlers
+****************************************/
+// The port takes the SVCall and PendSV vectors, stm32f4xx_it.c leaves
+// them out in this build. SysTick stays the HAL time base and calls
+// xPortSysTickHandler() once the scheduler runs.
+#define vPortSVCHandler							SVC_Handler
+#define xPortPendSVHandler						PendSV_Handler
+
+#endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,57 @@
+/*
+ * app_rtos.h
+ *
+ * @description: The header file of the FreeRTOS build of the player, an
+ * alternative to the cooperative main loop of scheduler.h. It is built
+ * with the project symbol WAV_PLAYER_RTOS and needs the FreeRTOS kernel
+ * with its CMSIS-RTOS v1 wrapper (Middlewares/Third_Party/FreeRTOS, as
+ * CubeMX adds it) in the build. The threads are:
+ *
+ *  - audio (osPriorityRealtime): blocked on a task notification that the
+ *    I2S DMA callbacks give, refills the ring half and reads ahead of the
+ *    stream between refills.
+ *  - USB host (osPriorityHigh): the thread of the USB host library
+ *    (USBH_USE_OS), woken by its event queue instead of PendSV.
+ *  - UI (osPriorityBelowNormal): runs the remaining main loop tasks
+ *    (control, LCD, telemetry, library scan) with the cooperative
+ *    scheduler and sleeps when none is ready.
+ *
+ * FatFs is reentrant in this build (_FS_REENTRANT with a mutex per
+ * volume), the USB host lock becomes a recursive mutex and the player
+ * state is shared under a player mutex. Without WAV_PLAYER_RTOS the
+ * player lock calls compile to nothing.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __APP_RTOS_H___
+#define __APP_RTOS_H___
+#include "scheduler.h"
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define APP_RTOS_AUDIO_STACK		512		/* words */
+#define APP_RTOS_UI_STACK			768		/* words, the library scan parses headers */
+
+/***************************************
+* Public function declaration
+****************************************/
+#ifdef WAV_PLAYER_RTOS
+// create the threads and start the kernel, never returns
+void appRtos_start(sched_task_t *uiTasks, uint8_t num);
+
+// keep the audio thread off the player state while the caller changes it
+void appRtos_lockPlayer(void);
+void appRtos_unlockPlayer(void);
+#else
+#define appRtos_lockPlayer()		do {} while (0)
+#define appRtos_unlockPlayer()		do {} while (0)
+#endif
+
+#endif // __APP_RTOS_H___
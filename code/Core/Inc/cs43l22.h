@@ -25,14 +25,16 @@
 #ifndef __CS43L22_H___
 #define __CS43L22_H___
 #include "stm32f4xx_hal.h"
+#include <stdbool.h>
 
 
 /***************************************
 * Public function declaration
 ****************************************/
-void CS43_init(I2C_HandleTypeDef i2c_handle);
+void CS43_init(I2C_HandleTypeDef *i2c_handle);
 void CS43_set_volume(uint8_t volume);
 void CS43_start(void);
 void CS43_stop(void);
+void CS43_set_mute(bool mute);
 
 #endif // __CS43L22_H___
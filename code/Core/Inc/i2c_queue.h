@@ -0,0 +1,58 @@
+/*
+ * i2c_queue.h
+ *
+ * @description: The header file of the asynchronous I2C transaction
+ * queue. Transactions are queued from any context and run one after the
+ * other with the interrupt driven STM HAL I2C functions, so the caller
+ * never waits for the bus. Every transaction carries a deadline, a
+ * transaction that has not finished by then is completed with
+ * I2C_XFER_TIMEOUT and the peripheral is re-initialized, so a stuck bus
+ * can not stall the queue.
+ *
+ * @reference:
+ * 1.ST open-source HAL I2C drivers
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __I2C_QUEUE_H___
+#define __I2C_QUEUE_H___
+#include "stm32f4xx_hal.h"
+#include <stdbool.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define I2C_QUEUE_LEN			16	/* queued transactions */
+#define I2C_QUEUE_MAX_DATA		9	/* bytes per write transaction */
+
+/***************************************
+* Public Type Definition
+****************************************/
+typedef enum
+{
+	I2C_XFER_OK = 0,
+	I2C_XFER_ERROR,		/* NACK, arbitration loss or bus error */
+	I2C_XFER_TIMEOUT,	/* deadline passed before completion */
+}i2c_xfer_status_t;
+
+/* completion callback, runs in interrupt context */
+typedef void (*i2c_xfer_cb_t)(i2c_xfer_status_t status, void *ctx);
+
+/***************************************
+* Public function declaration
+****************************************/
+void i2cQueue_init(I2C_HandleTypeDef *hi2c);
+bool i2cQueue_write(uint16_t devAddr, const uint8_t *data, uint8_t len,
+		uint32_t timeoutMs, i2c_xfer_cb_t cb, void *ctx);
+bool i2cQueue_read(uint16_t devAddr, uint8_t map, uint8_t *dst, uint8_t len,
+		uint32_t timeoutMs, i2c_xfer_cb_t cb, void *ctx);
+void i2cQueue_poll(void);
+bool i2cQueue_idle(void);
+bool i2cQueue_flush(uint32_t timeoutMs);
+
+#endif // __I2C_QUEUE_H___
@@ -0,0 +1,58 @@
+/*
+ * irq_prio.h
+ *
+ * @description: The interrupt priority map of the player. The NVIC is
+ * used with NVIC_PRIORITYGROUP_4, 16 preemption levels and no
+ * subpriority, 0 is the highest. A handler preempts every handler below
+ * it and is never delayed by one at the same or a lower level, only by
+ * code that masks interrupts with PRIMASK.
+ *
+ *  level  line                  work in the handler
+ *   0-4   (free)                reserved, may never call the kernel of
+ *                               the FreeRTOS build
+ *   5     DMA1_Stream5 (I2S)    hands the played half over, ~0.3 us
+ *   6     OTG_FS                moves the packets of a URB, kicks PendSV
+ *   7     SysTick, I2C1 EV/ER   HAL tick, I2C queue deadlines and chaining
+ *   8     EXTI1-4 (buttons)     debounce, records the press, kicks PendSV
+ *  15     PendSV                USBH_Process() and the button actions
+ *
+ * The audio DMA is on top so that no USB, tick or button handler can make
+ * it late. SysTick and the I2C interrupts both run the I2C queue, which
+ * does not rely on their levels: i2cQueue_poll() runs entirely under
+ * PRIMASK and the I2C completion updates the queue under PRIMASK, so either
+ * may preempt the other outside those sections. Work too
+ * long for its level (a USB host state machine pass, a codec volume
+ * command with its LCD update) is deferred to PendSV, which every other
+ * handler preempts.
+ *
+ * The lowest level in use is 5 so that the same map holds in the FreeRTOS
+ * build (WAV_PLAYER_RTOS), where only handlers at or below
+ * configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY may call the kernel. The
+ * kernel moves SysTick to level 15 there and owns PendSV, the I2C
+ * interrupts then preempt the tick.
+ *
+ * The numbers are also set in wav_player-beta.ioc, which generates the
+ * HAL_NVIC_SetPriority() calls of the MSP and MX init functions: change
+ * both together.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __IRQ_PRIO_H___
+#define __IRQ_PRIO_H___
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define IRQ_PRIO_AUDIO_DMA		5	/* DMA1_Stream5, the I2S ring */
+#define IRQ_PRIO_USB			6	/* OTG_FS */
+#define IRQ_PRIO_TICK			7	/* SysTick, TICK_INT_PRIORITY */
+#define IRQ_PRIO_I2C			7	/* I2C1 event and error */
+#define IRQ_PRIO_BUTTON			8	/* EXTI1 to EXTI4 */
+#define IRQ_PRIO_DEFERRED		15	/* PendSV */
+
+#endif // __IRQ_PRIO_H___
@@ -31,6 +31,8 @@
 #ifndef INC_LCD_H_
 #define INC_LCD_H_
 
+#include <stdint.h>
+
 /***************************************
 * GPIO Macro definition for LCD signals
 ****************************************/
@@ -50,6 +52,13 @@
 #define D7_GPIO_Port GPIOE
 
 
+/***************************************
+* LCD geometry
+****************************************/
+#define LCD_ROWS	2
+#define LCD_COLS	16
+#define LCD_CGRAM_SLOTS	8
+
 /***************************************
 * Public function declaration
 ****************************************/
@@ -65,4 +74,16 @@ void lcd_update_cur(int row, int col);
 // clear the lcd
 void lcd_clear(void);
 
+// load a 5x8 custom glyph (8 rows, low 5 bits each) into CGRAM slot (0-7)
+void lcd_create_char(uint8_t slot, const uint8_t *rows);
+
+// put a character into the frame buffer, no bus traffic
+void lcd_fb_put(int row, int col, char c);
+
+// put a string into the frame buffer, padded with spaces up to width
+void lcd_fb_write(int row, int col, const char *str, int width);
+
+// send at most maxCells dirty cells to the lcd, returns cells sent
+int lcd_flush(int maxCells);
+
 #endif /* INC_LCD_H_ */
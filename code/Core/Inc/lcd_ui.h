@@ -0,0 +1,41 @@
+/*
+ *  lcd_ui.h
+ *
+ *  @description: The player UI layer on top of the HD44780 LCD driver.
+ *  The top row shows the song title, scrolled as a marquee when it does
+ *  not fit. The bottom row shows the elapsed time, a progress bar with
+ *  per-pixel-column resolution and the remaining time. Volume changes
+ *  temporarily replace the bottom row.
+ *
+ *  All drawing goes to the LCD frame buffer and only the dirty cells are
+ *  flushed from lcdUi_process(), with a fixed cell budget per tick so the
+ *  time spent on the LCD bus per second is bounded.
+ *
+ *  @Author: Shuran Xu
+ *
+ *  @Revision: 1.0
+ *
+ *  @Date 2026-10-18
+ */
+
+#ifndef INC_LCD_UI_H_
+#define INC_LCD_UI_H_
+
+#include <stdint.h>
+
+/***************************************
+* Public function declaration
+****************************************/
+// load the custom glyphs and clear the screen
+void lcdUi_init(void);
+
+// set the title shown on the top row, restarts the marquee
+void lcdUi_setTitle(const char *title);
+
+// show the volume on the bottom row for a while, safe to call from an ISR
+void lcdUi_setVolume(uint8_t volume);
+
+// animate and flush the UI, call from the main loop
+void lcdUi_process(void);
+
+#endif /* INC_LCD_UI_H_ */
@@ -59,6 +59,8 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+// act on the button presses recorded by the EXTI interrupts, see irq_prio.h
+void app_buttons(void);
 
 /* USER CODE END EFP */
 
@@ -0,0 +1,98 @@
+/*
+ * profile.h
+ *
+ * @description: The header file of the cycle counter profiler. Every
+ * stage of the pipeline (file reads, MSC reads, the gain ramp, LCD
+ * flushes, I2C transactions and the interrupt handlers) is timed with
+ * the DWT cycle counter. Per stage the profiler keeps the count, the
+ * minimum, the average, the maximum and a histogram in profileStats[],
+ * which the debugger can read at any time, and profile_report() prints
+ * them through a line output function.
+ *
+ * A probe is a PROFILE_START() and a PROFILE_STOP() around the stage,
+ * a read of CYCCNT and a few cycles of bookkeeping with interrupts
+ * masked. The profiler is built with PROFILE_ENABLE set to 1 only, with
+ * the default of 0 the probes compile to nothing and profileStats[]
+ * does not exist.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __PROFILE_H___
+#define __PROFILE_H___
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE			0	/* 1: build the probes in */
+#endif
+#define PROFILE_HIST_BINS		16	/* bin 0: below 1 << PROFILE_HIST_SHIFT cycles, bin i: below twice that of bin i-1 */
+#define PROFILE_HIST_SHIFT		6
+
+/***************************************
+* Public Type Definition
+****************************************/
+typedef enum
+{
+	PROF_F_READ = 0,		/* f_read of the song file */
+	PROF_MSC_READ,			/* USBH_MSC_Read of the disk layer */
+	PROF_RAMP,				/* pause/resume gain ramp of the ring */
+	PROF_LCD_FLUSH,			/* lcd_flush of the UI tick */
+	PROF_I2C_XFER,			/* queued I2C transaction, start to completion */
+	PROF_IRQ_SYSTICK,
+	PROF_IRQ_DMA,			/* DMA1_Stream5, the I2S ring */
+	PROF_IRQ_I2C_EV,
+	PROF_IRQ_I2C_ER,
+	PROF_IRQ_OTG_FS,
+	PROF_IRQ_PENDSV,		/* the USB host process, preemption included */
+	PROF_IRQ_EXTI,			/* the buttons */
+	PROF_STAGE_NUM
+}profile_stage_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;			/* cycles */
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PROFILE_HIST_BINS];
+}profile_stat_t;
+
+/* line output of profile_report(), the line has no newline */
+typedef void (*profile_out_t)(const char *line);
+
+/***************************************
+* Public Variable Declaration
+****************************************/
+#if PROFILE_ENABLE
+extern profile_stat_t profileStats[PROF_STAGE_NUM];
+#endif
+
+/***************************************
+* Public function declaration
+****************************************/
+#if PROFILE_ENABLE
+void profile_init(void);
+void profile_reset(void);
+void profile_add(profile_stage_t stage, uint32_t cycles);
+void profile_report(profile_out_t out);
+
+#define PROFILE_START()				(DWT->CYCCNT)
+#define PROFILE_STOP(stage, start)	profile_add((stage), DWT->CYCCNT - (start))
+#else
+#define profile_init()				do {} while (0)
+#define profile_reset()				do {} while (0)
+#define profile_report(out)			((void)(out))
+
+#define PROFILE_START()				(0U)
+#define PROFILE_STOP(stage, start)	((void)(start))
+#endif
+
+#endif // __PROFILE_H___
@@ -0,0 +1,93 @@
+/*
+ * scheduler.h
+ *
+ * @description: The header file of the cooperative task scheduler of the
+ * main loop. A task is a run-to-completion function with a priority, a
+ * release condition (a period, a ready check or both) and a deadline
+ * relative to its release. Every sched_run() call releases the tasks
+ * whose condition holds and runs one released task: the one with the
+ * highest priority, the earliest deadline among equals.
+ *
+ * A task can also report its slack, the time left until its work is
+ * due, e.g. the audio refill until the DMA hands over the next half.
+ * When that slack falls below the task's urgency threshold it runs
+ * first, whatever the priorities, and tasks that took longer than the
+ * slack before are held back until it has run.
+ *
+ * When no task is ready the main loop calls sched_idle(), which sleeps
+ * with WFI until the next interrupt: the I2S DMA, OTG_FS, a button or
+ * the 1 ms SysTick that releases the periodic tasks. The time the CPU is
+ * awake is counted into a duty cycle, the headroom left is the rest.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __SCHEDULER_H___
+#define __SCHEDULER_H___
+#include "stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define SCHED_NO_SLACK			INT32_MAX	/* slack of a task with nothing due */
+#define SCHED_LINE_LEN			96		/* characters of a report line */
+
+/***************************************
+* Public Type Definition
+****************************************/
+typedef void (*sched_run_t)(void);
+typedef bool (*sched_ready_t)(void);
+typedef int32_t (*sched_slack_t)(void);
+typedef void (*sched_out_t)(const char *line);	/* takes one report line */
+
+typedef struct
+{
+	const char *name;
+	sched_run_t run;
+	sched_ready_t ready;	/* NULL: released on the period alone */
+	sched_slack_t slack;	/* NULL: no urgency, else the slack in us */
+	uint8_t priority;		/* 0 is the highest */
+	uint32_t periodMs;		/* 0: released whenever ready */
+	uint32_t deadlineMs;	/* after the release */
+	int32_t urgentUs;		/* slack below which the task runs first */
+
+	// state and statistics, kept by the scheduler
+	bool released;
+	uint32_t releaseTick;
+	uint32_t dueTick;
+	uint32_t runs;
+	uint32_t misses;		/* runs that started after the deadline */
+	uint32_t urgentRuns;	/* runs forced by low slack */
+	uint32_t maxUs;			/* longest run */
+	uint64_t busyCycles;
+}sched_task_t;
+
+/***************************************
+* Public function declaration
+****************************************/
+// take over a task table, the table must outlive the scheduler
+void sched_init(sched_task_t *tasks, uint8_t num);
+
+// release the due tasks and run one of them, false if none was ready
+bool sched_run(void);
+
+// sleep until the next interrupt unless a task became ready meanwhile
+void sched_idle(void);
+
+// the share of the time the CPU was awake since the statistics were cleared, in per mille
+uint32_t sched_dutyPermille(void);
+
+// clear the statistics of all tasks
+void sched_clearStats(void);
+
+// print one line per task: runs, deadline misses, urgent runs, longest run, CPU share,
+// then the duty cycle of the CPU
+void sched_report(sched_out_t out);
+
+#endif // __SCHEDULER_H___
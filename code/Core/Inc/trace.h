@@ -0,0 +1,117 @@
+/*
+ * trace.h
+ *
+ * @description: The header file of the event trace. The audio path logs
+ * what it does (DMA callbacks, refills, URB state changes, BOT phases,
+ * button presses and codec commands) as 8-byte records stamped with the
+ * DWT cycle counter into a fixed-size ring in CCM RAM, so the last
+ * TRACE_LEN events before a glitch are always there. The ring can be
+ * stopped a number of events after a trigger, e.g. the first underrun,
+ * to keep what led up to it.
+ *
+ * The ring is read with the debugger (dump the traceLog variable as
+ * binary) and turned into a timeline by Tools/trace_decode.py. With
+ * TRACE_ITM set trace_poll() also streams the records over SWO through
+ * ITM stimulus port TRACE_ITM_PORT, two words per record, records the
+ * ring overwrites before they are sent are dropped and counted.
+ *
+ * With TRACE_ENABLE set to 0 the TRACE() calls compile to nothing.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __TRACE_H___
+#define __TRACE_H___
+#include "stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE			1
+#endif
+#ifndef TRACE_ITM
+#define TRACE_ITM				0	/* 1: stream the records over SWO as well */
+#endif
+#ifndef TRACE_LEN
+#define TRACE_LEN				4096	/* records in the ring, a power of 2 */
+#endif
+#ifndef TRACE_RAM
+#define TRACE_RAM				__attribute__((section(".ccmnoload")))
+#endif
+#define TRACE_ITM_PORT			1
+#define TRACE_MAGIC				0x52544157UL	/* "WATR" in memory */
+
+/***************************************
+* Public Type Definition
+****************************************/
+typedef enum
+{
+	TRACE_EV_NONE = 0,
+	TRACE_EV_MARK,			/* a: user, b: user */
+	TRACE_EV_DMA,			/* a: ring half handed over, b: pause state */
+	TRACE_EV_REFILL_START,	/* a: ring half */
+	TRACE_EV_REFILL_END,	/* a: ring half, b: bytes read */
+	TRACE_EV_UNDERRUN,		/* a: ring half still pending */
+	TRACE_EV_URB,			/* a: host channel, b: URB state */
+	TRACE_EV_BOT,			/* a: BOT state entered, b: SCSI opcode */
+	TRACE_EV_BUTTON,		/* a: level, b: GPIO pin */
+	TRACE_EV_CODEC_WRITE,	/* a: register, b: count << 8 | first value */
+	TRACE_EV_CODEC_READ,	/* a: register, b: count */
+	TRACE_EV_NUM
+}trace_event_t;
+
+typedef struct
+{
+	uint32_t cycles;		/* DWT cycle counter */
+	uint8_t event;			/* trace_event_t */
+	uint8_t a;
+	uint16_t b;
+}trace_record_t;
+
+// The ring as it is dumped, the decoder reads this layout
+typedef struct
+{
+	uint32_t magic;			/* TRACE_MAGIC once initialized */
+	uint32_t len;			/* records in the ring */
+	uint32_t coreClock;		/* Hz, to turn cycles into time */
+	volatile uint32_t head;	/* records logged so far, the next goes to head % len */
+	volatile uint32_t stopAt;	/* head at which logging stops, 0: never */
+	volatile uint32_t itmDropped;
+	trace_record_t ring[TRACE_LEN];
+}trace_log_t;
+
+/***************************************
+* Public Variable Declaration
+****************************************/
+#if TRACE_ENABLE
+extern trace_log_t traceLog;
+#endif
+
+/***************************************
+* Public function declaration
+****************************************/
+#if TRACE_ENABLE
+void trace_init(void);
+void trace_log(trace_event_t event, uint8_t a, uint16_t b);
+void trace_trigger(uint32_t postEvents);
+bool trace_stopped(void);
+void trace_poll(void);
+
+#define TRACE(event, a, b)		trace_log((event), (uint8_t)(a), (uint16_t)(b))
+#else
+#define trace_init()			do {} while (0)
+#define trace_trigger(n)		((void)(n))
+#define trace_stopped()			(false)
+#define trace_poll()			do {} while (0)
+
+#define TRACE(event, a, b)		do {} while (0)
+#endif
+
+#endif // __TRACE_H___
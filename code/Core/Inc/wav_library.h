@@ -0,0 +1,120 @@
+/*
+ * wav_library.h
+ *
+ * @description: The header file of the track library. On mount the
+ * volume is walked once and every playable WAV file gets a compact index
+ * entry (file name, size, start cluster, format, data offset and
+ * duration). The index is saved to WAVLIB_INDEX_PATH together with a
+ * signature of the volume, so later mounts load it in one pass instead of
+ * walking the directories and probing every header again.
+ *
+ * Without a valid index the walk runs in the background: wavLib_process()
+ * does small steps within a time budget from the main loop and yields to
+ * pending audio refills. Tracks are appended as they are found, so
+ * playback can start before the walk is done.
+ *
+ * The entries, the file names, the directory paths and the long names
+ * share one arena of WAVLIB_RAM_BUDGET bytes: entries grow from the front,
+ * strings from the back. The number of tracks is only limited by that
+ * budget. Paths are built from the 8.3 short names on FAT and from the
+ * full names on exFAT, which has no short names. Long names are taken
+ * from the directory entries during the walk and kept as the display
+ * titles, so showing a title never reads the directory again.
+ *
+ * @reference:
+ * 1.FatFs R0.12c application interface
+ * 2.Microsoft/IBM RIFF WAVE file format
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef _WAV_LIBRARY_H_
+#define _WAV_LIBRARY_H_
+
+#include "fatfs.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#ifndef WAVLIB_RAM_BUDGET
+#define WAVLIB_RAM_BUDGET		(8 * 1024)	/* bytes for entries and directory paths */
+#endif
+#define WAVLIB_INDEX_PATH		"/WAVLIB.IDX"
+#define WAVLIB_MAX_DEPTH		4			/* directory levels below the root */
+#define WAVLIB_PATH_MAX			80			/* longest full path incl. terminator */
+#define WAVLIB_TITLE_MAX		64			/* long name characters kept as title */
+#ifndef WAVLIB_STEP_BUDGET_US
+#define WAVLIB_STEP_BUDGET_US	1000		/* scan time per main loop pass */
+#endif
+
+/***************************************
+* Public Type Definition
+****************************************/
+// The format of a WAV file as found in its "fmt " and "data" chunks
+typedef struct
+{
+	uint16_t audioFormat;	/* 1: PCM, the sub format for WAVE_FORMAT_EXTENSIBLE */
+	uint16_t channels;
+	uint32_t sampleRate;
+	uint32_t byteRate;
+	uint16_t blockAlign;
+	uint16_t bitsPerSample;
+	uint32_t dataOffset;	/* file offset of the first sample */
+	uint32_t dataSize;		/* bytes of sample data, clipped to the file */
+}wavLib_format_t;
+
+// One track of the library, stored as is in the index file
+typedef struct
+{
+	uint16_t name;					/* file name in the path, bytes from the end of the arena */
+	uint16_t dir;					/* directory path, bytes from the end of the arena */
+	uint16_t title;					/* long name, bytes from the end of the arena, 0 if none */
+	uint16_t bitsPerSample;
+	uint8_t  channels;
+	uint32_t sampleRate;
+	uint32_t size;					/* file size */
+	uint32_t sclust;				/* start cluster of the file */
+	uint32_t dataOffset;
+	uint32_t durationMs;
+}wavLib_entry_t;
+
+/***************************************
+* Public function declaration
+****************************************/
+// parse the RIFF chunks of an open file, leaves the file pointer anywhere
+bool wavLib_parseHeader(FIL *fp, wavLib_format_t *fmt);
+
+// check whether the player can play a format (16-bit PCM, 1 or 2 channels)
+bool wavLib_isPlayable(const wavLib_format_t *fmt);
+
+// load the index of the mounted volume, or start a background scan
+bool wavLib_mount(void);
+
+// run the background scan for budgetUs, returns true while it is running
+bool wavLib_process(uint32_t budgetUs);
+
+// check whether the background scan is still running
+bool wavLib_scanning(void);
+
+// forget the library and delete the index file, the next mount rescans
+void wavLib_invalidate(void);
+
+// the number of tracks in the library
+uint32_t wavLib_count(void);
+
+// the entry of a track, NULL when out of range
+const wavLib_entry_t *wavLib_get(uint32_t idx);
+
+// the display title of a track, its long name when it has one
+const char *wavLib_title(uint32_t idx);
+
+// build the full path of a track
+bool wavLib_path(uint32_t idx, char *buf, uint32_t len);
+
+#endif /* _WAV_LIBRARY_H_ */
@@ -27,6 +27,33 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifndef WAV_TELEMETRY_UNDERRUNS
+#define WAV_TELEMETRY_UNDERRUNS  8  /* underrun timestamps kept */
+#endif
+
+#define WAV_BACKGROUND_IDLE      UINT32_MAX  /* no background work pending */
+
+// The refill telemetry, a snapshot taken by wavPlayer_getTelemetry()
+typedef struct
+{
+  uint32_t callbacks;       /* DMA callbacks of the current track */
+  uint32_t fillBytes;       /* fresh audio ahead of the DMA at the last callback */
+  uint32_t minFillBytes;    /* lowest fill level of the current track */
+  uint32_t avgFillBytes;
+  uint32_t refills;         /* refills done for the current track */
+  int32_t  lastSlackUs;     /* time left until the refilled half was due, negative when late */
+  int32_t  minSlackUs;      /* worst slack of the current track */
+  int32_t  avgSlackUs;
+  int32_t  prevMinSlackUs;  /* worst slack of the previous track */
+  uint32_t trackUnderruns;  /* halves due before their refill was done, current track */
+  uint32_t underruns;       /* the same since the last wavPlayer_clearTelemetry() */
+  uint8_t  underrunsKept;   /* valid entries of underrunMs */
+  uint32_t underrunMs[WAV_TELEMETRY_UNDERRUNS]; /* HAL ticks of the last underruns, oldest first */
+}wavPlayer_telemetry_t;
+
+// Called from the DMA interrupt when a ring half is handed over for a refill
+typedef void (*wavPlayer_notify_t)(void);
+
 
 /**
  * @brief Open the WAV file to play
@@ -59,6 +86,11 @@ void wavPlayer_proceed(void);
  */
 bool is_wavPlayer_finished_Playing(void);
 
+/**
+ * @brief Enable or disable direct streaming into the audio ring
+ */
+void wavPlayer_setZeroCopy(bool enable);
+
 /**
  * @brief Set WAV player volume
  */
@@ -74,5 +106,95 @@ void wavPlayer_pause(void);
  */
 void wavPlayer_resume(void);
 
+/**
+ * @brief Set the paused time before the codec is powered down
+ */
+void wavPlayer_setPauseTimeout(uint32_t timeoutMs);
+
+/**
+ * @brief Check whether an audio buffer refill is pending
+ */
+bool wavPlayer_refillPending(void);
+
+/**
+ * @brief Get the time left until the pending refill is due
+ */
+int32_t wavPlayer_refillSlackUs(void);
+
+/**
+ * @brief Get the time until the player has work to do between refills
+ */
+uint32_t wavPlayer_backgroundDelayMs(void);
+
+/**
+ * @brief Check whether the player has work to do between refills
+ */
+bool wavPlayer_backgroundPending(void);
+
+/**
+ * @brief Do the work of the player between refills
+ */
+void wavPlayer_background(void);
+
+/**
+ * @brief Set the function that wakes the refill, NULL for none
+ */
+void wavPlayer_setRefillNotify(wavPlayer_notify_t notify);
+
+/**
+ * @brief Get the length of the open song in milliseconds
+ */
+uint32_t wavPlayer_getDurationMs(void);
+
+/**
+ * @brief Get the playing time of the open song in milliseconds
+ */
+uint32_t wavPlayer_getElapsedMs(void);
+
+/**
+ * @brief Get the sampling frequency of the open song
+ */
+uint32_t wavPlayer_getSampleRate(void);
+
+/**
+ * @brief Get the length of the open song in sample frames
+ */
+uint32_t wavPlayer_getTotalSamples(void);
+
+/**
+ * @brief Get the sample-accurate playback position in sample frames
+ */
+uint32_t wavPlayer_getPositionSamples(void);
+
+/**
+ * @brief Take a snapshot of the refill telemetry
+ */
+void wavPlayer_getTelemetry(wavPlayer_telemetry_t *snap);
+
+/**
+ * @brief Clear the refill telemetry of all tracks
+ */
+void wavPlayer_clearTelemetry(void);
+
+#ifdef WAV_PLAYER_BENCHMARK
+// The streaming throughput of one file
+typedef struct
+{
+  uint8_t  fsType;      /* FS_FAT12, FS_FAT16, FS_FAT32 or FS_EXFAT */
+  bool     noFatChain;  /* contiguous exFAT file, streamed without FAT access */
+  uint32_t fragments;   /* cluster runs of the file */
+  uint32_t bytes;       /* bytes read */
+  uint32_t us;          /* time taken */
+  uint32_t kBps;        /* throughput in kB/s */
+  uint32_t copyCyclesPerSec;    /* CPU cycles per second of audio, copied */
+  uint32_t directCyclesPerSec;  /* CPU cycles per second of audio, direct */
+}wavPlayer_bench_t;
+
+/**
+ * @brief Measure the streaming throughput of a file, the player must be stopped
+ */
+bool wavPlayer_benchmark(const char *filePath, wavPlayer_bench_t *result);
+#endif
+
 
 #endif /* _WAV_PLAYER_H_ */
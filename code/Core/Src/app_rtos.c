@@ -0,0 +1,182 @@
+/*
+ * app_rtos.c
+ *
+ * @description: The FreeRTOS build implementation file. The audio thread
+ * has the highest priority and sleeps on its task notification, so a
+ * refill starts as soon as the DMA callback returns instead of after the
+ * main loop task that happens to run. It can still wait behind a lower
+ * priority thread that holds the FatFs or the USB host mutex, for at
+ * most one FatFs call, the mutexes hand the priority down meanwhile.
+ *
+ * Lock order: player, then FatFs, then USB host. The UI thread takes the
+ * player mutex only in the control task.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "app_rtos.h"
+
+#ifdef WAV_PLAYER_RTOS
+#include "main.h"
+#include "cmsis_os.h"
+#include "wav_player.h"
+#include "irq_prio.h"
+
+/***************************************
+* Local Macro Definition
+****************************************/
+// the DMA and OTG interrupts call the kernel
+#if (IRQ_PRIO_AUDIO_DMA < configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY) || \
+	(IRQ_PRIO_USB < configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY)
+#error "irq_prio.h: kernel-aware interrupts above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY"
+#endif
+
+#define APP_RTOS_READ_AHEAD_TICKS	1	/* audio thread wake-up while reading ahead */
+#define APP_RTOS_UI_IDLE_TICKS		1	/* UI thread sleep with no task ready */
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static osThreadId audioThread;
+static osThreadId uiThread;
+static osMutexId playerMutex;
+static sched_task_t *uiTaskTable;
+static uint8_t uiTaskNum;
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Wake the audio thread, from the DMA callbacks
+ */
+static void appRtos_refillNotify(void)
+{
+	BaseType_t woken = pdFALSE;
+
+	vTaskNotifyGiveFromISR((TaskHandle_t)audioThread, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * @brief The audio thread: refills, then the read-ahead
+ * @note Sleeps until a DMA callback hands a half over, for a tick while
+ * the read-ahead has work to do, or until the pause power down is due.
+ */
+static void appRtos_audio(void const *argument)
+{
+	uint32_t wait, delayMs;
+
+	(void)argument;
+	for(;;)
+	{
+		delayMs = wavPlayer_backgroundDelayMs();
+		if(delayMs == 0){
+			wait = APP_RTOS_READ_AHEAD_TICKS;
+		}else if(delayMs == WAV_BACKGROUND_IDLE){
+			wait = portMAX_DELAY;
+		}else{
+			wait = pdMS_TO_TICKS(delayMs) + 1;
+		}
+		ulTaskNotifyTake(pdTRUE, wait);
+
+		osMutexWait(playerMutex, osWaitForever);
+		while(wavPlayer_refillPending())
+		{
+			wavPlayer_proceed();
+		}
+		wavPlayer_background();
+		osMutexRelease(playerMutex);
+	}
+}
+
+/**
+ * @brief The UI thread: the cooperative scheduler over the UI tasks
+ */
+static void appRtos_ui(void const *argument)
+{
+	(void)argument;
+	sched_init(uiTaskTable, uiTaskNum);
+	for(;;)
+	{
+		if(!sched_run())
+		{
+			osDelay(APP_RTOS_UI_IDLE_TICKS);
+		}
+	}
+}
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief The idle task hook: sleep until the next interrupt
+ * @note The kernel calls it with no thread ready, the SysTick, DMA, OTG
+ * or button interrupt that ends the sleep makes one ready.
+ */
+void vApplicationIdleHook(void)
+{
+	__DSB();
+	__WFI();
+}
+
+/**
+ * @brief Create the threads and start the kernel
+ * @param uiTasks - The main loop tasks run by the UI thread, without the
+ * audio refill and the read-ahead, the audio thread does those
+ * @param num - The number of tasks
+ * @note Call after the peripherals and the USB host are initialized, the
+ * USB host thread is created by MX_USB_HOST_Init(). The interrupt
+ * priorities are those of irq_prio.h, the kernel may be called from all
+ * of them.
+ */
+void appRtos_start(sched_task_t *uiTasks, uint8_t num)
+{
+	osMutexDef(player);
+	osThreadDef(audio, appRtos_audio, osPriorityRealtime, 0, APP_RTOS_AUDIO_STACK);
+	osThreadDef(ui, appRtos_ui, osPriorityBelowNormal, 0, APP_RTOS_UI_STACK);
+
+	uiTaskTable = uiTasks;
+	uiTaskNum = num;
+	playerMutex = osMutexCreate(osMutex(player));
+	audioThread = osThreadCreate(osThread(audio), NULL);
+	uiThread = osThreadCreate(osThread(ui), NULL);
+	if((playerMutex == NULL) || (audioThread == NULL) || (uiThread == NULL))
+	{
+		Error_Handler();
+	}
+
+	wavPlayer_setRefillNotify(appRtos_refillNotify);
+
+	osKernelStart();
+	for(;;);	/* not reached */
+}
+
+/**
+ * @brief Keep the audio thread off the player state
+ */
+void appRtos_lockPlayer(void)
+{
+	if(osKernelRunning())
+	{
+		osMutexWait(playerMutex, osWaitForever);
+	}
+}
+
+/**
+ * @brief Let the audio thread at the player state again
+ */
+void appRtos_unlockPlayer(void)
+{
+	if(osKernelRunning())
+	{
+		osMutexRelease(playerMutex);
+	}
+}
+
+#endif /* WAV_PLAYER_RTOS */
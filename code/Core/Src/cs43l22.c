@@ -23,7 +23,11 @@
  */
 
 #include "cs43l22.h"
+#include "i2c_queue.h"
+#include "trace.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 /***************************************
 * Local Macro Definition
 ****************************************/
@@ -51,14 +55,23 @@
 #define HEADPHONE_B_VOL     				0x23
 
 #define DAC_I2C_ADDR 						0x94
-#define TRANSFER_TIMEOUT 					100
+#define TRANSFER_TIMEOUT 					100  /* blocking reads at init */
+#define XFER_DEADLINE						20   /* queued transaction deadline */
 #define CS43_DEFAULT_VOLUME				    200
 
+#define MAP_INCR							0x80 /* MAP auto-increment bit */
+#define CS43_FIRST_REG						0x01 /* documented register map */
+#define CS43_LAST_REG						0x34
+#define CS43_REG_NUM						(CONFIG_47 + 1)
+#define CS43_BURST_MAX						(I2C_QUEUE_MAX_DATA - 1)
+
 
 /***************************************
 * Local Variable Definition
 ****************************************/
-static I2C_HandleTypeDef i2cx;
+// RAM copy of the codec registers, reads are served from here
+static uint8_t regShadow[CS43_REG_NUM];
+static bool regValid[CS43_REG_NUM];
 
 /***************************************
 * External Variable Definition
@@ -69,40 +82,158 @@ extern I2S_HandleTypeDef hi2s3;
 /***************************************
 * Local Function Helper Definition
 ****************************************/
+/**
+ * @brief Check whether writes to a register must always go to the bus
+ * @param reg: The register address
+ * @note The undocumented registers used by the power-up errata sequence
+ * are not cached, their writes are part of a sequence and are never
+ * considered redundant.
+ */
+static bool CS43_is_write_through(uint8_t reg)
+{
+	return (reg == CONFIG_00) || (reg == CONFIG_32) || (reg == CONFIG_47);
+}
+
+/**
+ * @brief Completion callback of queued register writes
+ * @param status: The result of the transaction
+ * @param ctx: The first register in bits [15:8] and the count in [7:0]
+ * @note A failed write leaves the registers in an unknown state, so
+ * their shadow entries are invalidated and the next access goes to the
+ * bus.
+ */
+static void CS43_write_done(i2c_xfer_status_t status, void *ctx)
+{
+	uint8_t reg = (uint8_t)((uintptr_t)ctx >> 8);
+	uint8_t len = (uint8_t)((uintptr_t)ctx & 0xFF);
+
+	if(status != I2C_XFER_OK)
+	{
+		while(len--){
+			regValid[reg++] = false;
+		}
+	}
+}
+
+/**
+ * @brief Write consecutive registers in a single I2C transaction
+ * @param reg: The first register address to be written
+ * @param data: The data of the registers
+ * @param len: The number of registers (1..CS43_BURST_MAX)
+ * @note Leading and trailing registers that already hold the value are
+ * dropped, and nothing is sent if no register changes. More than one
+ * register is sent with the MAP auto-increment bit set.
+ *
+ * The transaction is queued and the call returns right away, so it can
+ * be made from any context. The shadow is updated when the write is
+ * queued, the completion callback invalidates it if the write fails or
+ * misses its deadline.
+ */
+static void CS43_write_registers(uint8_t reg, const uint8_t *data, uint8_t len)
+{
+	uint8_t wData[CS43_BURST_MAX + 1];
+	uint8_t i;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	// trim unchanged registers from both ends of the burst
+	while((len > 0) && !CS43_is_write_through(reg) &&
+			regValid[reg] && (regShadow[reg] == data[0]))
+	{
+		reg++;
+		data++;
+		len--;
+	}
+	while((len > 0) && !CS43_is_write_through(reg + len - 1) &&
+			regValid[reg + len - 1] && (regShadow[reg + len - 1] == data[len - 1]))
+	{
+		len--;
+	}
+	if(len == 0)
+	{
+		__set_PRIMASK(primask);
+		return;
+	}
+
+	TRACE(TRACE_EV_CODEC_WRITE, reg, (len << 8) | data[0]);
+	wData[0] = (len > 1) ? (reg | MAP_INCR) : reg;
+	memcpy(&wData[1], data, len);
+	memcpy(&regShadow[reg], data, len);
+	for(i = 0; i < len; i++){
+		regValid[reg + i] = true;
+	}
+	if(!i2cQueue_write(DAC_I2C_ADDR, wData, len + 1, XFER_DEADLINE,
+			CS43_write_done, (void *)(uintptr_t)((reg << 8) | len)))
+	{
+		CS43_write_done(I2C_XFER_ERROR, (void *)(uintptr_t)((reg << 8) | len));
+	}
+	__set_PRIMASK(primask);
+}
+
 /**
  * @brief Write 1-byte data to the designated register
  * @param reg: The register address to be written
  * @param data: The one-byte data to be used
- * @note This function uses the ST I2C library to transfer
- * data in the master mode.
+ * @note The write is skipped if the register already holds the data.
  */
 static void CS43_write_register(uint8_t reg, uint8_t data)
 {
-    uint8_t wData[2];
-    wData[0] = reg;
-    wData[1] = data;
-    HAL_I2C_Master_Transmit(&i2cx, DAC_I2C_ADDR, wData,
-    		2, TRANSFER_TIMEOUT);
+	CS43_write_registers(reg, &data, 1);
 }
 
+/**
+ * @brief Completion callback of register reads
+ * @param status: The result of the transaction
+ * @param ctx: Where the result is stored
+ */
+static void CS43_read_done(i2c_xfer_status_t status, void *ctx)
+{
+	*(volatile i2c_xfer_status_t *)ctx = status;
+}
+
+/**
+ * @brief Read consecutive registers from the codec into the shadow
+ * @param reg: The first register address to be read
+ * @param len: The number of registers
+ * @note The MAP is sent with auto-increment followed by a repeated start
+ * read of all the registers. This waits for the queue to drain, so it is
+ * only used at initialization.
+ */
+static void CS43_fetch_registers(uint8_t reg, uint8_t len)
+{
+	static uint8_t rData[CS43_REG_NUM];
+	static volatile i2c_xfer_status_t rStatus;
+	uint8_t map = (len > 1) ? (reg | MAP_INCR) : reg;
+	uint8_t i;
+
+	rStatus = I2C_XFER_ERROR;
+	TRACE(TRACE_EV_CODEC_READ, reg, len);
+	if(i2cQueue_read(DAC_I2C_ADDR, map, rData, len, TRANSFER_TIMEOUT,
+			CS43_read_done, (void *)&rStatus) &&
+	   i2cQueue_flush(TRANSFER_TIMEOUT) &&
+	   (rStatus == I2C_XFER_OK))
+	{
+		memcpy(&regShadow[reg], rData, len);
+		for(i = 0; i < len; i++){
+			regValid[reg + i] = true;
+		}
+	}
+}
 
 /**
  * @brief read 1-byte data from the designated register
  * @param reg: The register address to be read
- * @return data: The one-byte I2C transfer data
- * @note This function uses the ST I2C library to transfer
- * data in the master, full-duplex mode.
+ * @return data: The one-byte register data
+ * @note The data comes from the register shadow, the bus is only used
+ * the first time an unknown register is read.
  */
 static uint8_t CS43_read_register(uint8_t reg)
 {
-	uint8_t rData[2];
-	uint8_t data;
-	rData[0] = reg;
-	HAL_I2C_Master_Transmit(&i2cx, DAC_I2C_ADDR, rData, 1,
-			TRANSFER_TIMEOUT);
-	HAL_I2C_Master_Receive(&i2cx, DAC_I2C_ADDR, &data, 1,
-			TRANSFER_TIMEOUT);
-	return data;
+	if(!regValid[reg])
+	{
+		CS43_fetch_registers(reg, 1);
+	}
+	return regShadow[reg];
 }
 
 
@@ -111,7 +242,8 @@ static uint8_t CS43_read_register(uint8_t reg)
 ****************************************/
 /**
  * @brief Initialize the CS43L22 Audio Codec using STM HAL libraries.
- * @param i2c_handle: The handler of the I2C module to be used
+ * @param i2c_handle: The handler of the I2C module to be used, it has
+ * to outlive the driver because transfers complete in its interrupts
  * @param outputMode: The output mode of the CS43L22
  * @note The CS43L22 Audio Codec is configured with the following
  * steps according to the datasheet:
@@ -134,82 +266,93 @@ static uint8_t CS43_read_register(uint8_t reg)
  * 10.Set volume to default (+12dB)
  * 11.Set the passthrough volume to default (+12dB)
  * 12.Maximize the master volume
+ *
+ * The register shadow is loaded with one burst read first, then the
+ * consecutive registers are written in bursts: 8 I2C transactions instead
+ * of the 27 needed with single register reads and writes. Only the reads
+ * wait for the bus, all writes are queued.
  */
 
-void CS43_init(I2C_HandleTypeDef i2c_handle)
+void CS43_init(I2C_HandleTypeDef *i2c_handle)
 {
-    uint8_t data;
+    uint8_t data[CS43_BURST_MAX];
     // unlock and enable the I2S3
 	__HAL_UNLOCK(&hi2s3);
 	__HAL_I2S_ENABLE(&hi2s3);
 
 	HAL_GPIO_WritePin(GPIOD, GPIO_PIN_4, GPIO_PIN_SET);
 
-	//0.Get the I2C handle
-	i2cx = i2c_handle;
+	//0.Get the I2C handle and load the register shadow in one burst
+	i2cQueue_init(i2c_handle);
+	memset(regValid, 0, sizeof(regValid));
+	CS43_fetch_registers(CS43_FIRST_REG, CS43_LAST_REG - CS43_FIRST_REG + 1);
 
 	//1.Power down
 	CS43_write_register(POWER_CONTROL1, 0x01);
 
-	//2.Enable Right and Left headphones
-	data =  (2 << 6);  // PDN_HPB[0:1]  = 10 (HP-B always onCon)
-	data |= (2 << 4);  // PDN_HPA[0:1]  = 10 (HP-A always on)
-	data |= (3 << 2);  // PDN_SPKB[0:1] = 11 (Speaker B always off)
-	data |= (3 << 0);  // PDN_SPKA[0:1] = 11 (Speaker A always off)
-	CS43_write_register(POWER_CONTROL2,data);
-
-	//3.Automatic clock detection
-	data = (1 << 7);
-	CS43_write_register(CLOCKING_CONTROL,data);
-
-	//4.Interface control 1
-	data = CS43_read_register(INTERFACE_CONTROL1);
-	data &= (1 << 5); // Clear all bits except bit 5 which is reserved
-	data &= ~(1 << 7);  // Slave
-	data &= ~(1 << 6);  // Clock polarity: Not inverted
-	data &= ~(1 << 4);  // No DSP mode
-	data &= ~(1 << 2);  // Left justified, up to 24 bit (default)
-	data |= (1 << 2);
-
-	data |=  (3 << 0);  // 16-bit audio word length for I2S interface
-	CS43_write_register(INTERFACE_CONTROL1,data);
-
-	//5.Passthrough A settings
-	data = CS43_read_register(PASSTHROUGH_A);
-	data &= 0xF0;      // Bits [4-7] are reserved
-	data |=  (1 << 0); // Use AIN1A as source for passthrough
-	CS43_write_register(PASSTHROUGH_A, data);
-
-	//6.Passthrough B settings
-	data = CS43_read_register(PASSTHROUGH_B);
-	data &= 0xF0;      // Bits [4-7] are reserved
-	data |=  (1 << 0); // Use AIN1B as source for passthrough
-	CS43_write_register(PASSTHROUGH_B, data);
-
-	//7.Miscellaneous register settings
-	data = CS43_read_register(MISCELLANEOUS_CONTRLS);
-	data = 0x02;
-	CS43_write_register(MISCELLANEOUS_CONTRLS, data);
-
-	//8.Configure the analog gain to be 1.143
-	CS43_write_register(PLAYBACK_CONTROL1, 0xE0);
-
-	//9.Unmute headphone and speaker
-	data = CS43_read_register(PLAYBACK_CONTROL2);
-	data = 0x00;
-	CS43_write_register(PLAYBACK_CONTROL2,data);
+	// Cache the hidden register 0x32 used by the power-up errata, it is
+	// only visible while the 0x99 key is written to register 0x00, so
+	// that CS43_start() never has to wait for a read
+	CS43_write_register(CONFIG_00, 0x99);
+	CS43_fetch_registers(CONFIG_32, 1);
+	CS43_write_register(CONFIG_00, 0x00);
 
-	//10.Set volume to default (+12dB)
-	CS43_write_register(PCM_VOLUME_A,0x18);
-	CS43_write_register(PCM_VOLUME_B,0x18);
+	//2.Enable Right and Left headphones (0x04)
+	data[0] =  (2 << 6);  // PDN_HPB[0:1]  = 10 (HP-B always onCon)
+	data[0] |= (2 << 4);  // PDN_HPA[0:1]  = 10 (HP-A always on)
+	data[0] |= (3 << 2);  // PDN_SPKB[0:1] = 11 (Speaker B always off)
+	data[0] |= (3 << 0);  // PDN_SPKA[0:1] = 11 (Speaker A always off)
+
+	//3.Automatic clock detection (0x05)
+	data[1] = (1 << 7);
+
+	//4.Interface control 1 (0x06)
+	data[2] = CS43_read_register(INTERFACE_CONTROL1);
+	data[2] &= (1 << 5); // Clear all bits except bit 5 which is reserved
+	data[2] &= ~(1 << 7);  // Slave
+	data[2] &= ~(1 << 6);  // Clock polarity: Not inverted
+	data[2] &= ~(1 << 4);  // No DSP mode
+	data[2] &= ~(1 << 2);  // Left justified, up to 24 bit (default)
+	data[2] |= (1 << 2);
+
+	data[2] |=  (3 << 0);  // 16-bit audio word length for I2S interface
+
+	// Interface control 2 (0x07) is kept as is
+	data[3] = CS43_read_register(INTERFACE_CONTROL2);
+
+	//5.Passthrough A settings (0x08)
+	data[4] = CS43_read_register(PASSTHROUGH_A);
+	data[4] &= 0xF0;      // Bits [4-7] are reserved
+	data[4] |=  (1 << 0); // Use AIN1A as source for passthrough
+
+	//6.Passthrough B settings (0x09)
+	data[5] = CS43_read_register(PASSTHROUGH_B);
+	data[5] &= 0xF0;      // Bits [4-7] are reserved
+	data[5] |=  (1 << 0); // Use AIN1B as source for passthrough
+	CS43_write_registers(POWER_CONTROL2, data, 6);
+
+	//8.Configure the analog gain to be 1.143 (0x0D)
+	data[0] = 0xE0;
+	//7.Miscellaneous register settings (0x0E)
+	data[1] = 0x02;
+	//9.Unmute headphone and speaker (0x0F)
+	data[2] = 0x00;
+	CS43_write_registers(PLAYBACK_CONTROL1, data, 3);
 
 	//11.Set the passthrough volume to default (+12dB)
-	CS43_write_register(PASSTHROUGH_VOLUME_A,0x7F);
-	CS43_write_register(PASSTHROUGH_VOLUME_B,0x7F);
+	data[0] = 0x7F;
+	data[1] = 0x7F;
+	CS43_write_registers(PASSTHROUGH_VOLUME_A, data, 2);
+
+	//10.Set volume to default (+12dB)
+	data[0] = 0x18;
+	data[1] = 0x18;
+	CS43_write_registers(PCM_VOLUME_A, data, 2);
 
 	//12.Maximize the master volume
-	CS43_write_register(MASTER_A_VOL,0x00);
-	CS43_write_register(MASTER_B_VOL,0x00);
+	data[0] = 0x00;
+	data[1] = 0x00;
+	CS43_write_registers(MASTER_A_VOL, data, 2);
 
 }
 
@@ -229,8 +372,9 @@ void CS43_set_volume(uint8_t volume)
 	  volume += 25;
   }
 
-  CS43_write_register(HEADPHONE_A_VOL, volume);
-  CS43_write_register(HEADPHONE_B_VOL, volume);
+  uint8_t data[2] = {volume, volume};
+
+  CS43_write_registers(HEADPHONE_A_VOL, data, 2);
 }
 
 
@@ -244,14 +388,21 @@ void CS43_set_volume(uint8_t volume)
  * 3. Write ‘1’b to bit 7 in register 0x32.
  * 4. Write ‘0’b to bit 7 in register 0x32.
  * 5. Write 0x00 to register 0x00.
+ *
+ * With the register shadow a restart after CS43_stop() takes 8 I2C
+ * transactions (25 bytes, ~2.3 ms at 100 kHz) instead of 14 transactions
+ * (38 bytes, ~3.7 ms): register 0x32 is no longer read back twice, the
+ * headphone volumes go out as one burst and the mute write to 0x04 that
+ * CS43_stop() already did is skipped. The transactions are queued in
+ * order and the call returns without waiting for the bus.
  */
 void CS43_start(void)
 {
 	uint8_t data;
+	uint8_t vol[2] = {0x00, 0x00};
 	// Unmute the DAC’s and PWM outputs
 	CS43_write_register(POWER_CONTROL2, 0xFF);
-	CS43_write_register(HEADPHONE_A_VOL,0x00);
-	CS43_write_register(HEADPHONE_B_VOL,0x00);
+	CS43_write_registers(HEADPHONE_A_VOL, vol, 2);
 
 	CS43_write_register(POWER_CONTROL2, 0xAF);
 	// Write 0x99 to register 0x00.
@@ -279,13 +430,17 @@ void CS43_start(void)
  * 	1. Mute the DAC’s and PWM outputs.
  * 	2. Disable soft ramp and zero cross volume transitions.
  * 	3. Set the “Power Ctl 1” register (0x02) to 0x9F.
+ *
+ * With the register shadow this takes at most 4 I2C transactions (13
+ * bytes) instead of 5 (15 bytes), and 3 once the soft ramp setting is
+ * already disabled by a previous stop.
  */
 void CS43_stop(void)
 {
+  uint8_t vol[2] = {0x01, 0x01};
   // Mute the DAC’s and PWM outputs
   CS43_write_register(POWER_CONTROL2, 0xFF);
-  CS43_write_register(HEADPHONE_A_VOL,0x01);
-  CS43_write_register(HEADPHONE_B_VOL,0x01);
+  CS43_write_registers(HEADPHONE_A_VOL, vol, 2);
 
   // Disable soft ramp and zero cross volume transitions.
   CS43_write_register(MISCELLANEOUS_CONTRLS, 0x04);
@@ -293,3 +448,16 @@ void CS43_stop(void)
   // Set the “Power Ctl 1” register (0x02) to 0x9F
   CS43_write_register(POWER_CONTROL1, 0x9F);
 }
+
+/**
+ * @brief Mute or unmute the outputs
+ * @param mute: true to mute the headphone and speaker outputs
+ * @note Only the mute bits of "Playback Control 2" (0x0F) are changed,
+ * the DAC stays powered and clocked, so muting and unmuting is a single
+ * queued I2C write and can be done from any context.
+ */
+void CS43_set_mute(bool mute)
+{
+  // HPBMUTE, HPAMUTE, SPKBMUTE, SPKAMUTE
+  CS43_write_register(PLAYBACK_CONTROL2, mute ? 0xF0 : 0x00);
+}
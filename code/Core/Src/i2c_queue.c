@@ -0,0 +1,357 @@
+/*
+ * i2c_queue.c
+ *
+ * @description: The implementation file of the asynchronous I2C
+ * transaction queue.
+ *
+ * @note The queue is a ring of transactions. The transaction at the head
+ * is the one on the bus, it is started either by the enqueue call when
+ * the queue was idle or by the completion interrupt of the previous
+ * transaction. Queue updates are done with interrupts masked for a few
+ * instructions only, also in the I2C interrupt, which the I2S DMA
+ * interrupt preempts (see irq_prio.h) and may queue a codec command from.
+ * i2cQueue_poll() masks them for its whole body, so the queue does not
+ * depend on the relative levels of SysTick and I2C. A transaction is
+ * never started while the BUSY flag is set, because the HAL would spin on
+ * it with interrupts masked.
+ *
+ * @reference:
+ * 1.ST open-source HAL I2C drivers
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "i2c_queue.h"
+#include "profile.h"
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+/* polls of the BUSY flag while the STOP condition of the previous
+ * transaction finishes, a few tens of microseconds at most */
+#define I2C_QUEUE_STOP_SPIN		1000
+
+/***************************************
+* Local Struct Definition
+****************************************/
+typedef struct
+{
+	uint16_t devAddr;
+	bool isRead;
+	uint8_t len;
+	uint8_t map;						/* register address of a read */
+	uint8_t data[I2C_QUEUE_MAX_DATA];	/* payload of a write */
+	uint8_t *dst;						/* destination of a read */
+	uint32_t deadline;
+	i2c_xfer_cb_t cb;
+	void *ctx;
+}i2c_xfer_t;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static I2C_HandleTypeDef *i2cq;
+static i2c_xfer_t xferQueue[I2C_QUEUE_LEN];
+static volatile uint8_t xferHead;
+static volatile uint8_t xferCount;
+static volatile bool xferActive;
+#if PROFILE_ENABLE
+static uint32_t xferStart;			/* cycle count at the start of the active transaction */
+#endif
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Mask interrupts and return the previous mask state
+ */
+static uint32_t i2cQueue_lock(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+/**
+ * @brief Restore the interrupt mask state
+ */
+static void i2cQueue_unlock(uint32_t primask)
+{
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Complete the transaction at the head of the queue
+ * @param status: The result reported to the callback
+ * @note Must be called with interrupts masked.
+ */
+static void i2cQueue_complete(i2c_xfer_status_t status)
+{
+	i2c_xfer_t *xfer = &xferQueue[xferHead];
+
+#if PROFILE_ENABLE
+	if(xferActive){
+		PROFILE_STOP(PROF_I2C_XFER, xferStart);
+	}
+#endif
+	xferHead = (xferHead + 1) % I2C_QUEUE_LEN;
+	xferCount--;
+	xferActive = false;
+	if(xfer->cb != NULL){
+		xfer->cb(status, xfer->ctx);
+	}
+}
+
+/**
+ * @brief Start the transaction at the head of the queue
+ * @note Transactions whose deadline already passed are completed with
+ * I2C_XFER_TIMEOUT without touching the bus. Nothing is started while
+ * the bus is busy, the next poll tries again.
+ */
+static void i2cQueue_start_next(void)
+{
+	i2c_xfer_t *xfer;
+	HAL_StatusTypeDef res;
+	uint32_t spin;
+
+	while(!xferActive && (xferCount > 0))
+	{
+		xfer = &xferQueue[xferHead];
+		if((int32_t)(HAL_GetTick() - xfer->deadline) > 0)
+		{
+			i2cQueue_complete(I2C_XFER_TIMEOUT);
+			continue;
+		}
+		for(spin = 0; (spin < I2C_QUEUE_STOP_SPIN) &&
+				__HAL_I2C_GET_FLAG(i2cq, I2C_FLAG_BUSY); spin++);
+		if(__HAL_I2C_GET_FLAG(i2cq, I2C_FLAG_BUSY) ||
+		   (HAL_I2C_GetState(i2cq) != HAL_I2C_STATE_READY))
+		{
+			return;
+		}
+
+		xferActive = true;
+#if PROFILE_ENABLE
+		xferStart = PROFILE_START();
+#endif
+		if(xfer->isRead)
+		{
+			res = HAL_I2C_Mem_Read_IT(i2cq, xfer->devAddr, xfer->map,
+					I2C_MEMADD_SIZE_8BIT, xfer->dst, xfer->len);
+		}
+		else
+		{
+			res = HAL_I2C_Master_Transmit_IT(i2cq, xfer->devAddr,
+					xfer->data, xfer->len);
+		}
+		if(res != HAL_OK){
+			i2cQueue_complete(I2C_XFER_ERROR);
+		}
+	}
+}
+
+/**
+ * @brief End the transaction on the bus from the I2C interrupt
+ * @param hi2c - The I2C module whose interrupt is triggered
+ * @param status: The result reported to the callback
+ */
+static void i2cQueue_irq_done(I2C_HandleTypeDef *hi2c, i2c_xfer_status_t status)
+{
+	uint32_t primask;
+
+	if(hi2c != i2cq){
+		return;
+	}
+	primask = i2cQueue_lock();
+	if(xferActive){
+		i2cQueue_complete(status);
+		i2cQueue_start_next();
+	}
+	i2cQueue_unlock(primask);
+}
+
+/**
+ * @brief Append a transaction to the queue and kick the queue
+ * @return false if the queue is full
+ */
+static bool i2cQueue_push(const i2c_xfer_t *xfer)
+{
+	uint32_t primask = i2cQueue_lock();
+
+	if(xferCount >= I2C_QUEUE_LEN)
+	{
+		i2cQueue_unlock(primask);
+		return false;
+	}
+	xferQueue[(xferHead + xferCount) % I2C_QUEUE_LEN] = *xfer;
+	xferCount++;
+	i2cQueue_start_next();
+	i2cQueue_unlock(primask);
+	return true;
+}
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Initialize the queue
+ * @param hi2c: The I2C handle used for all transactions, its event and
+ * error interrupts must be enabled
+ */
+void i2cQueue_init(I2C_HandleTypeDef *hi2c)
+{
+	i2cq = hi2c;
+	xferHead = 0;
+	xferCount = 0;
+	xferActive = false;
+}
+
+/**
+ * @brief Queue a write transaction
+ * @param devAddr: The 8-bit device address
+ * @param data: The bytes to send, copied into the queue
+ * @param len: The number of bytes (1..I2C_QUEUE_MAX_DATA)
+ * @param timeoutMs: The deadline of the transaction from now on
+ * @param cb: The completion callback, may be NULL
+ * @param ctx: The callback argument
+ * @return false if the transaction could not be queued
+ */
+bool i2cQueue_write(uint16_t devAddr, const uint8_t *data, uint8_t len,
+		uint32_t timeoutMs, i2c_xfer_cb_t cb, void *ctx)
+{
+	i2c_xfer_t xfer;
+
+	if((len == 0) || (len > I2C_QUEUE_MAX_DATA)){
+		return false;
+	}
+	xfer.devAddr = devAddr;
+	xfer.isRead = false;
+	xfer.len = len;
+	xfer.map = 0;
+	memcpy(xfer.data, data, len);
+	xfer.dst = NULL;
+	xfer.deadline = HAL_GetTick() + timeoutMs;
+	xfer.cb = cb;
+	xfer.ctx = ctx;
+	return i2cQueue_push(&xfer);
+}
+
+/**
+ * @brief Queue a register read transaction
+ * @param devAddr: The 8-bit device address
+ * @param map: The register address byte sent before the repeated start
+ * @param dst: The destination, must stay valid until completion
+ * @param len: The number of bytes to read
+ * @param timeoutMs: The deadline of the transaction from now on
+ * @param cb: The completion callback, may be NULL
+ * @param ctx: The callback argument
+ * @return false if the transaction could not be queued
+ */
+bool i2cQueue_read(uint16_t devAddr, uint8_t map, uint8_t *dst, uint8_t len,
+		uint32_t timeoutMs, i2c_xfer_cb_t cb, void *ctx)
+{
+	i2c_xfer_t xfer;
+
+	if(len == 0){
+		return false;
+	}
+	xfer.devAddr = devAddr;
+	xfer.isRead = true;
+	xfer.len = len;
+	xfer.map = map;
+	xfer.dst = dst;
+	xfer.deadline = HAL_GetTick() + timeoutMs;
+	xfer.cb = cb;
+	xfer.ctx = ctx;
+	return i2cQueue_push(&xfer);
+}
+
+/**
+ * @brief Enforce the deadlines and restart a stalled queue
+ * @note Called from the SysTick interrupt. A transaction on the bus past
+ * its deadline is completed with I2C_XFER_TIMEOUT and the peripheral is
+ * re-initialized to release the bus. The whole body runs with interrupts
+ * masked: in the FreeRTOS build SysTick is below the I2C interrupts, which
+ * must not see the queue or the handle halfway through a restart.
+ */
+void i2cQueue_poll(void)
+{
+	uint32_t primask = i2cQueue_lock();
+
+	if(i2cq == NULL){
+		i2cQueue_unlock(primask);
+		return;
+	}
+	if(xferActive &&
+	   ((int32_t)(HAL_GetTick() - xferQueue[xferHead].deadline) > 0))
+	{
+		HAL_I2C_DeInit(i2cq);
+		HAL_I2C_Init(i2cq);
+		i2cQueue_complete(I2C_XFER_TIMEOUT);
+	}
+	i2cQueue_start_next();
+	i2cQueue_unlock(primask);
+}
+
+/**
+ * @brief Check whether all queued transactions are done
+ */
+bool i2cQueue_idle(void)
+{
+	return (xferCount == 0);
+}
+
+/**
+ * @brief Wait until all queued transactions are done
+ * @param timeoutMs: The maximum time to wait
+ * @return true if the queue drained in time
+ * @note Blocking, for initialization code only. Must not be called from
+ * an interrupt handler.
+ */
+bool i2cQueue_flush(uint32_t timeoutMs)
+{
+	uint32_t start = HAL_GetTick();
+
+	while(!i2cQueue_idle())
+	{
+		if((HAL_GetTick() - start) > timeoutMs){
+			return false;
+		}
+		i2cQueue_poll();
+	}
+	return true;
+}
+
+/**
+ * @brief The callback function for the master TX completion interrupt
+ * @param hi2c - The pointer to the I2C module whose interrupt is triggered
+ */
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	i2cQueue_irq_done(hi2c, I2C_XFER_OK);
+}
+
+/**
+ * @brief The callback function for the memory RX completion interrupt
+ * @param hi2c - The pointer to the I2C module whose interrupt is triggered
+ */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	i2cQueue_irq_done(hi2c, I2C_XFER_OK);
+}
+
+/**
+ * @brief The callback function for the I2C error interrupt
+ * @param hi2c - The pointer to the I2C module whose interrupt is triggered
+ */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	i2cQueue_irq_done(hi2c, I2C_XFER_ERROR);
+}
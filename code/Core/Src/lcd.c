@@ -40,7 +40,20 @@
 #define ENTRY_MODE_SET  (0x06)
 #define LCD_MODE 		(0x28)
 #define MODE_4_BIT 		(0x20)
+#define SET_CGRAM_ADDR	(0x40)
+#define CUR_UNKNOWN		(-1)
 
+/***************************************
+* Local Variable Definition
+****************************************/
+
+// what is currently shown on the glass
+static char lcdShadow[LCD_ROWS][LCD_COLS];
+// what the UI wants to show, flushed cell by cell
+static char lcdFrame[LCD_ROWS][LCD_COLS];
+// tracked DDRAM cursor, CUR_UNKNOWN when it has to be re-sent
+static int curRow = CUR_UNKNOWN;
+static int curCol = CUR_UNKNOWN;
 
 
 /***************************************
@@ -107,6 +120,33 @@ static void lcd_send_data (char data)
 	lcd_write((data>>4)&0x0f,1);
 	/* send Lower 4-bit */
 	lcd_write((data)&0x0f, 1);
+
+	// keep the shadow in sync with the glass, the address
+	// counter auto-increments but leaves the visible area at the
+	// end of a row
+	if((curRow != CUR_UNKNOWN) && (curCol != CUR_UNKNOWN))
+	{
+		lcdShadow[curRow][curCol] = data;
+		lcdFrame[curRow][curCol] = data;
+		curCol = (curCol + 1 < LCD_COLS) ? (curCol + 1) : CUR_UNKNOWN;
+	}
+}
+
+/**
+ * @brief Fill both the shadow and the frame buffer with spaces
+ */
+static void lcd_fb_reset(void)
+{
+	int row, col;
+
+	for(row = 0; row < LCD_ROWS; row++)
+	{
+		for(col = 0; col < LCD_COLS; col++)
+		{
+			lcdShadow[row][col] = ' ';
+			lcdFrame[row][col] = ' ';
+		}
+	}
 }
 
 /**
@@ -117,6 +157,9 @@ void lcd_clear (void)
 {
 	lcd_send_cmd(CLR_LCD);
 	HAL_Delay(10);
+	lcd_fb_reset();
+	curRow = 0;
+	curCol = 0;
 }
 
 /**
@@ -126,6 +169,8 @@ void lcd_clear (void)
  */
 void lcd_update_cur(int row, int col)
 {
+	curRow = row;
+	curCol = col;
 	col |= (row == 0) ? ROW_0 : ROW_1;
     lcd_send_cmd(col);
 }
@@ -182,6 +227,7 @@ void lcd_init (void)
 	// clear display
 	lcd_send_cmd (CLR_LCD);
 	HAL_Delay(15);
+	lcd_fb_reset();
 
 	// Entry mode set
 	// I/D = 1 (increment cursor)
@@ -207,3 +253,88 @@ void lcd_write_string (char *str)
 		lcd_send_data(*str++);
 	}
 }
+
+/**
+ * @brief Load a custom glyph into the character generator RAM
+ * @param slot: the CGRAM slot (0-7), shown by writing character code slot
+ * @param rows: 8 pixel rows, the low 5 bits of each row are used
+ * @note The address counter is left in CGRAM, so the cursor has to be
+ * re-sent before the next character write.
+ */
+void lcd_create_char(uint8_t slot, const uint8_t *rows)
+{
+	int i;
+
+	lcd_send_cmd(SET_CGRAM_ADDR | ((slot & (LCD_CGRAM_SLOTS - 1)) << 3));
+	curRow = CUR_UNKNOWN;
+	curCol = CUR_UNKNOWN;
+	for(i = 0; i < 8; i++){
+		lcd_send_data(rows[i] & 0x1F);
+	}
+}
+
+/**
+ * @brief Put a character into the frame buffer
+ * @param row: the destination row number
+ * @param col: the destination col number
+ * @param c: the character code, CGRAM glyphs are codes 0-7
+ * @note Nothing is sent to the LCD until lcd_flush() is called.
+ */
+void lcd_fb_put(int row, int col, char c)
+{
+	if((row < 0) || (row >= LCD_ROWS) || (col < 0) || (col >= LCD_COLS)){
+		return;
+	}
+	lcdFrame[row][col] = c;
+}
+
+/**
+ * @brief Put a string into the frame buffer
+ * @param row: the destination row number
+ * @param col: the first col number
+ * @param str: the string to be displayed
+ * @param width: the number of cells to fill, the remainder is padded
+ * with spaces
+ */
+void lcd_fb_write(int row, int col, const char *str, int width)
+{
+	while(width-- > 0){
+		lcd_fb_put(row, col++, (*str) ? *str++ : ' ');
+	}
+}
+
+/**
+ * @brief Send the dirty cells of the frame buffer to the LCD
+ * @param maxCells: the upper bound of cells to be sent in this call
+ * @return the number of cells sent
+ * @note Only cells that differ from what is on the glass are sent, and
+ * the cursor is only re-positioned when the next dirty cell is not the
+ * one the address counter already points at. The bound keeps the time
+ * spent bit-banging the bus per call predictable, the remaining dirty
+ * cells are picked up by the next call.
+ */
+int lcd_flush(int maxCells)
+{
+	int row, col;
+	int sent = 0;
+
+	for(row = 0; row < LCD_ROWS; row++)
+	{
+		for(col = 0; col < LCD_COLS; col++)
+		{
+			if(sent >= maxCells){
+				return sent;
+			}
+			if(lcdFrame[row][col] == lcdShadow[row][col]){
+				continue;
+			}
+			if((curRow != row) || (curCol != col)){
+				lcd_update_cur(row, col);
+			}
+			lcd_send_data(lcdFrame[row][col]);
+			sent++;
+		}
+	}
+
+	return sent;
+}
@@ -0,0 +1,272 @@
+/*
+ *  lcd_ui.c
+ *
+ *  @description: The player UI layer on top of the HD44780 LCD driver.
+ *  The UI never talks to the LCD directly, it only composes the frame
+ *  buffer and lets lcd_flush() send the cells that changed.
+ *
+ *  @Screen Layout:
+ *  - Row 0: song title, scrolled as a marquee when longer than 16 chars
+ *  - Row 1: "mm:ss" elapsed, 5-cell progress bar, "-mm:ss" remaining
+ *
+ *  @Bus Budget: A cell costs at most one cursor command and one data
+ *  byte, i.e. 4 nibble strobes of ~120 us each (~0.5 ms). At most
+ *  LCD_UI_CELLS_PER_TICK cells are sent every LCD_UI_TICK_MS, which caps
+ *  the LCD at 160 cells/s (~80 ms of bus time per second, ~4 ms in one
+ *  go) in the worst case. A tick is deferred while an audio refill is
+ *  pending so the LCD never delays the refill.
+ *
+ *  @Author: Shuran Xu
+ *
+ *  @Revision: 1.0
+ *
+ *  @Date 2026-10-18
+ */
+
+#include "lcd_ui.h"
+#include "lcd.h"
+#include "wav_player.h"
+#include "profile.h"
+#include "stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#define LCD_UI_TICK_MS				(50)
+#define LCD_UI_CELLS_PER_TICK		(8)
+#define LCD_UI_MARQUEE_STEP_MS		(300)
+#define LCD_UI_MARQUEE_HOLD_MS		(1500)
+#define LCD_UI_MARQUEE_GAP			(4)
+#define LCD_UI_VOLUME_HOLD_MS		(1500)
+#define LCD_UI_TITLE_MAX			(64)
+
+#define LCD_UI_TIME_COLS			(5)
+#define LCD_UI_BAR_COL				(5)
+#define LCD_UI_BAR_CELLS			(5)
+#define LCD_UI_REMAIN_COL			(10)
+#define LCD_UI_REMAIN_COLS			(6)
+#define LCD_UI_PIXELS_PER_CELL		(5)
+
+// CGRAM slot of the bar glyph with n filled pixel columns (n = 0..5),
+// slot 0 is left unused so glyphs never look like a string terminator
+#define LCD_UI_BAR_GLYPH(n)			((char)(1 + (n)))
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static char uiTitle[LCD_UI_TITLE_MAX + 1];
+static int uiTitleLen;
+static int marqueeOffset;
+static uint32_t marqueeStepAt;
+
+static volatile uint8_t uiVolume;
+static volatile bool uiVolumeChanged;
+static uint32_t volumeShownUntil;
+
+static uint32_t lastTickMs;
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Build the progress bar glyphs in CGRAM
+ * @note Each glyph has a top and a bottom frame line and n filled
+ * pixel columns from the left, so 5 cells give 25 bar positions.
+ */
+static void lcdUi_load_glyphs(void)
+{
+	uint8_t rows[8];
+	uint8_t fill;
+	int n, r;
+
+	for(n = 0; n <= LCD_UI_PIXELS_PER_CELL; n++)
+	{
+		fill = (uint8_t)(0x1F & ~(0x1F >> n));
+		rows[0] = 0x1F;
+		for(r = 1; r < 7; r++){
+			rows[r] = fill;
+		}
+		rows[7] = 0x1F;
+		lcd_create_char((uint8_t)LCD_UI_BAR_GLYPH(n), rows);
+	}
+}
+
+/**
+ * @brief Format a time as "mm:ss", minutes clamped to 99
+ * @param buf: the destination buffer, at least 7 bytes
+ * @param ms: the time in milliseconds
+ * @param sign: the prefix character, 0 for none
+ */
+static void lcdUi_format_time(char *buf, uint32_t ms, char sign)
+{
+	uint32_t sec = ms / 1000;
+	uint32_t min = sec / 60;
+
+	if(min > 99){
+		min = 99;
+		sec = 59;
+	}
+	else{
+		sec %= 60;
+	}
+
+	if(sign){
+		sprintf(buf, "%c%02lu:%02lu", sign, (unsigned long)min, (unsigned long)sec);
+	}
+	else{
+		sprintf(buf, "%02lu:%02lu", (unsigned long)min, (unsigned long)sec);
+	}
+}
+
+/**
+ * @brief Compose the title row
+ * @param now: the current tick in milliseconds
+ * @note Titles that fit are shown as they are. Longer titles scroll
+ * one cell per step through a ring of "title + gap", so the end of the
+ * title is followed by its start without a jump, and the marquee holds
+ * for a moment each time the start of the title is back in place.
+ */
+static void lcdUi_draw_title(uint32_t now)
+{
+	int period, col, idx;
+
+	if(uiTitleLen <= LCD_COLS)
+	{
+		lcd_fb_write(0, 0, uiTitle, LCD_COLS);
+		return;
+	}
+
+	if((int32_t)(now - marqueeStepAt) >= 0)
+	{
+		period = uiTitleLen + LCD_UI_MARQUEE_GAP;
+		marqueeOffset = (marqueeOffset + 1) % period;
+		marqueeStepAt = now + ((marqueeOffset == 0) ?
+				LCD_UI_MARQUEE_HOLD_MS : LCD_UI_MARQUEE_STEP_MS);
+	}
+
+	period = uiTitleLen + LCD_UI_MARQUEE_GAP;
+	for(col = 0; col < LCD_COLS; col++)
+	{
+		idx = (marqueeOffset + col) % period;
+		lcd_fb_put(0, col, (idx < uiTitleLen) ? uiTitle[idx] : ' ');
+	}
+}
+
+/**
+ * @brief Compose the status row
+ * @param now: the current tick in milliseconds
+ */
+static void lcdUi_draw_status(uint32_t now)
+{
+	char str[LCD_COLS + 1];
+	uint32_t duration, elapsed, filled;
+	int i, pixels;
+
+	if(uiVolumeChanged)
+	{
+		uiVolumeChanged = false;
+		volumeShownUntil = now + LCD_UI_VOLUME_HOLD_MS;
+	}
+	if((int32_t)(volumeShownUntil - now) > 0)
+	{
+		sprintf(str, "Volume(dB):%d", uiVolume);
+		lcd_fb_write(1, 0, str, LCD_COLS);
+		return;
+	}
+
+	duration = wavPlayer_getDurationMs();
+	elapsed = wavPlayer_getElapsedMs();
+	if(elapsed > duration){
+		elapsed = duration;
+	}
+
+	lcdUi_format_time(str, elapsed, 0);
+	lcd_fb_write(1, 0, str, LCD_UI_TIME_COLS);
+
+	filled = (duration == 0) ? 0 :
+			(uint32_t)(((uint64_t)elapsed * LCD_UI_BAR_CELLS * LCD_UI_PIXELS_PER_CELL) / duration);
+	for(i = 0; i < LCD_UI_BAR_CELLS; i++)
+	{
+		pixels = (int)filled - (i * LCD_UI_PIXELS_PER_CELL);
+		pixels = (pixels < 0) ? 0 : pixels;
+		pixels = (pixels > LCD_UI_PIXELS_PER_CELL) ? LCD_UI_PIXELS_PER_CELL : pixels;
+		lcd_fb_put(1, LCD_UI_BAR_COL + i, LCD_UI_BAR_GLYPH(pixels));
+	}
+
+	lcdUi_format_time(str, duration - elapsed, '-');
+	lcd_fb_write(1, LCD_UI_REMAIN_COL, str, LCD_UI_REMAIN_COLS);
+}
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Initialize the UI layer
+ * @note Must be called after lcd_init(). This is the only UI call that
+ * talks to the LCD synchronously.
+ */
+void lcdUi_init(void)
+{
+	lcdUi_load_glyphs();
+	lcd_clear();
+	uiTitle[0] = '\0';
+	uiTitleLen = 0;
+	volumeShownUntil = 0;
+	lastTickMs = HAL_GetTick();
+}
+
+/**
+ * @brief Set the title shown on the top row
+ * @param title: the title, truncated to LCD_UI_TITLE_MAX characters
+ */
+void lcdUi_setTitle(const char *title)
+{
+	strncpy(uiTitle, title, LCD_UI_TITLE_MAX);
+	uiTitle[LCD_UI_TITLE_MAX] = '\0';
+	uiTitleLen = (int)strlen(uiTitle);
+	marqueeOffset = 0;
+	marqueeStepAt = HAL_GetTick() + LCD_UI_MARQUEE_HOLD_MS;
+}
+
+/**
+ * @brief Show the volume on the bottom row for a while
+ * @param volume: the volume to be shown
+ * @note Only latches the value, the row is redrawn on the next tick, so
+ * this can be called from the button interrupt.
+ */
+void lcdUi_setVolume(uint8_t volume)
+{
+	uiVolume = volume;
+	uiVolumeChanged = true;
+}
+
+/**
+ * @brief Animate the UI and flush the dirty cells
+ * @note Runs at most once per LCD_UI_TICK_MS and sends at most
+ * LCD_UI_CELLS_PER_TICK cells. Cells left dirty are sent on the next
+ * tick. A pending audio refill postpones the tick to the next call.
+ */
+void lcdUi_process(void)
+{
+	uint32_t now = HAL_GetTick();
+	uint32_t start;
+
+	if((now - lastTickMs) < LCD_UI_TICK_MS){
+		return;
+	}
+	if(wavPlayer_refillPending()){
+		return;
+	}
+	lastTickMs = now;
+
+	lcdUi_draw_title(now);
+	lcdUi_draw_status(now);
+	start = PROFILE_START();
+	lcd_flush(LCD_UI_CELLS_PER_TICK);
+	PROFILE_STOP(PROF_LCD_FLUSH, start);
+}
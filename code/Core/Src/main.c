@@ -30,7 +30,13 @@
 /* USER CODE BEGIN Includes */
 #include "cs43l22.h"
 #include "wav_player.h"
+#include "wav_library.h"
 #include "lcd.h"
+#include "lcd_ui.h"
+#include "profile.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "app_rtos.h"
 #include <string.h>
 #include <stdio.h>
 /* USER CODE END Includes */
@@ -60,8 +66,7 @@ DMA_HandleTypeDef hdma_spi3_tx;
 TIM_HandleTypeDef htim1;
 
 /* USER CODE BEGIN PV */
-#define NUM_SONGS 			(11)
-#define DEFAULT_SONG_IDX 	(1)
+#define DEFAULT_SONG_IDX 	(0)
 #define GREEN_LED	        (GPIO_PIN_12)
 #define ORANGE_LED			(GPIO_PIN_13)
 #define RED_LED				(GPIO_PIN_14)
@@ -72,12 +77,19 @@ TIM_HandleTypeDef htim1;
 #define EXT_PB3				(GPIO_PIN_3)
 #define EXT_PB4				(GPIO_PIN_4)
 #define DELAY_200MS			(200)
+#define BUTTON_DEBOUNCE_MS	(50)
 #define DELAY_500MS			(500)
 #define DELAY_1S			(1000)
 #define DELAY_4S			(4000)
-
-const char* songs[NUM_SONGS] = {"Song1.wav", "Song2.wav", "Song3.wav", "Song4.wav", "Song5.wav", "Song6.wav",
-		"Song7.wav", "Song8.wav", "Song9.wav", "Song10.wav", "Song11.wav"};
+#ifdef WAV_PLAYER_BENCHMARK
+#define BENCHMARK_FILE		"/BENCH.WAV"
+#endif
+#define TASK_AUDIO_DEADLINE_MS	(2)		/* refill started after release */
+#define TASK_AUDIO_URGENT_US	(4000)	/* refill slack that runs it first */
+#define TASK_CONTROL_PERIOD_MS	(10)
+#define TASK_BACKGROUND_DEADLINE_MS (1)
+#define TASK_UI_PERIOD_MS		(10)
+#define TASK_TELEMETRY_PERIOD_MS (10)
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -96,33 +108,285 @@ typedef enum{
 	NEXT_SONG,
 	PREV_SONG
 }song_mov_t;
+
+typedef enum{
+	APP_WAIT_USB=0,		/* no volume mounted yet */
+	APP_IDLE,			/* waiting for the first press */
+	APP_STARTING,		/* orange LED on, the track starts soon */
+	APP_PLAYING,
+	APP_GAP				/* silence between two tracks */
+}app_state_t;
+
+static void task_control(void);
+static void task_scan(void);
+static void task_telemetry(void);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 volatile uint8_t volume = 200;
-volatile uint8_t song_idx = DEFAULT_SONG_IDX;
+volatile uint16_t song_idx = DEFAULT_SONG_IDX;
 volatile song_mov_t song_mov = CURR_SONG;
+static app_state_t appState = APP_WAIT_USB;
+static volatile uint16_t buttonPending;		/* EXT_PB presses not acted on yet */
+static uint32_t buttonEdgeTick[16];			/* last accepted press per EXTI line */
+static uint32_t appStateTick;
+static bool pauseResumeToggle;
+wavPlayer_telemetry_t playerTelemetry;	/* refreshed for the debugger */
+uint32_t cpuDutyPermille;				/* CPU time awake, main loop build, for the debugger */
+
+/* The main loop tasks, see scheduler.h. The control task comes first so
+ * that a button press is answered within its period, the audio refill
+ * overtakes it when the DMA is about to catch up with the ring. The
+ * background task reads ahead and powers the codec down, the USB host
+ * state machine is not a task, it runs in PendSV. The FreeRTOS build
+ * runs the refill and the read-ahead in the audio thread and the rest of
+ * the table in the UI thread. */
+static sched_task_t tasks[] =
+{
+	{ .name = "control", .run = task_control, .priority = 0,
+	  .periodMs = TASK_CONTROL_PERIOD_MS, .deadlineMs = TASK_CONTROL_PERIOD_MS },
+#ifndef WAV_PLAYER_RTOS
+	{ .name = "audio", .run = wavPlayer_proceed, .ready = wavPlayer_refillPending,
+	  .slack = wavPlayer_refillSlackUs, .priority = 1,
+	  .deadlineMs = TASK_AUDIO_DEADLINE_MS, .urgentUs = TASK_AUDIO_URGENT_US },
+	{ .name = "background", .run = wavPlayer_background, .ready = wavPlayer_backgroundPending,
+	  .priority = 2, .deadlineMs = TASK_BACKGROUND_DEADLINE_MS },
+#endif
+	{ .name = "ui", .run = lcdUi_process, .priority = 3,
+	  .periodMs = TASK_UI_PERIOD_MS, .deadlineMs = TASK_UI_PERIOD_MS },
+	{ .name = "telemetry", .run = task_telemetry, .priority = 4,
+	  .periodMs = TASK_TELEMETRY_PERIOD_MS, .deadlineMs = TASK_TELEMETRY_PERIOD_MS },
+	{ .name = "scan", .run = task_scan, .ready = wavLib_scanning, .priority = 5,
+	  .deadlineMs = DELAY_1S },
+};
 
 static void display_song_info(void)
 {
+	lcdUi_setTitle(wavLib_title(song_idx));
+}
+
+/**
+ * @brief Open the current library track
+ * @return true when the track is ready to play
+ */
+static bool open_song(void)
+{
+	char path[WAVLIB_PATH_MAX];
+
+	return wavLib_path(song_idx, path, sizeof(path)) && wavPlayer_openFile(path);
+}
+
+#ifdef WAV_PLAYER_BENCHMARK
+/**
+ * @brief Show the streaming throughput of BENCHMARK_FILE on the LCD
+ * @note Copy the same file to a FAT32 and an exFAT stick to compare them:
+ * the top row shows the file system, the bottom row kB/s and the number
+ * of fragments ("C" for a contiguous exFAT file without FAT chain). The
+ * second screen shows the CPU cycles per second of audio when streaming
+ * through the sector buffer and straight into the audio buffer.
+ */
+static void run_benchmark(void)
+{
+	static const char *fsNames[] = {"?", "FAT12", "FAT16", "FAT32", "exFAT"};
+	wavPlayer_bench_t bench;
+	char str[LCD_COLS + 1];
+
+	if(!wavPlayer_benchmark(BENCHMARK_FILE, &bench)){
+		return;
+	}
 	lcd_clear();
-	HAL_Delay(DELAY_500MS);
 	lcd_update_cur(0, 0);
-	char str[64];
-	sprintf(str,"Song:%s", songs[song_idx]);
+	lcd_write_string((char *)fsNames[(bench.fsType <= FS_EXFAT) ? bench.fsType : 0]);
+	lcd_update_cur(1, 0);
+	if(bench.noFatChain){
+		snprintf(str, sizeof(str), "%lukB/s C", (unsigned long)bench.kBps);
+	}
+	else{
+		snprintf(str, sizeof(str), "%lukB/s F%lu", (unsigned long)bench.kBps,
+				(unsigned long)bench.fragments);
+	}
+	lcd_write_string(str);
+	HAL_Delay(DELAY_4S);
+	//CPU cycles per second of audio, in thousands
+	lcd_clear();
+	lcd_update_cur(0, 0);
+	snprintf(str, sizeof(str), "copy %lukc/s", (unsigned long)(bench.copyCyclesPerSec / 1000));
 	lcd_write_string(str);
 	lcd_update_cur(1, 0);
-	sprintf(str,"Volume(dB):%d", volume);
+	snprintf(str, sizeof(str), "dir. %lukc/s", (unsigned long)(bench.directCyclesPerSec / 1000));
 	lcd_write_string(str);
+	HAL_Delay(DELAY_4S);
 }
+#endif
 
-static void update_volume_display(void)
+/**
+ * @brief Detect a press of the user push button
+ * @return true once per press, on the released-to-pressed edge
+ * @note Polled from the main loop without blocking: a level change is
+ * only accepted BUTTON_DEBOUNCE_MS after the previous accepted change, so
+ * contact bounce is ignored and a held button counts as a single press.
+ */
+static bool pause_button_pressed(void)
 {
-	char str[32];
-	lcd_update_cur(1, 0);
-	sprintf(str,"Volume(dB):%d", volume);
-	lcd_write_string(str);
+	static GPIO_PinState lastLevel = GPIO_PIN_RESET;
+	static uint32_t lastEdgeTick;
+	GPIO_PinState level = HAL_GPIO_ReadPin(GPIOA, PUSH_BUTTON1);
+	uint32_t now = HAL_GetTick();
+
+	if((level == lastLevel) || ((now - lastEdgeTick) < BUTTON_DEBOUNCE_MS)){
+		return false;
+	}
+	lastLevel = level;
+	lastEdgeTick = now;
+	TRACE(TRACE_EV_BUTTON, level, PUSH_BUTTON1);
+	return (level == GPIO_PIN_SET);
+}
+
+/**
+ * @brief Move the player to a new state
+ */
+static void app_enter(app_state_t state)
+{
+	appState = state;
+	appStateTick = HAL_GetTick();
+}
+
+/**
+ * @brief Open the current track and start it
+ * @note A track that can not be opened counts as finished, so the player
+ * goes on with the next one.
+ */
+static void start_song(void)
+{
+	song_mov = CURR_SONG;
+	pauseResumeToggle = 0;
+	HAL_GPIO_WritePin(GPIOD, RED_LED, GPIO_PIN_RESET);
+	if(open_song()){
+		display_song_info();
+		wavPlayer_play();
+	}
+}
+
+/**
+ * @brief The control task: USB state LEDs, mounting and the track sequence
+ * @note Never waits: the pause before a track and the gap between two
+ * tracks are states left when their time is up, so the audio refill and
+ * the other tasks keep running through them. Holds the player lock, the
+ * audio thread of the FreeRTOS build refills the ring meanwhile.
+ */
+static void task_control(void)
+{
+	uint32_t now = HAL_GetTick();
+
+	appRtos_lockPlayer();
+#ifdef WAV_PLAYER_RTOS
+	app_buttons();
+#endif
+
+	if(Appli_state == APPLICATION_START)
+	{
+		HAL_GPIO_WritePin(GPIOD, GREEN_LED, GPIO_PIN_SET);
+	}
+	else if(Appli_state == APPLICATION_DISCONNECT)
+	{
+		HAL_GPIO_WritePin(GPIOD, GREEN_LED, GPIO_PIN_RESET);
+	}
+
+	switch(appState)
+	{
+	case APP_WAIT_USB:
+		if(Appli_state == APPLICATION_READY)
+		{
+			f_mount(&USBHFatFS, (const TCHAR*)USBHPath, 0);
+#ifdef WAV_PLAYER_BENCHMARK
+			run_benchmark();
+#endif
+			// load the track index, or start building it in the background
+			wavLib_mount();
+			song_idx = DEFAULT_SONG_IDX;
+			app_enter(APP_IDLE);
+		}
+		break;
+
+	case APP_IDLE:
+		if(pause_button_pressed() && (wavLib_count() > 0))
+		{
+			HAL_GPIO_WritePin(GPIOD, ORANGE_LED, GPIO_PIN_SET);
+			app_enter(APP_STARTING);
+		}
+		break;
+
+	case APP_STARTING:
+		if((now - appStateTick) >= DELAY_500MS)
+		{
+			start_song();
+			app_enter(APP_PLAYING);
+		}
+		break;
+
+	case APP_PLAYING:
+		if(is_wavPlayer_finished_Playing())
+		{
+			/* increase the song index if there are pending songs available */
+			if((song_idx + 1) < wavLib_count()){
+				song_idx++;
+			}
+			HAL_GPIO_WritePin(GPIOD, ORANGE_LED, GPIO_PIN_RESET);
+			app_enter(APP_GAP);
+		}
+		else if((song_mov == PREV_SONG) || (song_mov == NEXT_SONG))
+		{
+			// a song skipped while paused starts playing right away
+			wavPlayer_stop();
+			start_song();
+		}
+		else if(pause_button_pressed())
+		{
+			pauseResumeToggle ^= 1;
+			if(pauseResumeToggle)
+			{
+				HAL_GPIO_WritePin(GPIOD, RED_LED, GPIO_PIN_SET);
+				wavPlayer_pause();
+			}
+			else
+			{
+				HAL_GPIO_WritePin(GPIOD, RED_LED, GPIO_PIN_RESET);
+				wavPlayer_resume();
+			}
+		}
+		break;
+
+	case APP_GAP:
+		if((now - appStateTick) >= DELAY_1S)
+		{
+			HAL_GPIO_WritePin(GPIOD, ORANGE_LED, GPIO_PIN_SET);
+			app_enter(APP_STARTING);
+		}
+		break;
+	}
+	appRtos_unlockPlayer();
+}
+
+/**
+ * @brief The library scan task, one time budget per run
+ */
+static void task_scan(void)
+{
+	wavLib_process(WAVLIB_STEP_BUDGET_US);
+}
+
+/**
+ * @brief The telemetry task: SWO trace streaming, the refill snapshot and
+ * the CPU duty cycle
+ */
+static void task_telemetry(void)
+{
+	trace_poll();
+	wavPlayer_getTelemetry(&playerTelemetry);
+#ifndef WAV_PLAYER_RTOS
+	cpuDutyPermille = sched_dutyPermille();
+#endif
 }
 
 /* USER CODE END 0 */
@@ -165,6 +429,8 @@ int main(void)
   /* USER CODE BEGIN 2 */
 
   HAL_TIM_Base_Start(&htim1);
+  profile_init();
+  trace_init();
   lcd_init ();
   lcd_clear();
   HAL_Delay(DELAY_1S);
@@ -172,16 +438,17 @@ int main(void)
   lcd_write_string("MINI ");
   lcd_write_string("WAV Player ");
   HAL_Delay(DELAY_4S);
-  lcd_clear();
+  lcdUi_init();
 
-  CS43_init(hi2c1);
+  CS43_init(&hi2c1);
   wavPlayer_reset();
 
-  volatile bool isSdCardMounted = 0;
-  volatile bool pauseResumeToggle = 0;
-  volatile bool start_song = 0;
-
   song_idx = DEFAULT_SONG_IDX;
+#ifdef WAV_PLAYER_RTOS
+  appRtos_start(tasks, sizeof(tasks) / sizeof(tasks[0]));
+#else
+  sched_init(tasks, sizeof(tasks) / sizeof(tasks[0]));
+#endif
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -189,81 +456,10 @@ int main(void)
   while (1)
   {
     /* USER CODE END WHILE */
-    MX_USB_HOST_Process();
-
     /* USER CODE BEGIN 3 */
-    if(Appli_state == APPLICATION_START)
+    if(!sched_run())
     {
-    	HAL_GPIO_WritePin(GPIOD, GREEN_LED, GPIO_PIN_SET);
-    }
-    else if(Appli_state == APPLICATION_DISCONNECT)
-    {
-    	HAL_GPIO_WritePin(GPIOD, GREEN_LED, GPIO_PIN_RESET);
-    }
-
-    if(Appli_state == APPLICATION_READY)
-    {
-    	if(!isSdCardMounted)
-    	{
-    		isSdCardMounted = 1;
-    		f_mount(&USBHFatFS, (const TCHAR*)USBHPath, 0);
-    	}
-
-    	int button_pressed = HAL_GPIO_ReadPin(GPIOA, PUSH_BUTTON1);
-    	if(button_pressed){
-    		start_song = 1;
-    	}
-
-    	if(start_song)
-    	{
-    		HAL_GPIO_WritePin(GPIOD, ORANGE_LED, GPIO_PIN_SET);
-    		HAL_Delay(500);
-    		if(wavPlayer_openFile(songs[song_idx])){
-    			display_song_info();
-				wavPlayer_play();
-			}
-
-    		while(!is_wavPlayer_finished_Playing())
-    		{
-    			if((song_mov == PREV_SONG) || (song_mov == NEXT_SONG)){
-    				// reset song_mov
-    				song_mov = CURR_SONG;
-    				wavPlayer_stop();
-    				if(wavPlayer_openFile(songs[song_idx])){
-    					display_song_info();
-    					wavPlayer_play();
-    				}
-    			}
-    			else{
-    				wavPlayer_proceed();
-					if(HAL_GPIO_ReadPin(GPIOA, PUSH_BUTTON1))
-					{
-						pauseResumeToggle ^= 1;
-						if(pauseResumeToggle)
-						{
-							HAL_GPIO_WritePin(GPIOD, RED_LED, GPIO_PIN_SET);
-							wavPlayer_pause();
-							HAL_Delay(DELAY_200MS);
-						}
-						else
-						{
-							HAL_GPIO_WritePin(GPIOD, RED_LED, GPIO_PIN_RESET);
-							HAL_Delay(DELAY_1S);
-							wavPlayer_resume();
-						}
-					}
-				}
-    		}
-
-    		/* increase the song index if there are pending songs available */
-    		if(song_idx < NUM_SONGS){
-				 song_idx++;
-			 }
-
-    		HAL_GPIO_WritePin(GPIOD, ORANGE_LED, GPIO_PIN_RESET);
-    		HAL_Delay(DELAY_1S);
-    	}
-
+      sched_idle();
     }
   }
   /* USER CODE END 3 */
@@ -481,7 +677,7 @@ static void MX_DMA_Init(void)
 
   /* DMA interrupt init */
   /* DMA1_Stream5_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 5, 0);
   HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
 
 }
@@ -558,16 +754,16 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
 
   /* EXTI interrupt init*/
-  HAL_NVIC_SetPriority(EXTI1_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(EXTI1_IRQn, 8, 0);
   HAL_NVIC_EnableIRQ(EXTI1_IRQn);
 
-  HAL_NVIC_SetPriority(EXTI2_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(EXTI2_IRQn, 8, 0);
   HAL_NVIC_EnableIRQ(EXTI2_IRQn);
 
-  HAL_NVIC_SetPriority(EXTI3_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(EXTI3_IRQn, 8, 0);
   HAL_NVIC_EnableIRQ(EXTI3_IRQn);
 
-  HAL_NVIC_SetPriority(EXTI4_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(EXTI4_IRQn, 8, 0);
   HAL_NVIC_EnableIRQ(EXTI4_IRQn);
 
 }
@@ -579,40 +775,60 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
   /* NOTE: This function Should not be modified, when the callback is needed,
            the HAL_GPIO_EXTI_Callback could be implemented in the user file
    */
+  uint8_t line = 31 - __CLZ(GPIO_Pin);
+  uint32_t now = HAL_GetTick();
+
+  /* contact bounce of an accepted press is dropped here, the press itself
+   * is acted on in PendSV, below the audio and USB interrupts */
+  if((now - buttonEdgeTick[line]) < BUTTON_DEBOUNCE_MS){
+	  return;
+  }
+  buttonEdgeTick[line] = now;
+  TRACE(TRACE_EV_BUTTON, 1, GPIO_Pin);
   HAL_GPIO_TogglePin(GPIOD, GPIO_PIN_15);
-  for(uint32_t i = 0; i < 10000; i++);
+  buttonPending |= GPIO_Pin;
+#ifndef WAV_PLAYER_RTOS
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+}
 
-  if(GPIO_Pin == EXT_PB1)
-  {
+/**
+ * @brief Act on the button presses recorded by the EXTI interrupts
+ * @note Called from PendSV, and from the control task in the FreeRTOS
+ * build, whose kernel owns PendSV. The codec volume command and the LCD
+ * update are too long for the EXTI level of irq_prio.h.
+ */
+void app_buttons(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint16_t pressed;
 
-	  if(volume <= 250){
-		  volume+= 5;
-		  wavPlayer_setVolume(volume);
-		  update_volume_display();
-	  }
+  __disable_irq();
+  pressed = buttonPending;
+  buttonPending = 0;
+  __set_PRIMASK(primask);
+
+  if((pressed & EXT_PB1) && (volume <= 250))
+  {
+	  volume += 5;
+	  wavPlayer_setVolume(volume);
+	  lcdUi_setVolume(volume);
   }
-  else if(GPIO_Pin == EXT_PB2)
+  if((pressed & EXT_PB2) && (volume > 5))
   {
-	  if(volume > 5){
-		  volume -= 5;
-		  wavPlayer_setVolume(volume);
-		  update_volume_display();
-	  }
-
+	  volume -= 5;
+	  wavPlayer_setVolume(volume);
+	  lcdUi_setVolume(volume);
   }
-  else if(GPIO_Pin == EXT_PB3)
+  if((pressed & EXT_PB3) && ((song_idx + 1) < wavLib_count()))
   {
-	 if(song_idx < NUM_SONGS){
-		 song_idx++;
-		 song_mov = NEXT_SONG;
-	 }
+	  song_idx++;
+	  song_mov = NEXT_SONG;
   }
-  else if(GPIO_Pin == EXT_PB4)
+  if((pressed & EXT_PB4) && (song_idx > 0))
   {
-	  if(song_idx > 0){
-		  song_idx--;
-		  song_mov = PREV_SONG;
-	  }
+	  song_idx--;
+	  song_mov = PREV_SONG;
   }
 }
 /* USER CODE END 4 */
@@ -0,0 +1,157 @@
+/*
+ * profile.c
+ *
+ * @description: The cycle counter profiler implementation file. The
+ * probes hand the cycles of a stage to profile_add(), which folds them
+ * into the statistics of the stage. The statistics are updated with
+ * interrupts masked, so a stage timed from the main loop and from an
+ * interrupt never loses a sample.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "profile.h"
+
+#if PROFILE_ENABLE
+#include <stdio.h>
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#define PROFILE_LINE_LEN		160
+
+/***************************************
+* Public Variable Definition
+****************************************/
+profile_stat_t profileStats[PROF_STAGE_NUM];
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static const char *const profileNames[PROF_STAGE_NUM] =
+{
+	"f_read",
+	"msc_read",
+	"ramp",
+	"lcd_flush",
+	"i2c_xfer",
+	"SysTick",
+	"DMA1_S5",
+	"I2C1_EV",
+	"I2C1_ER",
+	"OTG_FS",
+	"PendSV",
+	"EXTI",
+};
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Enable the cycle counter and clear the statistics
+ */
+void profile_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	profile_reset();
+}
+
+/**
+ * @brief Clear the statistics of all stages
+ */
+void profile_reset(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t i;
+
+	__disable_irq();
+	memset(profileStats, 0, sizeof(profileStats));
+	for(i = 0; i < PROF_STAGE_NUM; i++){
+		profileStats[i].min = UINT32_MAX;
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Add a sample to the statistics of a stage
+ * @param stage - The stage the sample was taken of
+ * @param cycles - The cycles the stage took
+ */
+void profile_add(profile_stage_t stage, uint32_t cycles)
+{
+	profile_stat_t *stat = &profileStats[stage];
+	uint32_t primask = __get_PRIMASK();
+	uint32_t bin = 32U - __CLZ(cycles >> PROFILE_HIST_SHIFT);
+
+	if(bin >= PROFILE_HIST_BINS){
+		bin = PROFILE_HIST_BINS - 1;
+	}
+
+	__disable_irq();
+	stat->count++;
+	stat->sum += cycles;
+	if(cycles < stat->min){
+		stat->min = cycles;
+	}
+	if(cycles > stat->max){
+		stat->max = cycles;
+	}
+	stat->hist[bin]++;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Print the statistics of the stages that ran, two lines each
+ * @param out - The line output function
+ * @note The statistics are copied with interrupts masked one stage at
+ * a time, the printing itself runs with interrupts enabled.
+ */
+void profile_report(profile_out_t out)
+{
+	char line[PROFILE_LINE_LEN];
+	uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+	profile_stat_t stat;
+	uint32_t primask;
+	uint32_t i, bin;
+	int pos;
+
+	if(cyclesPerUs == 0){
+		cyclesPerUs = 1;
+	}
+	snprintf(line, sizeof(line), "profile   %10s %10s %10s %10s %10s (cycles)",
+			"count", "min", "avg", "max", "max us");
+	out(line);
+
+	for(i = 0; i < PROF_STAGE_NUM; i++)
+	{
+		primask = __get_PRIMASK();
+		__disable_irq();
+		stat = profileStats[i];
+		__set_PRIMASK(primask);
+
+		if(stat.count == 0){
+			continue;
+		}
+		snprintf(line, sizeof(line), "%-9s %10lu %10lu %10lu %10lu %10lu",
+				profileNames[i], (unsigned long)stat.count, (unsigned long)stat.min,
+				(unsigned long)(stat.sum / stat.count), (unsigned long)stat.max,
+				(unsigned long)(stat.max / cyclesPerUs));
+		out(line);
+
+		pos = snprintf(line, sizeof(line), "  hist   ");
+		for(bin = 0; (bin < PROFILE_HIST_BINS) && (pos < (int)sizeof(line)); bin++){
+			pos += snprintf(&line[pos], sizeof(line) - pos, " %lu",
+					(unsigned long)stat.hist[bin]);
+		}
+		out(line);
+	}
+}
+
+#endif /* PROFILE_ENABLE */
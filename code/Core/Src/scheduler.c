@@ -0,0 +1,300 @@
+/*
+ * scheduler.c
+ *
+ * @description: The cooperative task scheduler implementation file.
+ * Tasks never preempt each other, so a task that is too long for the
+ * audio slack is the one thing that can make a refill late. The
+ * scheduler measures every run with the DWT cycle counter and keeps a
+ * task whose longest run does not fit in the current audio slack back
+ * until the refill has been done.
+ *
+ * The duty cycle counts the cycles from each wake-up to the next WFI,
+ * interrupt handlers included, since they run with the CPU awake. The
+ * cycle counter is read only while the CPU runs, whether it keeps
+ * counting in sleep mode or not does not matter.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "scheduler.h"
+#include <stddef.h>
+#include <stdio.h>
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static sched_task_t *schedTasks;
+static uint8_t schedNum;
+static uint32_t schedStatsTick;	/* HAL tick the statistics started at */
+static uint32_t schedWakeCycles;	/* cycle count at the last wake-up */
+static uint64_t schedAwakeCycles;	/* up to the last WFI */
+static uint32_t schedSleeps;
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Release a task whose period passed and that has work to do
+ */
+static void sched_release(sched_task_t *task, uint32_t now)
+{
+	if(task->released)
+	{
+		return;
+	}
+	if((task->periodMs != 0) && ((now - task->releaseTick) < task->periodMs))
+	{
+		return;
+	}
+	if((task->ready != NULL) && !task->ready())
+	{
+		return;
+	}
+	task->released = true;
+	task->releaseTick = now;
+	task->dueTick = now + task->deadlineMs;
+}
+
+/**
+ * @brief Add the cycles awake since the last call to the duty cycle
+ * @note Called often enough that the cycle counter never wraps between
+ * two calls, every 25 s at 168 MHz.
+ */
+static void sched_count_awake(void)
+{
+	uint32_t now = DWT->CYCCNT;
+
+	schedAwakeCycles += now - schedWakeCycles;
+	schedWakeCycles = now;
+}
+
+/**
+ * @brief Run a released task and account for it
+ */
+static void sched_dispatch(sched_task_t *task, bool urgent)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles, us;
+
+	if((int32_t)(HAL_GetTick() - task->dueTick) > 0){
+		task->misses++;
+	}
+	if(urgent){
+		task->urgentRuns++;
+	}
+	task->released = false;
+	task->run();
+
+	cycles = DWT->CYCCNT - start;
+	us = cycles / (SystemCoreClock / 1000000);
+	task->runs++;
+	task->busyCycles += cycles;
+	if(us > task->maxUs){
+		task->maxUs = us;
+	}
+}
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Take over a task table
+ * @param tasks - The tasks, their state and statistics are cleared
+ * @param num - The number of tasks
+ * @note The periods start now, a periodic task is first released one
+ * period from now.
+ */
+void sched_init(sched_task_t *tasks, uint8_t num)
+{
+	uint32_t now = HAL_GetTick();
+	uint8_t i;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	schedTasks = tasks;
+	schedNum = num;
+	for(i = 0; i < num; i++)
+	{
+		tasks[i].released = false;
+		tasks[i].releaseTick = now;
+	}
+	sched_clearStats();
+}
+
+/**
+ * @brief Release the due tasks and run one of them
+ * @return true if a task ran, false if none was ready
+ * @note A task whose slack is below its threshold runs first. Otherwise
+ * the highest priority runs, the earliest deadline among equals, but a
+ * task whose longest run exceeds the slack of an urgent-capable task is
+ * skipped while that task is released.
+ */
+bool sched_run(void)
+{
+	uint32_t now = HAL_GetTick();
+	sched_task_t *task, *best = NULL;
+	int32_t slack, minSlack = SCHED_NO_SLACK;
+	uint8_t i;
+
+	sched_count_awake();
+	for(i = 0; i < schedNum; i++)
+	{
+		sched_release(&schedTasks[i], now);
+	}
+
+	// the most urgent slack of the released tasks that report one
+	for(i = 0; i < schedNum; i++)
+	{
+		task = &schedTasks[i];
+		if(!task->released || (task->slack == NULL))
+		{
+			continue;
+		}
+		slack = task->slack();
+		if(slack < task->urgentUs)
+		{
+			sched_dispatch(task, true);
+			return true;
+		}
+		if(slack < minSlack)
+		{
+			minSlack = slack;
+		}
+	}
+
+	for(i = 0; i < schedNum; i++)
+	{
+		task = &schedTasks[i];
+		if(!task->released)
+		{
+			continue;
+		}
+		if((task->slack == NULL) && (minSlack != SCHED_NO_SLACK) &&
+		   ((int32_t)task->maxUs > minSlack))
+		{
+			continue;
+		}
+		if((best == NULL) || (task->priority < best->priority) ||
+		   ((task->priority == best->priority) &&
+		    ((int32_t)(task->dueTick - best->dueTick) < 0)))
+		{
+			best = task;
+		}
+	}
+	if(best == NULL)
+	{
+		return false;
+	}
+	sched_dispatch(best, false);
+	return true;
+}
+
+/**
+ * @brief Sleep until the next interrupt
+ * @note Interrupts are masked from the last look at the tasks until the
+ * WFI, so an interrupt that makes a task ready in between is not slept
+ * through: it stays pending, the WFI returns at once and its handler runs
+ * when the mask is lifted.
+ */
+void sched_idle(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t now = HAL_GetTick();
+	uint8_t i;
+
+	__disable_irq();
+	for(i = 0; i < schedNum; i++)
+	{
+		sched_release(&schedTasks[i], now);
+		if(schedTasks[i].released)
+		{
+			__set_PRIMASK(primask);
+			return;
+		}
+	}
+	sched_count_awake();
+	__DSB();
+	__WFI();
+	schedWakeCycles = DWT->CYCCNT;
+	schedSleeps++;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Get the duty cycle of the CPU
+ * @return The time awake since the statistics were cleared, in per mille
+ * of the time passed, 1000 when the CPU never slept
+ */
+uint32_t sched_dutyPermille(void)
+{
+	uint64_t spanCycles = (uint64_t)(HAL_GetTick() - schedStatsTick) * (SystemCoreClock / 1000);
+	uint64_t awake = schedAwakeCycles + (uint32_t)(DWT->CYCCNT - schedWakeCycles);
+
+	if((spanCycles == 0) || (awake >= spanCycles)){
+		return 1000;
+	}
+	return (uint32_t)((awake * 1000) / spanCycles);
+}
+
+/**
+ * @brief Clear the statistics of all tasks
+ */
+void sched_clearStats(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < schedNum; i++)
+	{
+		schedTasks[i].runs = 0;
+		schedTasks[i].misses = 0;
+		schedTasks[i].urgentRuns = 0;
+		schedTasks[i].maxUs = 0;
+		schedTasks[i].busyCycles = 0;
+	}
+	schedStatsTick = HAL_GetTick();
+	schedWakeCycles = DWT->CYCCNT;
+	schedAwakeCycles = 0;
+	schedSleeps = 0;
+}
+
+/**
+ * @brief Print the statistics of the tasks
+ * @param out - Takes one line at a time, e.g. a UART or printf writer
+ * @note The CPU share is the time spent in the task since the statistics
+ * were cleared, in integers so that no float printf is needed. The last
+ * line is the duty cycle of the CPU, interrupts included.
+ */
+void sched_report(sched_out_t out)
+{
+	char line[SCHED_LINE_LEN];
+	uint64_t spanCycles = (uint64_t)(HAL_GetTick() - schedStatsTick) * (SystemCoreClock / 1000);
+	sched_task_t *task;
+	uint32_t permille;
+	uint8_t i;
+
+	snprintf(line, sizeof(line), "sched      %10s %10s %10s %10s %10s",
+			"runs", "misses", "urgent", "max us", "cpu %");
+	out(line);
+	for(i = 0; i < schedNum; i++)
+	{
+		task = &schedTasks[i];
+		permille = (spanCycles == 0) ? 0 : (uint32_t)((task->busyCycles * 1000) / spanCycles);
+		snprintf(line, sizeof(line), "%-10s %10lu %10lu %10lu %10lu %8lu.%lu",
+				task->name, (unsigned long)task->runs, (unsigned long)task->misses,
+				(unsigned long)task->urgentRuns, (unsigned long)task->maxUs,
+				(unsigned long)(permille / 10), (unsigned long)(permille % 10));
+		out(line);
+	}
+	permille = sched_dutyPermille();
+	snprintf(line, sizeof(line), "cpu busy   %8lu.%lu %% awake, %lu sleeps",
+			(unsigned long)(permille / 10), (unsigned long)(permille % 10),
+			(unsigned long)schedSleeps);
+	out(line);
+}
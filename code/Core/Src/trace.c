@@ -0,0 +1,169 @@
+/*
+ * trace.c
+ *
+ * @description: The event trace implementation file. A record is
+ * claimed and written with interrupts masked, so interrupts of any
+ * priority and the main loop can log into the same ring. The ring lives
+ * in a NOLOAD section of CCM RAM: it takes no space in the flash image
+ * and is left alone by the startup code. SWO streaming runs behind the
+ * ring from the main loop, so no record waits for the SWO line.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "trace.h"
+
+#if TRACE_ENABLE
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#if (TRACE_LEN & (TRACE_LEN - 1)) != 0
+#error "TRACE_LEN must be a power of 2"
+#endif
+
+/***************************************
+* Public Variable Definition
+****************************************/
+TRACE_RAM trace_log_t traceLog;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+#if TRACE_ITM
+static uint32_t itmTail;	/* next record to stream */
+static uint8_t itmWord;		/* next word of that record */
+#endif
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Enable the cycle counter and empty the ring
+ */
+void trace_init(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	__disable_irq();
+	memset(&traceLog, 0, sizeof(traceLog));
+	traceLog.len = TRACE_LEN;
+	traceLog.coreClock = SystemCoreClock;
+	traceLog.magic = TRACE_MAGIC;
+#if TRACE_ITM
+	itmTail = 0;
+	itmWord = 0;
+#endif
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Log an event
+ * @param event - The event
+ * @param a - The 8-bit argument of the event
+ * @param b - The 16-bit argument of the event
+ */
+void trace_log(trace_event_t event, uint8_t a, uint16_t b)
+{
+	trace_record_t *rec;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if((traceLog.magic != TRACE_MAGIC) ||
+	   ((traceLog.stopAt != 0) && (traceLog.head == traceLog.stopAt)))
+	{
+		__set_PRIMASK(primask);
+		return;
+	}
+	rec = &traceLog.ring[traceLog.head & (TRACE_LEN - 1)];
+	rec->cycles = DWT->CYCCNT;
+	rec->event = (uint8_t)event;
+	rec->a = a;
+	rec->b = b;
+	traceLog.head++;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Stop logging some events after now
+ * @param postEvents - The events still logged after the trigger, at most
+ * TRACE_LEN - 1 so that the ring keeps some history before it
+ * @note Only the first trigger counts, later ones are ignored.
+ */
+void trace_trigger(uint32_t postEvents)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	if(postEvents >= TRACE_LEN){
+		postEvents = TRACE_LEN - 1;
+	}
+	__disable_irq();
+	if(traceLog.stopAt == 0)
+	{
+		traceLog.stopAt = traceLog.head + postEvents;
+		if(traceLog.stopAt == 0){
+			traceLog.stopAt = 1;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Check whether a trigger stopped the logging
+ */
+bool trace_stopped(void)
+{
+	return (traceLog.stopAt != 0) && (traceLog.head == traceLog.stopAt);
+}
+
+/**
+ * @brief Stream the records logged since the last call over SWO
+ * @note Runs from the main loop and never waits: it stops when the ITM
+ * FIFO is full and goes on from there on the next call. Records the
+ * ring overwrote before they were sent are counted as dropped.
+ */
+void trace_poll(void)
+{
+#if TRACE_ITM
+	const uint32_t *words;
+	uint32_t head = traceLog.head;
+
+	if(((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0) ||
+	   ((ITM->TER & (1UL << TRACE_ITM_PORT)) == 0))
+	{
+		itmTail = head;
+		itmWord = 0;
+		return;
+	}
+	while(itmTail != head)
+	{
+		if((itmWord == 0) && ((head - itmTail) > TRACE_LEN))
+		{
+			traceLog.itmDropped += head - itmTail - TRACE_LEN;
+			itmTail = head - TRACE_LEN;
+		}
+		if(ITM->PORT[TRACE_ITM_PORT].u32 == 0)
+		{
+			return;
+		}
+		words = (const uint32_t *)&traceLog.ring[itmTail & (TRACE_LEN - 1)];
+		ITM->PORT[TRACE_ITM_PORT].u32 = words[itmWord];
+		if(++itmWord == 2)
+		{
+			itmWord = 0;
+			itmTail++;
+		}
+	}
+#endif
+}
+
+#endif /* TRACE_ENABLE */
@@ -0,0 +1,827 @@
+/*
+ * wav_library.c
+ *
+ * @description: The implementation file of the track library.
+ *
+ * @note The index file is a header, the entries and the name and path
+ * strings, in that order. The signature in the header is the volume serial
+ * number, the number of free clusters and the newest modification stamp
+ * in the root directory. Adding, deleting or resizing files changes the
+ * free cluster count, so a stale index is detected without walking the
+ * subdirectories. An edit that keeps every cluster allocation and does not
+ * touch the root directory is not detected: a track that fails to open or
+ * whose start cluster moved calls for wavLib_invalidate().
+ *
+ * @reference:
+ * 1.FatFs R0.12c application interface
+ * 2.Microsoft/IBM RIFF WAVE file format
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "wav_library.h"
+#include "wav_player.h"
+#include "stm32f4xx_hal.h"
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#define WAVLIB_MAGIC			0x58494C57	/* "WLIX" */
+#define WAVLIB_VERSION			3
+#define WAVLIB_INDEX_NAME		"WAVLIB.IDX"
+#define WAVLIB_MAX_CHUNKS		16			/* chunks looked at before "data" */
+#define WAVLIB_FMT_MAX			40			/* WAVE_FORMAT_EXTENSIBLE "fmt " body */
+#define WAVLIB_SAVE_CHUNK		512			/* index bytes written per scan step */
+
+#define RIFF_ID(a,b,c,d)		((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+								 ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define RIFF_RIFF				RIFF_ID('R','I','F','F')
+#define RIFF_WAVE				RIFF_ID('W','A','V','E')
+#define RIFF_FMT				RIFF_ID('f','m','t',' ')
+#define RIFF_DATA				RIFF_ID('d','a','t','a')
+#define WAVE_FORMAT_PCM			0x0001
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE
+
+#if WAVLIB_RAM_BUDGET > 0xFFFF
+#error "WAVLIB_RAM_BUDGET must fit the 16-bit string offsets"
+#endif
+
+/***************************************
+* Local Struct Definition
+****************************************/
+typedef struct
+{
+	uint32_t vsn;			/* volume serial number */
+	uint32_t freeClusters;
+	uint32_t rootStamp;		/* newest (fdate << 16 | ftime) in the root */
+	uint32_t rootEntries;
+}wavLib_sig_t;
+
+typedef enum
+{
+	WAVLIB_SCAN_Idle=0,
+	WAVLIB_SCAN_Walk,		/* one directory entry per step */
+	WAVLIB_SCAN_Create,		/* index file and its unsigned header */
+	WAVLIB_SCAN_Save,		/* one chunk of the index file per step */
+	WAVLIB_SCAN_Sign,		/* signature and final header */
+}WAVLIB_SCAN_e;
+
+// The walk state, kept between steps
+typedef struct
+{
+	WAVLIB_SCAN_e state;
+	DIR dirs[WAVLIB_MAX_DEPTH + 1];
+	uint16_t dirOfs[WAVLIB_MAX_DEPTH + 1];	/* arena offset of the path, 0 if not stored */
+	uint16_t pathLen[WAVLIB_MAX_DEPTH + 1];
+	char path[WAVLIB_PATH_MAX];
+	int depth;
+	FIL fil;								/* probed file, then the index file */
+	uint32_t saved;							/* index bytes written after the header */
+}wavLib_scan_t;
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entrySize;
+	uint32_t count;
+	uint32_t strBytes;
+	wavLib_sig_t sig;
+}wavLib_fileHeader_t;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static uint32_t libArena[WAVLIB_RAM_BUDGET / sizeof(uint32_t)];
+static wavLib_entry_t *const libEntries = (wavLib_entry_t *)libArena;
+static uint32_t libCount;
+static uint32_t libStrBytes;	/* bytes of strings at the end of the arena */
+static wavLib_scan_t scan;
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Read a little-endian 16-bit value
+ */
+static uint16_t wavLib_rd16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief Read a little-endian 32-bit value
+ */
+static uint32_t wavLib_rd32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+			((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief Get the end of the arena, where the strings are anchored
+ */
+static char *wavLib_arena_end(void)
+{
+	return (char *)libArena + sizeof(libArena);
+}
+
+/**
+ * @brief Get the free bytes between the entries and the strings
+ */
+static uint32_t wavLib_arena_free(void)
+{
+	return sizeof(libArena) - (libCount * sizeof(wavLib_entry_t)) - libStrBytes;
+}
+
+/**
+ * @brief Store a string at the end of the arena
+ * @param str - The string
+ * @param len - The characters to store, a terminator is added
+ * @return the offset of the string from the end of the arena, 0 if full
+ */
+static uint16_t wavLib_add_str(const char *str, uint32_t len)
+{
+	char *dst;
+
+	if(wavLib_arena_free() < (len + 1)){
+		return 0;
+	}
+	libStrBytes += len + 1;
+	dst = wavLib_arena_end() - libStrBytes;
+	memcpy(dst, str, len);
+	dst[len] = '\0';
+	return (uint16_t)libStrBytes;
+}
+
+/**
+ * @brief Get the name of a directory entry that paths are built from
+ * @return the 8.3 short name on FAT, the full name on exFAT
+ * @note With LFN enabled fname holds the long name and altname the short
+ * one. altname is left empty when a FAT name is a plain upper case 8.3
+ * name, and always on exFAT, which has no short names.
+ */
+static const char *wavLib_path_name(const FILINFO *fno)
+{
+#if _USE_LFN != 0
+	return (fno->altname[0] != '\0') ? fno->altname : fno->fname;
+#else
+	return fno->fname;
+#endif
+}
+
+/**
+ * @brief Store the long name of a track as its display title
+ * @param fno - The directory entry of the track
+ * @param fs - The volume of the track
+ * @return the arena offset of the title, 0 without a long name or space
+ * @note The ".wav" extension is dropped and the title is cut at
+ * WAVLIB_TITLE_MAX characters, the LCD could not show more anyway.
+ */
+static uint16_t wavLib_add_title(const FILINFO *fno, const FATFS *fs)
+{
+#if _USE_LFN != 0
+	uint32_t len;
+
+	//Every exFAT name is a long name, a FAT name without altname is a plain 8.3 one
+	if((fno->altname[0] == '\0') && (fs->fs_type != FS_EXFAT)){
+		return 0;
+	}
+	len = strlen(fno->fname);
+	if((len > 4) && (fno->fname[len - 4] == '.') &&
+	   ((fno->fname[len - 3] | 0x20) == 'w') && ((fno->fname[len - 2] | 0x20) == 'a') &&
+	   ((fno->fname[len - 1] | 0x20) == 'v'))
+	{
+		len -= 4;
+	}
+	len = (len < WAVLIB_TITLE_MAX) ? len : WAVLIB_TITLE_MAX;
+	return wavLib_add_str(fno->fname, len);
+#else
+	(void)fno;
+	(void)fs;
+	return 0;
+#endif
+}
+
+/**
+ * @brief Check whether a name has the ".WAV" extension
+ * @note The case is ignored: exFAT has no short names and a FAT short
+ * name written by another system may be in lower case.
+ */
+static bool wavLib_is_wav_name(const char *name)
+{
+	const char *dot = strrchr(name, '.');
+	const char *ext = ".WAV";
+
+	if(dot == NULL){
+		return false;
+	}
+	while((*ext != '\0') && (toupper((unsigned char)*dot) == *ext))
+	{
+		dot++;
+		ext++;
+	}
+	return (*dot == '\0') && (*ext == '\0');
+}
+
+/**
+ * @brief Compute the signature of the mounted volume
+ * @note Reads the boot record (cached), the free cluster count and the
+ * root directory. The free cluster count is the FSInfo value on FAT32
+ * when it is valid; on exFAT, on FAT12/16 and with an invalid FSInfo
+ * f_getfree() scans the whole allocation bitmap or FAT, once per mount,
+ * after which FatFs keeps the count up to date.
+ */
+static bool wavLib_signature(wavLib_sig_t *sig)
+{
+	FATFS *fs;
+	DWORD vsn, nclst;
+	DIR dir;
+	FILINFO fno;
+	uint32_t stamp;
+
+	memset(sig, 0, sizeof(*sig));
+	if(f_getlabel("", NULL, &vsn) != FR_OK){
+		return false;
+	}
+	sig->vsn = vsn;
+	if(f_getfree("", &nclst, &fs) != FR_OK){
+		return false;
+	}
+	sig->freeClusters = nclst;
+
+	if(f_opendir(&dir, "/") != FR_OK){
+		return false;
+	}
+	while((f_readdir(&dir, &fno) == FR_OK) && (fno.fname[0] != '\0'))
+	{
+		if(strcmp(wavLib_path_name(&fno), WAVLIB_INDEX_NAME) == 0){
+			continue;
+		}
+		stamp = ((uint32_t)fno.fdate << 16) | fno.ftime;
+		sig->rootStamp = (stamp > sig->rootStamp) ? stamp : sig->rootStamp;
+		sig->rootEntries++;
+	}
+	f_closedir(&dir);
+	return true;
+}
+
+/**
+ * @brief Probe one file and append it to the library when playable
+ * @param dirPath - The directory of the file
+ * @param dirOfs - The arena offset of dirPath, 0 if not stored yet
+ * @param fno - The directory entry of the file
+ * @return the arena offset of dirPath after the call
+ */
+static uint16_t wavLib_probe(const char *dirPath, uint16_t dirOfs, const FILINFO *fno)
+{
+	char path[WAVLIB_PATH_MAX];
+	wavLib_format_t fmt;
+	wavLib_entry_t *entry;
+	FIL *fil = &scan.fil;
+	const char *name = wavLib_path_name(fno);
+	uint16_t nameOfs = 0;
+	bool ok;
+
+	if((strlen(dirPath) + 1 + strlen(name)) >= sizeof(path)){
+		return dirOfs;
+	}
+	strcpy(path, dirPath);
+	strcat(path, "/");
+	strcat(path, name);
+
+	if(f_open(fil, path, FA_READ) != FR_OK){
+		return dirOfs;
+	}
+	ok = wavLib_parseHeader(fil, &fmt) && wavLib_isPlayable(&fmt);
+	if(ok && (dirOfs == 0)){
+		dirOfs = wavLib_add_str(dirPath, strlen(dirPath));
+	}
+	if(ok && (dirOfs != 0)){
+		nameOfs = wavLib_add_str(name, strlen(name));
+	}
+	if((nameOfs != 0) && (wavLib_arena_free() >= sizeof(wavLib_entry_t)))
+	{
+		entry = &libEntries[libCount++];
+		memset(entry, 0, sizeof(*entry));
+		entry->name = nameOfs;
+		entry->channels = (uint8_t)fmt.channels;
+		entry->dir = dirOfs;
+		entry->bitsPerSample = fmt.bitsPerSample;
+		entry->sampleRate = fmt.sampleRate;
+		entry->size = (uint32_t)f_size(fil);
+		entry->sclust = fil->obj.sclust;
+		entry->dataOffset = fmt.dataOffset;
+		entry->durationMs = (uint32_t)(((uint64_t)(fmt.dataSize / fmt.blockAlign) * 1000) /
+				fmt.sampleRate);
+		//The long name is only available now, while the entry is at hand
+		entry->title = wavLib_add_title(fno, fil->obj.fs);
+	}
+	f_close(fil);
+	return dirOfs;
+}
+
+/**
+ * @brief Start walking the volume
+ */
+static void wavLib_scan_start(void)
+{
+	libCount = 0;
+	libStrBytes = 0;
+	scan.path[0] = '\0';
+	scan.pathLen[0] = 0;
+	scan.dirOfs[0] = 0;
+	scan.depth = 0;
+	scan.state = (f_opendir(&scan.dirs[0], "/") == FR_OK) ?
+			WAVLIB_SCAN_Walk : WAVLIB_SCAN_Idle;
+}
+
+/**
+ * @brief Walk one directory entry
+ * @note Depth first, WAVLIB_MAX_DEPTH levels below the root. A step reads
+ * one directory entry and either enters a directory or probes one file.
+ * Directories without playable files take no arena space. The walk ends
+ * early when the arena is full.
+ */
+static void wavLib_scan_walk(void)
+{
+	FILINFO fno;
+	const char *name;
+	uint32_t len;
+	int depth = scan.depth;
+
+	if((f_readdir(&scan.dirs[depth], &fno) != FR_OK) || (fno.fname[0] == '\0') ||
+	   (wavLib_arena_free() < sizeof(wavLib_entry_t)))
+	{
+		//Directory done, back to its parent
+		f_closedir(&scan.dirs[depth]);
+		scan.depth = --depth;
+		if(depth >= 0){
+			scan.path[scan.pathLen[depth]] = '\0';
+		}
+		else{
+			scan.state = WAVLIB_SCAN_Create;
+		}
+		return;
+	}
+	//Paths are built from the short names where the volume has them, they are shorter
+	name = wavLib_path_name(&fno);
+	if((name[0] == '.') || (fno.fattrib & (AM_HID | AM_SYS))){
+		return;
+	}
+
+	if(fno.fattrib & AM_DIR)
+	{
+		len = scan.pathLen[depth] + 1 + strlen(name);
+		if((depth >= WAVLIB_MAX_DEPTH) || (len >= sizeof(scan.path))){
+			return;
+		}
+		strcat(scan.path, "/");
+		strcat(scan.path, name);
+		if(f_opendir(&scan.dirs[depth + 1], scan.path) != FR_OK)
+		{
+			scan.path[scan.pathLen[depth]] = '\0';
+			return;
+		}
+		scan.depth = ++depth;
+		scan.pathLen[depth] = (uint16_t)len;
+		scan.dirOfs[depth] = 0;
+	}
+	else if(wavLib_is_wav_name(name))
+	{
+		scan.dirOfs[depth] = wavLib_probe(scan.path, scan.dirOfs[depth], &fno);
+	}
+}
+
+/**
+ * @brief Check a string offset of a loaded entry
+ * @param ofs - The offset from the end of the arena
+ * @param strBytes - The size of the string area
+ * @return true if the string starts and ends inside the string area
+ */
+static bool wavLib_str_valid(uint16_t ofs, uint32_t strBytes)
+{
+	return (ofs != 0) && (ofs <= strBytes) &&
+		   (memchr(wavLib_arena_end() - ofs, '\0', ofs) != NULL);
+}
+
+/**
+ * @brief Check the string offsets of the loaded entries
+ * @note A truncated or corrupt index whose header still matches would
+ * otherwise hand out pointers outside the arena.
+ */
+static bool wavLib_entries_valid(uint32_t count, uint32_t strBytes)
+{
+	const wavLib_entry_t *entry;
+	uint32_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		entry = &libEntries[i];
+		if(!wavLib_str_valid(entry->name, strBytes) ||
+		   !wavLib_str_valid(entry->dir, strBytes) ||
+		   ((entry->title != 0) && !wavLib_str_valid(entry->title, strBytes)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Load the index file if its signature matches the volume
+ */
+static bool wavLib_load(const wavLib_sig_t *sig)
+{
+	wavLib_fileHeader_t hdr;
+	uint32_t entryBytes;
+	FIL *fil = &scan.fil;
+	UINT br;
+	bool ok = false;
+
+	if(f_open(fil, WAVLIB_INDEX_PATH, FA_READ) != FR_OK){
+		return false;
+	}
+	if((f_read(fil, &hdr, sizeof(hdr), &br) == FR_OK) && (br == sizeof(hdr)) &&
+	   (hdr.magic == WAVLIB_MAGIC) && (hdr.version == WAVLIB_VERSION) &&
+	   (hdr.entrySize == sizeof(wavLib_entry_t)) &&
+	   (memcmp(&hdr.sig, sig, sizeof(*sig)) == 0) &&
+	   (hdr.count <= (sizeof(libArena) / sizeof(wavLib_entry_t))))
+	{
+		entryBytes = hdr.count * sizeof(wavLib_entry_t);
+		if((entryBytes + hdr.strBytes) <= sizeof(libArena))
+		{
+			ok = (f_read(fil, libEntries, entryBytes, &br) == FR_OK) && (br == entryBytes) &&
+				 (f_read(fil, wavLib_arena_end() - hdr.strBytes, hdr.strBytes, &br) == FR_OK) &&
+				 (br == hdr.strBytes) && wavLib_entries_valid(hdr.count, hdr.strBytes);
+		}
+	}
+	f_close(fil);
+
+	libCount = ok ? hdr.count : 0;
+	libStrBytes = ok ? hdr.strBytes : 0;
+	return ok;
+}
+
+/**
+ * @brief Fill the header of the index file
+ */
+static void wavLib_header(wavLib_fileHeader_t *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = WAVLIB_MAGIC;
+	hdr->version = WAVLIB_VERSION;
+	hdr->entrySize = sizeof(wavLib_entry_t);
+	hdr->count = libCount;
+	hdr->strBytes = libStrBytes;
+}
+
+/**
+ * @brief Create the index file with a header without a signature
+ */
+static void wavLib_scan_create(void)
+{
+	wavLib_fileHeader_t hdr;
+	UINT bw;
+
+	wavLib_header(&hdr);
+	scan.saved = 0;
+	scan.state = WAVLIB_SCAN_Idle;
+	if(f_open(&scan.fil, WAVLIB_INDEX_PATH, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK){
+		return;
+	}
+	if(f_write(&scan.fil, &hdr, sizeof(hdr), &bw) != FR_OK)
+	{
+		f_close(&scan.fil);
+		f_unlink(WAVLIB_INDEX_PATH);
+		return;
+	}
+	scan.state = WAVLIB_SCAN_Save;
+}
+
+/**
+ * @brief Write one chunk of the index file
+ * @note Writes WAVLIB_SAVE_CHUNK bytes of the entries, then of the
+ * strings, per step.
+ */
+static void wavLib_scan_save(void)
+{
+	uint32_t entryBytes = libCount * sizeof(wavLib_entry_t);
+	const uint8_t *src;
+	uint32_t len;
+	UINT bw;
+
+	if(scan.saved < entryBytes)
+	{
+		src = (const uint8_t *)libEntries + scan.saved;
+		len = entryBytes - scan.saved;
+	}
+	else
+	{
+		src = (const uint8_t *)wavLib_arena_end() - libStrBytes + (scan.saved - entryBytes);
+		len = entryBytes + libStrBytes - scan.saved;
+	}
+	len = (len < WAVLIB_SAVE_CHUNK) ? len : WAVLIB_SAVE_CHUNK;
+
+	if((len > 0) && (f_write(&scan.fil, src, len, &bw) != FR_OK))
+	{
+		f_close(&scan.fil);
+		f_unlink(WAVLIB_INDEX_PATH);
+		scan.state = WAVLIB_SCAN_Idle;
+		return;
+	}
+	scan.saved += len;
+	if(scan.saved >= (entryBytes + libStrBytes)){
+		scan.state = WAVLIB_SCAN_Sign;
+	}
+}
+
+/**
+ * @brief Sign the index file and close it
+ * @note The signature is taken after the file is written, so the clusters
+ * of the index file itself are part of it.
+ */
+static void wavLib_scan_sign(void)
+{
+	wavLib_fileHeader_t hdr;
+	UINT bw;
+	bool ok;
+
+	wavLib_header(&hdr);
+	ok = (f_sync(&scan.fil) == FR_OK) &&
+		 wavLib_signature(&hdr.sig) &&
+		 (f_lseek(&scan.fil, 0) == FR_OK) &&
+		 (f_write(&scan.fil, &hdr, sizeof(hdr), &bw) == FR_OK);
+	f_close(&scan.fil);
+	if(!ok){
+		f_unlink(WAVLIB_INDEX_PATH);
+	}
+	scan.state = WAVLIB_SCAN_Idle;
+}
+
+/**
+ * @brief Enable the DWT cycle counter used to time the scan steps
+ */
+static void wavLib_cycles_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Parse the RIFF chunks of a WAV file
+ * @param fp - The open file
+ * @param fmt - The parsed format
+ * @return true when a "fmt " chunk is followed by a "data" chunk
+ * @note Chunks other than "fmt " and "data" (LIST, fact, cue...) are
+ * skipped, so the sample data does not have to start at offset 44.
+ */
+bool wavLib_parseHeader(FIL *fp, wavLib_format_t *fmt)
+{
+	uint8_t buf[WAVLIB_FMT_MAX];
+	uint32_t pos, id, size, avail;
+	bool haveFmt = false;
+	UINT br;
+	int chunk;
+
+	memset(fmt, 0, sizeof(*fmt));
+	if((f_lseek(fp, 0) != FR_OK) || (f_read(fp, buf, 12, &br) != FR_OK) || (br != 12) ||
+	   (wavLib_rd32(&buf[0]) != RIFF_RIFF) || (wavLib_rd32(&buf[8]) != RIFF_WAVE))
+	{
+		return false;
+	}
+
+	pos = 12;
+	for(chunk = 0; chunk < WAVLIB_MAX_CHUNKS; chunk++)
+	{
+		if((pos + 8) > f_size(fp)){
+			return false;
+		}
+		if((f_lseek(fp, pos) != FR_OK) || (f_read(fp, buf, 8, &br) != FR_OK) || (br != 8)){
+			return false;
+		}
+		id = wavLib_rd32(&buf[0]);
+		size = wavLib_rd32(&buf[4]);
+		pos += 8;
+
+		if(id == RIFF_FMT)
+		{
+			if(size < 16){
+				return false;
+			}
+			avail = (size < sizeof(buf)) ? size : sizeof(buf);
+			if((f_read(fp, buf, avail, &br) != FR_OK) || (br != avail)){
+				return false;
+			}
+			fmt->audioFormat = wavLib_rd16(&buf[0]);
+			fmt->channels = wavLib_rd16(&buf[2]);
+			fmt->sampleRate = wavLib_rd32(&buf[4]);
+			fmt->byteRate = wavLib_rd32(&buf[8]);
+			fmt->blockAlign = wavLib_rd16(&buf[12]);
+			fmt->bitsPerSample = wavLib_rd16(&buf[14]);
+			//The sub format GUID starts with the format code
+			if((fmt->audioFormat == WAVE_FORMAT_EXTENSIBLE) && (avail >= 26)){
+				fmt->audioFormat = wavLib_rd16(&buf[24]);
+			}
+			haveFmt = true;
+		}
+		else if(id == RIFF_DATA)
+		{
+			if(!haveFmt){
+				return false;
+			}
+			//Streamed files leave the size open, trust the file size then
+			avail = (uint32_t)f_size(fp) - pos;
+			fmt->dataOffset = pos;
+			fmt->dataSize = (size < avail) ? size : avail;
+			return true;
+		}
+
+		//Chunks are word aligned
+		if(size > ((uint32_t)f_size(fp) - pos)){
+			return false;
+		}
+		pos += size + (size & 1);
+	}
+	return false;
+}
+
+/**
+ * @brief Check whether the player can play a format
+ * @param fmt - The parsed format
+ */
+bool wavLib_isPlayable(const wavLib_format_t *fmt)
+{
+	return (fmt->audioFormat == WAVE_FORMAT_PCM) &&
+		   (fmt->bitsPerSample == 16) &&
+		   ((fmt->channels == 1) || (fmt->channels == 2)) &&
+		   (fmt->blockAlign == (fmt->channels * 2)) &&
+		   (fmt->sampleRate != 0) &&
+		   (fmt->dataSize >= fmt->blockAlign);
+}
+
+/**
+ * @brief Build the library of the mounted volume
+ * @return true when the index file was loaded, false when a background
+ * scan was started instead
+ * @note Loads the index file when its signature matches the volume,
+ * otherwise starts a scan that wavLib_process() runs step by step and
+ * that writes a new index file when done. The signature is taken here, in
+ * the caller's context: on exFAT or FAT12/16 its free cluster count reads
+ * the whole allocation bitmap or FAT (see wavLib_signature()).
+ */
+bool wavLib_mount(void)
+{
+	wavLib_sig_t sig;
+
+	wavLib_cycles_init();
+	libCount = 0;
+	libStrBytes = 0;
+	scan.state = WAVLIB_SCAN_Idle;
+	if(wavLib_signature(&sig) && wavLib_load(&sig)){
+		return true;
+	}
+	wavLib_scan_start();
+	return false;
+}
+
+/**
+ * @brief Run the background scan for a while
+ * @param budgetUs - The time budget in microseconds
+ * @return true while the scan is still running
+ * @note Runs whole steps until the budget is used up or an audio refill
+ * is pending, so the call takes at most the budget plus one step (one
+ * directory entry, one header probe or one WAVLIB_SAVE_CHUNK write).
+ * Tracks found so far are usable right away, they are only appended.
+ */
+bool wavLib_process(uint32_t budgetUs)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t budget = budgetUs * (SystemCoreClock / 1000000);
+
+	while(scan.state != WAVLIB_SCAN_Idle)
+	{
+		if(wavPlayer_refillPending() || ((DWT->CYCCNT - start) >= budget)){
+			break;
+		}
+		switch(scan.state)
+		{
+			case WAVLIB_SCAN_Walk:
+				wavLib_scan_walk();
+				break;
+			case WAVLIB_SCAN_Create:
+				wavLib_scan_create();
+				break;
+			case WAVLIB_SCAN_Save:
+				wavLib_scan_save();
+				break;
+			case WAVLIB_SCAN_Sign:
+				wavLib_scan_sign();
+				break;
+			default:
+				scan.state = WAVLIB_SCAN_Idle;
+				break;
+		}
+	}
+	return (scan.state != WAVLIB_SCAN_Idle);
+}
+
+/**
+ * @brief Check whether the background scan is still running
+ */
+bool wavLib_scanning(void)
+{
+	return (scan.state != WAVLIB_SCAN_Idle);
+}
+
+/**
+ * @brief Forget the library and delete the index file
+ */
+void wavLib_invalidate(void)
+{
+	if(scan.state == WAVLIB_SCAN_Walk){
+		for(; scan.depth >= 0; scan.depth--){
+			f_closedir(&scan.dirs[scan.depth]);
+		}
+	}
+	else if(scan.state != WAVLIB_SCAN_Idle){
+		f_close(&scan.fil);
+	}
+	scan.state = WAVLIB_SCAN_Idle;
+	libCount = 0;
+	libStrBytes = 0;
+	f_unlink(WAVLIB_INDEX_PATH);
+}
+
+/**
+ * @brief Get the number of tracks in the library
+ */
+uint32_t wavLib_count(void)
+{
+	return libCount;
+}
+
+/**
+ * @brief Get the entry of a track
+ * @param idx - The track index
+ * @return the entry, NULL when out of range
+ */
+const wavLib_entry_t *wavLib_get(uint32_t idx)
+{
+	return (idx < libCount) ? &libEntries[idx] : NULL;
+}
+
+/**
+ * @brief Get the display title of a track
+ * @param idx - The track index
+ * @return the long name without extension, the file name when the file
+ * has no long name, "" when out of range
+ * @note Served from the arena, the directory is not read again.
+ */
+const char *wavLib_title(uint32_t idx)
+{
+	const wavLib_entry_t *entry = wavLib_get(idx);
+
+	if(entry == NULL){
+		return "";
+	}
+	return wavLib_arena_end() - ((entry->title != 0) ? entry->title : entry->name);
+}
+
+/**
+ * @brief Build the full path of a track
+ * @param idx - The track index
+ * @param buf - The destination
+ * @param len - The size of the destination
+ * @return false when out of range or the path does not fit
+ */
+bool wavLib_path(uint32_t idx, char *buf, uint32_t len)
+{
+	const wavLib_entry_t *entry = wavLib_get(idx);
+	const char *dir, *name;
+
+	if(entry == NULL){
+		return false;
+	}
+	dir = wavLib_arena_end() - entry->dir;
+	name = wavLib_arena_end() - entry->name;
+	if((strlen(dir) + 1 + strlen(name)) >= len){
+		return false;
+	}
+	strcpy(buf, dir);
+	strcat(buf, "/");
+	strcat(buf, name);
+	return true;
+}
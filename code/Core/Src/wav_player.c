@@ -23,43 +23,41 @@
 
 #include <cs43l22.h>
 #include "wav_player.h"
+#include "wav_library.h"
 #include "fatfs.h"
+#include "profile.h"
+#include "trace.h"
 #include "stm32f4xx_hal.h"
 #include <stddef.h>
+#include <string.h>
 
 /***************************************
 * Local Macro Definition
 ****************************************/
 
-#define AUDIO_BUFFER_SIZE  			4096
+#ifndef AUDIO_BUFFER_MIN
+#define AUDIO_BUFFER_MIN  			4096 /* ring bytes, the host build may size it */
+#endif
+#define AUDIO_BUFFER_MAX            (((2 * _MAX_SS) > AUDIO_BUFFER_MIN) ? (2 * _MAX_SS) : AUDIO_BUFFER_MIN)
 #define DMA_MAX_SZE                 0xFFFF
 #define DMA_MAX(_X_)                (((_X_) <= DMA_MAX_SZE)? (_X_):DMA_MAX_SZE)
 #define AUDIO_DATA_SIZE              2   /* 16-bits audio data size */
+#define AUDIO_RING_HW               (audioBufferSize / AUDIO_DATA_SIZE) /* DMA items in the ring */
+#define AUDIO_SLOT_HW               (AUDIO_RING_HW / 2) /* DMA items per half */
+#define AUDIO_SLOT_NUM               2
+#define AUDIO_FADE_HW                512 /* pause/resume ramp, 256 stereo samples */
+#define AUDIO_GUARD_HW               128 /* DMA items left alone ahead of the DMA */
+#define AUDIO_RESUME_MIN_HW          512 /* less left in the half: fill the next one too */
+#define WAV_CLMT_LEN                 64  /* fast seek table, up to 31 fragments */
+#ifndef WAV_TRACE_POST_UNDERRUN
+#define WAV_TRACE_POST_UNDERRUN      256 /* trace records logged after the first underrun */
+#endif
+#ifndef WAV_PAUSE_POWERDOWN_MS
+#define WAV_PAUSE_POWERDOWN_MS       30000 /* paused time before the codec powers down */
+#endif
 #define PLLI2S_VCO_MUL_FACTOR 		258
 #define PLLI2S_CLK_DIV_FACTOR 	    3
 
-/***************************************
-* Local Struct Definition
-****************************************/
-typedef struct
-{
-  uint32_t   ChunkID;       /* 0 */
-  uint32_t   FileSize;      /* 4 */
-  uint32_t   FileFormat;    /* 8 */
-  uint32_t   SubChunk1ID;   /* 12 */
-  uint32_t   SubChunk1Size; /* 16*/
-  uint16_t   AudioFormat;   /* 20 */
-  uint16_t   NbrChannels;   /* 22 */
-  uint32_t   SampleRate;    /* 24 */
-
-  uint32_t   ByteRate;      /* 28 */
-  uint16_t   BlockAlign;    /* 32 */
-  uint16_t   BitPerSample;  /* 34 */
-  uint32_t   SubChunk2ID;   /* 36 */
-  uint32_t   SubChunk2Size; /* 40 */
-
-}WAV_HeaderTypeDef;
-
 /***************************************
 * Local Variable Definition
 ****************************************/
@@ -72,14 +70,55 @@ static const uint32_t I2SPLLN[8] = {256, 429, 213, 429, 426, 271, 258, 344};
 static const uint32_t I2SPLLR[8] = {5, 4, 4, 4, 4, 6, 3, 1};
 //WAV File System variables
 static FIL wavFile;
+static DWORD wavClmt[WAV_CLMT_LEN];
+static uint32_t wavFragments;
+static uint32_t dataOffset;
 //WAV Audio Buffer
 static uint32_t fileLength;
-static uint8_t audioBuffer[AUDIO_BUFFER_SIZE];
+static uint8_t audioBuffer[AUDIO_BUFFER_MAX];
+//Ring bytes in use, a ring half is at least one sector of the volume
+static uint32_t audioBufferSize = AUDIO_BUFFER_MIN;
+static uint32_t sectorSize = _MIN_SS;
+//Direct streaming: the ring starts at the sector holding the first sample
+static bool zeroCopy = true;
+static bool streamDirect;
+static uint32_t streamPad;
 static __IO uint32_t audioRemainSize = 0;
 //WAV Player
 static uint32_t samplingFreq;
+static uint32_t byteRate;
+//Playback position ledger, the file sample that each ring half starts with
+static uint16_t hwPerSample;
+static uint32_t totalSamples;
+static uint32_t nextSample;
+static volatile uint32_t slotStartSample[AUDIO_SLOT_NUM];
+static volatile bool dmaRunning = false;
+static uint32_t stoppedPosition;
 static UINT player_bytes_read = 0;
 static bool is_song_finished=0;
+//Refill telemetry, a ring half is due when the DMA hands over the next one
+static wavPlayer_telemetry_t telemetry;
+static uint64_t telemetryFillSum;
+static int64_t telemetrySlackSum;
+static uint32_t underrunTicks[WAV_TELEMETRY_UNDERRUNS];
+static uint8_t underrunHead;
+static uint32_t slotDueCycles[AUDIO_SLOT_NUM];
+static volatile bool slotPending[AUDIO_SLOT_NUM];
+static wavPlayer_notify_t refillNotify;
+
+//WAV Player pause states
+typedef enum
+{
+  PLAYER_PAUSE_None=0,
+  PLAYER_PAUSE_Fading,      /* fade-out playing, DMA callbacks write silence */
+  PLAYER_PAUSE_Muted,       /* codec muted, I2S DMA paused, codec powered */
+  PLAYER_PAUSE_PoweredDown, /* idle timeout passed, codec powered down */
+}PLAYER_PAUSE_e;
+static volatile PLAYER_PAUSE_e pauseState = PLAYER_PAUSE_None;
+static volatile uint32_t positionLimit = UINT32_MAX;
+static uint32_t pauseFadeFrames;    /* fade-out frames before positionLimit */
+static uint32_t pausedAtTick;
+static uint32_t pauseTimeoutMs = WAV_PAUSE_POWERDOWN_MS;
 
 //WAV Player process states
 typedef enum
@@ -192,21 +231,316 @@ static void audio_stop()
 }
 
 /**
- * @brief Pause the Audio
+ * @brief Get the ring position the DMA is reading from
+ * @return the offset in DMA items from the start of the ring
  */
-static void audio_pause()
+static uint32_t audio_dma_offset(void)
 {
-	CS43_stop();
-	HAL_I2S_DMAPause(i2sptr);
+	return (AUDIO_RING_HW - __HAL_DMA_GET_COUNTER(i2sptr->hdmatx)) % AUDIO_RING_HW;
 }
 
 /**
- * @brief Resume the Audio
+ * @brief Get the file sample stored at a ring position
+ * @param offset - The ring offset in DMA items
  */
-static void audio_resume()
+static uint32_t audio_sample_at(uint32_t offset)
 {
-	CS43_start();
-	HAL_I2S_DMAResume(i2sptr);
+	uint32_t slot = offset / AUDIO_SLOT_HW;
+	uint32_t sample = slotStartSample[slot] + ((offset - (slot * AUDIO_SLOT_HW)) / hwPerSample);
+
+	//The silence played before the first sample of a direct stream
+	return ((int32_t)sample < 0) ? 0 : sample;
+}
+
+/**
+ * @brief Read from the song file into the audio buffer
+ * @param dst - The destination in the audio buffer
+ * @param len - The bytes to read
+ * @param br - The bytes read
+ */
+static FRESULT audio_file_read(uint8_t *dst, UINT len, UINT *br)
+{
+	uint32_t start = PROFILE_START();
+	FRESULT res = f_read(&wavFile, dst, len, br);
+
+	PROFILE_STOP(PROF_F_READ, start);
+	return res;
+}
+
+/**
+ * @brief Apply a linear gain ramp to a part of the ring
+ * @param from - The first ring offset in DMA items
+ * @param len - The ramp length in DMA items, may wrap around the ring
+ * @param skip - The frames of the ramp left out in front of from, so that
+ * a fade-in starts at the gain skip / (len / hwPerSample) instead of 0
+ * @param fadeIn - true to ramp up from silence, false to ramp down to silence
+ */
+static void audio_ramp(uint32_t from, uint32_t len, uint32_t skip, bool fadeIn)
+{
+	int16_t *ring = (int16_t *)audioBuffer;
+	uint32_t frames = len / hwPerSample;
+	uint32_t i, frame, idx;
+	uint32_t start = PROFILE_START();
+	int32_t gain;
+
+	for(i = 0; i < (len - (skip * hwPerSample)); i++)
+	{
+		frame = skip + (i / hwPerSample);
+		gain = (int32_t)(((fadeIn ? frame : (frames - frame)) << 15) / frames);
+		idx = (from + i) % AUDIO_RING_HW;
+		ring[idx] = (int16_t)((ring[idx] * gain) >> 15);
+	}
+	PROFILE_STOP(PROF_RAMP, start);
+}
+
+/**
+ * @brief Fill a part of the ring with silence
+ * @param from - The first ring offset in DMA items
+ * @param len - The length in DMA items, may wrap around the ring
+ */
+static void audio_silence(uint32_t from, uint32_t len)
+{
+	uint32_t idx, chunk;
+
+	while(len > 0)
+	{
+		idx = from % AUDIO_RING_HW;
+		chunk = ((AUDIO_RING_HW - idx) < len) ? (AUDIO_RING_HW - idx) : len;
+		memset(&audioBuffer[idx * AUDIO_DATA_SIZE], 0, chunk * AUDIO_DATA_SIZE);
+		from += chunk;
+		len -= chunk;
+	}
+}
+
+/**
+ * @brief Read song data into a part of the ring
+ * @param from - The first ring offset in DMA items
+ * @param len - The length in DMA items, may wrap around the ring
+ * @note Whatever is past the end of the file is filled with silence.
+ */
+static void audio_read_ring(uint32_t from, uint32_t len)
+{
+	uint32_t idx, chunk;
+	UINT br;
+
+	while(len > 0)
+	{
+		idx = from % AUDIO_RING_HW;
+		chunk = ((AUDIO_RING_HW - idx) < len) ? (AUDIO_RING_HW - idx) : len;
+		br = 0;
+		audio_file_read(&audioBuffer[idx * AUDIO_DATA_SIZE], chunk * AUDIO_DATA_SIZE, &br);
+		if(br < (chunk * AUDIO_DATA_SIZE))
+		{
+			memset(&audioBuffer[(idx * AUDIO_DATA_SIZE) + br], 0,
+					(chunk * AUDIO_DATA_SIZE) - br);
+		}
+		from += chunk;
+		len -= chunk;
+	}
+}
+
+/**
+ * @brief Map the clusters of the open file
+ * @note FAT files get a fast seek table so that neither seeking nor
+ * streaming walks the FAT chain. Contiguous exFAT files are flagged as
+ * having no FAT chain: FatFs computes their next cluster without any FAT
+ * access, so they need no table and stream straight from their LBA run.
+ */
+static void audio_link_map(void)
+{
+  FRESULT res;
+
+  wavFile.cltbl = NULL;
+  wavFragments = 1;
+#if _FS_EXFAT
+  if(wavFile.obj.stat == 2)
+  {
+    return;
+  }
+#endif
+  wavClmt[0] = WAV_CLMT_LEN;
+  wavFile.cltbl = wavClmt;
+  res = f_lseek(&wavFile, CREATE_LINKMAP);
+  //The table holds a length/cluster pair per fragment and a terminator
+  wavFragments = (wavClmt[0] - 2) / 2;
+  if(res != FR_OK)
+  {
+    wavFile.cltbl = NULL;
+  }
+}
+
+/**
+ * @brief Size the ring to the sector size of the volume
+ * @note With a half of at least one sector a refill needs at most one
+ * new device block per half, read by one READ10 of the full block size,
+ * and whole sectors are read by FatFs straight into the ring. Only called
+ * while the DMA is stopped.
+ */
+static void audio_size_ring(void)
+{
+#if _MAX_SS != _MIN_SS
+  sectorSize = wavFile.obj.fs->ssize;
+#else
+  sectorSize = _MAX_SS;
+#endif
+  audioBufferSize = 2 * (((AUDIO_BUFFER_MIN / 2) > sectorSize) ? (AUDIO_BUFFER_MIN / 2) : sectorSize);
+}
+
+/**
+ * @brief Choose between direct and copied streaming
+ * @note The ring halves are whole sectors, so when the ring starts at the
+ * sector holding the first sample every refill reads whole sectors: FatFs
+ * hands the ring slot to the disk layer, which fills it with whole sectors
+ * of its read-ahead ring, and the USB host pops the bulk-IN FIFO straight
+ * into it for any sector not read ahead yet, no sector buffer in between
+ * and no split head and tail sector reads. The streamPad bytes
+ * of the header in front of the first sample are played as silence. This
+ * needs the pad to be whole sample frames, otherwise the channels would
+ * swap, so such files are copied through the FatFs sector buffer.
+ */
+static void audio_align_stream(void)
+{
+  streamPad = dataOffset % sectorSize;
+  streamDirect = zeroCopy && ((streamPad % (hwPerSample * AUDIO_DATA_SIZE)) == 0);
+  if(!streamDirect)
+  {
+    streamPad = 0;
+  }
+}
+
+/**
+ * @brief Refill a ring half with silence while pausing
+ * @param slot - The ring half the DMA has just finished, 0 from the
+ * half-transfer and 1 from the transfer-complete interrupt
+ * @note Runs in the DMA interrupt. Once the DMA is past the end of the
+ * fade-out the codec is muted and the DMA requests are paused. The I2S
+ * keeps running, so the codec stays locked to its clocks.
+ */
+static void audio_pause_refill(uint8_t slot)
+{
+	memset(&audioBuffer[slot * (audioBufferSize / 2)], 0, audioBufferSize / 2);
+	slotStartSample[slot] = positionLimit;
+
+	if((pauseState == PLAYER_PAUSE_Fading) &&
+	   (audio_sample_at(audio_dma_offset()) >= positionLimit))
+	{
+		CS43_set_mute(true);
+		HAL_I2S_DMAPause(i2sptr);
+		pauseState = PLAYER_PAUSE_Muted;
+	}
+}
+
+/**
+ * @brief Convert DMA items of the ring to DWT cycles at the song rate
+ */
+static uint32_t audio_items_cycles(uint32_t items)
+{
+	return (uint32_t)(((uint64_t)(items / hwPerSample) * SystemCoreClock) / samplingFreq);
+}
+
+/**
+ * @brief Start the refill telemetry of a new track
+ * @note The worst slack of the track before is kept for the snapshot.
+ */
+static void audio_telemetry_start(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	__disable_irq();
+	if(telemetry.refills != 0)
+	{
+		telemetry.prevMinSlackUs = telemetry.minSlackUs;
+	}
+	telemetry.callbacks = 0;
+	telemetry.fillBytes = 0;
+	telemetry.minFillBytes = 0;
+	telemetry.refills = 0;
+	telemetry.lastSlackUs = 0;
+	telemetry.minSlackUs = 0;
+	telemetry.trackUnderruns = 0;
+	telemetryFillSum = 0;
+	telemetrySlackSum = 0;
+	slotPending[0] = false;
+	slotPending[1] = false;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Account for a ring half handed over for a refill
+ * @param slot - The ring half to be refilled
+ * @note Runs in the DMA interrupt. The other half is the one the refill
+ * before was for, if it is still pending the DMA has caught up with it.
+ * The refill is due when the DMA is back at the start of the half, taken
+ * from the DMA position so that a late interrupt does not add slack.
+ */
+static void audio_telemetry_request(uint8_t slot)
+{
+	uint32_t fill = slotPending[slot ^ 1] ? 0 : (audioBufferSize / 2);
+	uint32_t ahead;
+
+	if(slotPending[slot ^ 1])
+	{
+		TRACE(TRACE_EV_UNDERRUN, slot ^ 1, 0);
+		trace_trigger(WAV_TRACE_POST_UNDERRUN);
+		telemetry.trackUnderruns++;
+		telemetry.underruns++;
+		underrunTicks[underrunHead] = HAL_GetTick();
+		underrunHead = (underrunHead + 1) % WAV_TELEMETRY_UNDERRUNS;
+	}
+	if((telemetry.callbacks == 0) || (fill < telemetry.minFillBytes))
+	{
+		telemetry.minFillBytes = fill;
+	}
+	telemetry.callbacks++;
+	telemetry.fillBytes = fill;
+	telemetryFillSum += fill;
+	ahead = ((slot * AUDIO_SLOT_HW) + AUDIO_RING_HW - audio_dma_offset()) % AUDIO_RING_HW;
+	slotDueCycles[slot] = DWT->CYCCNT + audio_items_cycles(ahead);
+	slotPending[slot] = true;
+}
+
+/**
+ * @brief Account for a completed refill
+ * @param slot - The ring half that was refilled
+ */
+static void audio_telemetry_refilled(uint8_t slot)
+{
+	uint32_t primask;
+	int32_t slackUs;
+
+	if(!slotPending[slot])
+	{
+		return;
+	}
+	slackUs = (int32_t)(slotDueCycles[slot] - DWT->CYCCNT) / (int32_t)(SystemCoreClock / 1000000);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	slotPending[slot] = false;
+	if((telemetry.refills == 0) || (slackUs < telemetry.minSlackUs))
+	{
+		telemetry.minSlackUs = slackUs;
+	}
+	telemetry.refills++;
+	telemetry.lastSlackUs = slackUs;
+	telemetrySlackSum += slackUs;
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Power the codec down after a long pause
+ */
+static void audio_pause_timeout(void)
+{
+	if((pauseState == PLAYER_PAUSE_Muted) &&
+	   ((HAL_GetTick() - pausedAtTick) >= pauseTimeoutMs))
+	{
+		CS43_stop();
+		pauseState = PLAYER_PAUSE_PoweredDown;
+	}
 }
 
 /***************************************
@@ -232,19 +566,31 @@ void wavPlayer_reset(void)
  */
 bool wavPlayer_openFile(const char* filePath)
 {
-  WAV_HeaderTypeDef wavHeader;
-  UINT readBytes = 0;
+  wavLib_format_t wavFormat;
   //Open WAV file
   if(f_open(&wavFile, filePath, FA_READ) != FR_OK)
   {
     return false;
   }
-  //Read WAV file Header
-  f_read(&wavFile, &wavHeader, sizeof(wavHeader), &readBytes);
+  //Parse the RIFF chunks, the data does not have to start right after "fmt "
+  if(!wavLib_parseHeader(&wavFile, &wavFormat) || !wavLib_isPlayable(&wavFormat))
+  {
+    f_close(&wavFile);
+    return false;
+  }
+  dataOffset = wavFormat.dataOffset;
+  audio_link_map();
+  audio_size_ring();
   //Get audio data size
-  fileLength = wavHeader.FileSize;
+  fileLength = wavFormat.dataSize;
   //Play the WAV file with frequency specified in header
-  samplingFreq = wavHeader.SampleRate;
+  samplingFreq = wavFormat.sampleRate;
+  byteRate = wavFormat.byteRate;
+  //One sample frame is BlockAlign bytes, i.e. BlockAlign/2 DMA items
+  hwPerSample = wavFormat.blockAlign / AUDIO_DATA_SIZE;
+  totalSamples = fileLength / (hwPerSample * AUDIO_DATA_SIZE);
+  audio_align_stream();
+  stoppedPosition = 0;
   return true;
 }
 
@@ -253,17 +599,30 @@ bool wavPlayer_openFile(const char* filePath)
  */
 void wavPlayer_play(void)
 {
+  uint32_t dataRead;
+
   is_song_finished = false;
   //configure the PLL clock frequency setting
   audio_clock_config(samplingFreq);
   //update I2S peripheral sampling frequency
   audio_adjust_freq(samplingFreq);
-  //Read Audio data from USB Disk
-  f_lseek(&wavFile, 0);
-  f_read (&wavFile, &audioBuffer[0], AUDIO_BUFFER_SIZE, &player_bytes_read);
-  audioRemainSize = fileLength - player_bytes_read;
-  //Start playing the WAV
-  audio_play((uint16_t *)&audioBuffer[0], AUDIO_BUFFER_SIZE);
+  //Read Audio data from USB Disk, starting at the data chunk
+  pauseState = PLAYER_PAUSE_None;
+  positionLimit = UINT32_MAX;
+  f_lseek(&wavFile, dataOffset - streamPad);
+  audio_file_read(&audioBuffer[0], audioBufferSize, &player_bytes_read);
+  memset(&audioBuffer[0], 0, streamPad);
+  dataRead = (player_bytes_read > streamPad) ? (player_bytes_read - streamPad) : 0;
+  audioRemainSize = (fileLength > dataRead) ? (fileLength - dataRead) : 0;
+  //A direct stream starts with the pad, before the first sample
+  slotStartSample[0] = 0 - (streamPad / (hwPerSample * AUDIO_DATA_SIZE));
+  slotStartSample[1] = slotStartSample[0] + (AUDIO_SLOT_HW / hwPerSample);
+  nextSample = slotStartSample[0] + (AUDIO_RING_HW / hwPerSample);
+  audio_telemetry_start();
+  //Start playing the WAV, a song skipped while paused left the codec muted
+  audio_play((uint16_t *)&audioBuffer[0], audioBufferSize);
+  CS43_set_mute(false);
+  dmaRunning = true;
 }
 
 /**
@@ -271,16 +630,28 @@ void wavPlayer_play(void)
  */
 void wavPlayer_proceed(void)
 {
+  audio_pause_timeout();
+
   switch(playerControlSM)
   {
 	  case PLAYER_CONTROL_Idle:
+		//Nothing to refill, let the disk read ahead of the stream
+		if(dmaRunning)
+		{
+		  USBH_PrefetchProcess();
+		}
 		break;
 
 	  case PLAYER_CONTROL_HalfBuffer:
 		player_bytes_read = 0;
 		playerControlSM = PLAYER_CONTROL_Idle;
-		f_read (&wavFile, &audioBuffer[0], AUDIO_BUFFER_SIZE/2, &player_bytes_read);
-		if(audioRemainSize > (AUDIO_BUFFER_SIZE / 2))
+		slotStartSample[0] = nextSample;
+		nextSample += AUDIO_SLOT_HW / hwPerSample;
+		TRACE(TRACE_EV_REFILL_START, 0, 0);
+		audio_file_read(&audioBuffer[0], audioBufferSize/2, &player_bytes_read);
+		TRACE(TRACE_EV_REFILL_END, 0, player_bytes_read);
+		audio_telemetry_refilled(0);
+		if(audioRemainSize > (audioBufferSize / 2))
 		{
 		  audioRemainSize -= player_bytes_read;
 		}
@@ -294,9 +665,14 @@ void wavPlayer_proceed(void)
 	  case PLAYER_CONTROL_FullBuffer:
 		player_bytes_read = 0;
 		playerControlSM = PLAYER_CONTROL_Idle;
-		f_read (&wavFile, &audioBuffer[AUDIO_BUFFER_SIZE/2], AUDIO_BUFFER_SIZE/2,
+		slotStartSample[1] = nextSample;
+		nextSample += AUDIO_SLOT_HW / hwPerSample;
+		TRACE(TRACE_EV_REFILL_START, 1, 0);
+		audio_file_read(&audioBuffer[audioBufferSize/2], audioBufferSize/2,
 				&player_bytes_read);
-		if(audioRemainSize > (AUDIO_BUFFER_SIZE / 2))
+		TRACE(TRACE_EV_REFILL_END, 1, player_bytes_read);
+		audio_telemetry_refilled(1);
+		if(audioRemainSize > (audioBufferSize / 2))
 		{
 		  audioRemainSize -= player_bytes_read;
 		}
@@ -321,25 +697,168 @@ void wavPlayer_proceed(void)
  */
 void wavPlayer_stop(void)
 {
+  stoppedPosition = wavPlayer_getPositionSamples();
+  dmaRunning = false;
   audio_stop();
   f_close(&wavFile);
+  pauseState = PLAYER_PAUSE_None;
+  positionLimit = UINT32_MAX;
   is_song_finished = true;
 }
 
 /**
  * @brief WAV pause
+ * @note The codec stays powered. The audio right ahead of the DMA is
+ * faded out in place and the rest of the ring is silenced, the DMA
+ * callbacks keep writing silence until the DMA is past the fade, then the
+ * codec is muted with its mute bits and the DMA requests are paused. The
+ * codec is only powered down after the pause timeout, from
+ * wavPlayer_proceed().
  */
 void wavPlayer_pause(void)
 {
-	audio_pause();
+  uint32_t pos, from, fade, slotEnd;
+
+  if(!dmaRunning || (pauseState != PLAYER_PAUSE_None))
+  {
+    return;
+  }
+  //Bring a pending half up to date so that the fade works on fresh audio
+  if((playerControlSM == PLAYER_CONTROL_HalfBuffer) ||
+     (playerControlSM == PLAYER_CONTROL_FullBuffer))
+  {
+    wavPlayer_proceed();
+  }
+
+  pauseState = PLAYER_PAUSE_Fading;
+  slotPending[0] = false;
+  slotPending[1] = false;
+  pos = audio_dma_offset();
+  from = pos + AUDIO_GUARD_HW;
+  fade = AUDIO_FADE_HW;
+  //A half handed over in the meantime holds stale audio, keep out of it
+  if((playerControlSM == PLAYER_CONTROL_HalfBuffer) ||
+     (playerControlSM == PLAYER_CONTROL_FullBuffer))
+  {
+    playerControlSM = PLAYER_CONTROL_Idle;
+    slotEnd = ((pos / AUDIO_SLOT_HW) + 1) * AUDIO_SLOT_HW;
+    from = (from < slotEnd) ? from : slotEnd;
+    fade = ((slotEnd - from) < fade) ? (slotEnd - from) : fade;
+  }
+
+  positionLimit = audio_sample_at(pos) + ((from - pos + fade) / hwPerSample);
+  pauseFadeFrames = fade / hwPerSample;
+  audio_ramp(from, fade, 0, false);
+  audio_silence(from + fade, AUDIO_RING_HW - (from - pos) - fade);
+  pausedAtTick = HAL_GetTick();
 }
 
 /**
  * @brief WAV resume
+ * @note The DMA is paused, so its position is known and fixed: the song is
+ * read from the pause position straight into the ring at the DMA position,
+ * faded in and the DMA requests are resumed. Only the rest of the current
+ * half (and the next half when little is left) is read before resuming, so
+ * with the codec still powered this takes a few milliseconds. A direct
+ * stream starts the fade-in up to one sector later, after a little
+ * silence, so that the ring halves start at sectors of the file again.
+ * Resumed during the fade-out, the DMA is paused right away and the song
+ * goes on from the sample at the DMA position, faded in from the gain the
+ * fade-out had reached, with no silence in between. The ring keeps its
+ * mapping to the file then, so a direct stream needs no gap either.
  */
 void wavPlayer_resume(void)
 {
-	audio_resume();
+  uint32_t pos, len, slot, resumeSample, fileOffset, gap, lead, skip;
+
+  if(pauseState == PLAYER_PAUSE_None)
+  {
+    return;
+  }
+  if(pauseState == PLAYER_PAUSE_Fading)
+  {
+    HAL_I2S_DMAPause(i2sptr);
+  }
+  else if(pauseState == PLAYER_PAUSE_PoweredDown)
+  {
+    CS43_start();
+  }
+
+  //The DMA may have stopped inside a frame, the song goes on at the next one
+  pos = audio_dma_offset();
+  resumeSample = audio_sample_at(pos - (pos % hwPerSample));
+  if((pos % hwPerSample) != 0)
+  {
+    resumeSample++;
+    pos = (pos + hwPerSample - (pos % hwPerSample)) % AUDIO_RING_HW;
+  }
+  skip = 0;
+  if((pauseState == PLAYER_PAUSE_Fading) && (resumeSample < positionLimit))
+  {
+    //The fade-out gain at the DMA, the fade-in starts from there
+    skip = positionLimit - resumeSample;
+    skip = (skip < pauseFadeFrames) ?
+        ((skip * (AUDIO_FADE_HW / hwPerSample)) / pauseFadeFrames) :
+        (AUDIO_FADE_HW / hwPerSample);
+  }
+  else
+  {
+    resumeSample = positionLimit;
+  }
+
+  fileOffset = dataOffset + (resumeSample * hwPerSample * AUDIO_DATA_SIZE);
+  f_lseek(&wavFile, fileOffset);
+
+  slot = pos / AUDIO_SLOT_HW;
+  len = ((slot + 1) * AUDIO_SLOT_HW) - pos;
+  //Read up to a sector boundary of the file at the end of the half
+  lead = ((sectorSize - (fileOffset % sectorSize)) % sectorSize) / AUDIO_DATA_SIZE;
+  gap = (streamDirect && (skip == 0)) ?
+      ((len + (sectorSize / AUDIO_DATA_SIZE) - lead) % (sectorSize / AUDIO_DATA_SIZE)) : 0;
+  if((gap > len) || ((len - gap) < AUDIO_RESUME_MIN_HW))
+  {
+    len += AUDIO_SLOT_HW;
+  }
+  audio_silence(pos, gap);
+  audio_read_ring(pos + gap, len - gap);
+  audio_ramp(pos + gap, AUDIO_FADE_HW, skip, true);
+
+  slotStartSample[slot] = resumeSample - ((pos + gap - (slot * AUDIO_SLOT_HW)) / hwPerSample);
+  slotStartSample[slot ^ 1] = slotStartSample[slot] + (AUDIO_SLOT_HW / hwPerSample);
+  nextSample = resumeSample + ((len - gap) / hwPerSample);
+  audioRemainSize = (nextSample < totalSamples) ?
+      ((totalSamples - nextSample) * hwPerSample * AUDIO_DATA_SIZE) : 0;
+  //Only the current half was filled, the next one is due right away
+  if(len <= AUDIO_SLOT_HW)
+  {
+    slotDueCycles[slot ^ 1] = DWT->CYCCNT + audio_items_cycles(((slot + 1) * AUDIO_SLOT_HW) - pos);
+    slotPending[slot ^ 1] = true;
+    playerControlSM = (slot == 0) ? PLAYER_CONTROL_FullBuffer : PLAYER_CONTROL_HalfBuffer;
+  }
+
+  positionLimit = UINT32_MAX;
+  pauseState = PLAYER_PAUSE_None;
+  CS43_set_mute(false);
+  HAL_I2S_DMAResume(i2sptr);
+}
+
+/**
+ * @brief Set how long a pause lasts before the codec is powered down
+ * @param timeoutMs - The idle time in milliseconds
+ */
+void wavPlayer_setPauseTimeout(uint32_t timeoutMs)
+{
+  pauseTimeoutMs = timeoutMs;
+}
+
+/**
+ * @brief Enable or disable direct streaming into the audio ring
+ * @param enable - false to always copy through the FatFs sector buffer
+ * @note Takes effect with the next wavPlayer_openFile().
+ */
+void wavPlayer_setZeroCopy(bool enable)
+{
+  zeroCopy = enable;
 }
 
 /**
@@ -359,6 +878,301 @@ bool is_wavPlayer_finished_Playing(void)
   return is_song_finished;
 }
 
+/**
+ * @brief Check whether a half of the audio buffer is waiting for data
+ * @return true if the next wavPlayer_proceed() call has a refill to do
+ * @note Background work (LCD, scanning) uses this to step aside while
+ * the audio path has something to do.
+ */
+bool wavPlayer_refillPending(void)
+{
+  return (playerControlSM != PLAYER_CONTROL_Idle);
+}
+
+/**
+ * @brief Get the time left until the pending refill is due
+ * @return the slack in microseconds, negative when the refill is late,
+ * INT32_MAX when no refill is pending
+ * @note A refill is due when the DMA hands over the next half, the
+ * scheduler runs the refill first when this gets short.
+ */
+int32_t wavPlayer_refillSlackUs(void)
+{
+  int32_t slackUs = INT32_MAX;
+  int32_t cyclesPerUs = (int32_t)(SystemCoreClock / 1000000);
+  uint32_t now = DWT->CYCCNT;
+  uint8_t slot;
+
+  for(slot = 0; slot < AUDIO_SLOT_NUM; slot++)
+  {
+    if(slotPending[slot] && (((int32_t)(slotDueCycles[slot] - now) / cyclesPerUs) < slackUs))
+    {
+      slackUs = (int32_t)(slotDueCycles[slot] - now) / cyclesPerUs;
+    }
+  }
+  return slackUs;
+}
+
+/**
+ * @brief Get the time until the player has work to do between refills
+ * @return 0 while the read-ahead of the stream makes progress or the codec
+ * is due to be powered down, the time left until the power down during a
+ * shorter pause, WAV_BACKGROUND_IDLE otherwise
+ */
+uint32_t wavPlayer_backgroundDelayMs(void)
+{
+  uint32_t pausedMs;
+
+  if(dmaRunning && USBH_PrefetchPending())
+  {
+    return 0;
+  }
+  if(pauseState != PLAYER_PAUSE_Muted)
+  {
+    return WAV_BACKGROUND_IDLE;
+  }
+  pausedMs = HAL_GetTick() - pausedAtTick;
+  return (pausedMs >= pauseTimeoutMs) ? 0 : (pauseTimeoutMs - pausedMs);
+}
+
+/**
+ * @brief Check whether the player has work to do between refills
+ * @return true while the read-ahead of the stream makes progress or the
+ * codec is due to be powered down after a long pause
+ * @note Stays false for the rest of a pause, so that the idle loop sleeps.
+ */
+bool wavPlayer_backgroundPending(void)
+{
+  return wavPlayer_backgroundDelayMs() == 0;
+}
+
+/**
+ * @brief Do the work of the player between refills
+ * @note The part of wavPlayer_proceed() that has no deadline: the codec
+ * power down after a long pause and the disk read-ahead. It never waits
+ * for the disk and leaves a pending refill to wavPlayer_proceed().
+ */
+void wavPlayer_background(void)
+{
+  audio_pause_timeout();
+  if((playerControlSM == PLAYER_CONTROL_Idle) && dmaRunning)
+  {
+    USBH_PrefetchProcess();
+  }
+}
+
+/**
+ * @brief Set the function that wakes the refill
+ * @param notify - Called from the DMA interrupt after a ring half was
+ * handed over for a refill, e.g. to wake the thread that runs
+ * wavPlayer_proceed(), NULL when the refill is polled
+ */
+void wavPlayer_setRefillNotify(wavPlayer_notify_t notify)
+{
+  refillNotify = notify;
+}
+
+/**
+ * @brief Get the length of the open song
+ * @return the duration in milliseconds, 0 if unknown
+ */
+uint32_t wavPlayer_getDurationMs(void)
+{
+  if(byteRate == 0)
+  {
+    return 0;
+  }
+  return (uint32_t)(((uint64_t)fileLength * 1000) / byteRate);
+}
+
+/**
+ * @brief Get the sampling frequency of the open song
+ * @return the sample rate in Hz
+ */
+uint32_t wavPlayer_getSampleRate(void)
+{
+  return samplingFreq;
+}
+
+/**
+ * @brief Get the total number of samples of the open song
+ * @return the song length in sample frames
+ */
+uint32_t wavPlayer_getTotalSamples(void)
+{
+  return totalSamples;
+}
+
+/**
+ * @brief Get the sample frame that is being sent to the codec
+ * @return the playback position in sample frames from the start of the song
+ * @note Every ring half remembers the file sample it was filled from, so
+ * the position is that start plus how far the DMA is into the half, taken
+ * from the live NDTR register of the I2S DMA stream. A ledger entry is a
+ * single word store made once the DMA has left its half (a refill, the
+ * silence of a pause) or while the DMA is paused (a resume), and NDTR is
+ * read once, so no lock or retry loop is needed and the call is safe from
+ * any context that is not held up for a whole ring half between the two
+ * reads. NDTR leads the I2S shift register by the DMA FIFO depth, which is
+ * a few DMA items at most. While paused the position stays at the end of
+ * the fade-out.
+ */
+uint32_t wavPlayer_getPositionSamples(void)
+{
+  uint32_t ndtr, offset, slot, pos;
+
+  if(!dmaRunning)
+  {
+    return stoppedPosition;
+  }
+
+  ndtr = __HAL_DMA_GET_COUNTER(i2sptr->hdmatx);
+  offset = (AUDIO_RING_HW - ndtr) % AUDIO_RING_HW;
+  slot = offset / AUDIO_SLOT_HW;
+  pos = slotStartSample[slot] + ((offset - (slot * AUDIO_SLOT_HW)) / hwPerSample);
+  //Neither the pad of a direct stream nor the silence after a fade-out count
+  pos = ((int32_t)pos < 0) ? 0 : pos;
+  pos = (pos < positionLimit) ? pos : positionLimit;
+
+  return (pos < totalSamples) ? pos : totalSamples;
+}
+
+/**
+ * @brief Get the playing time of the open song
+ * @return the elapsed time in milliseconds
+ */
+uint32_t wavPlayer_getElapsedMs(void)
+{
+  if((samplingFreq == 0) || is_song_finished)
+  {
+    return 0;
+  }
+  return (uint32_t)(((uint64_t)wavPlayer_getPositionSamples() * 1000) / samplingFreq);
+}
+
+/**
+ * @brief Take a snapshot of the refill telemetry
+ * @param snap - The snapshot, consistent with the DMA interrupt
+ * @note Fill levels are taken at every DMA callback: a ring half that was
+ * refilled in time is a half ring of fresh audio ahead of the DMA, one that
+ * was not is an underrun. The slack is the time from the end of a refill
+ * to the DMA callback it had to beat.
+ */
+void wavPlayer_getTelemetry(wavPlayer_telemetry_t *snap)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t i, first;
+
+  __disable_irq();
+  *snap = telemetry;
+  snap->avgFillBytes = (telemetry.callbacks != 0) ?
+      (uint32_t)(telemetryFillSum / telemetry.callbacks) : 0;
+  snap->avgSlackUs = (telemetry.refills != 0) ?
+      (int32_t)(telemetrySlackSum / (int64_t)telemetry.refills) : 0;
+  snap->underrunsKept = (telemetry.underruns < WAV_TELEMETRY_UNDERRUNS) ?
+      telemetry.underruns : WAV_TELEMETRY_UNDERRUNS;
+  first = (underrunHead + WAV_TELEMETRY_UNDERRUNS - snap->underrunsKept) % WAV_TELEMETRY_UNDERRUNS;
+  for(i = 0; i < snap->underrunsKept; i++)
+  {
+    snap->underrunMs[i] = underrunTicks[(first + i) % WAV_TELEMETRY_UNDERRUNS];
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Clear the refill telemetry of all tracks
+ * @note The refills pending in the ring stay tracked.
+ */
+void wavPlayer_clearTelemetry(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(&telemetry, 0, sizeof(telemetry));
+  telemetryFillSum = 0;
+  telemetrySlackSum = 0;
+  underrunHead = 0;
+  __set_PRIMASK(primask);
+}
+
+#ifdef WAV_PLAYER_BENCHMARK
+/**
+ * @brief Stream the open file through the audio buffer once
+ * @param direct - true to start at the sector of the first sample, so
+ * every read is whole sectors into the buffer, false to start at the first
+ * sample and copy through the FatFs sector buffer as a copied stream does.
+ * Both read ahead between the reads as playback does.
+ * @param bytes - The number of bytes read
+ * @return the DWT cycles taken, 0 on a read error
+ */
+static uint32_t bench_pass(bool direct, uint32_t *bytes)
+{
+  uint32_t start, i;
+  UINT br;
+
+  *bytes = 0;
+  f_lseek(&wavFile, direct ? (dataOffset - (dataOffset % sectorSize)) : dataOffset);
+  start = DWT->CYCCNT;
+  do
+  {
+    if(f_read(&wavFile, audioBuffer, audioBufferSize / 2, &br) != FR_OK)
+    {
+      return 0;
+    }
+    *bytes += br;
+    for(i = 0; i <= ((audioBufferSize / 2) / USBH_PREFETCH_CHUNK); i++)
+    {
+      USBH_PrefetchProcess();
+    }
+  }while(br == (audioBufferSize / 2));
+  return DWT->CYCCNT - start;
+}
+
+/**
+ * @brief Measure the streaming throughput of a file
+ * @param filePath - The WAV file to read
+ * @param result - The measurement
+ * @return false when the file can not be opened or read
+ * @note Reads the whole data chunk in ring-half sized pieces through the
+ * same path as playback (link map, f_read into the audio buffer) and times
+ * it with the DWT cycle counter, once copied and once direct. The player
+ * must be stopped. Running it on the same file copied to a FAT32 and an
+ * exFAT stick compares the two.
+ */
+bool wavPlayer_benchmark(const char *filePath, wavPlayer_bench_t *result)
+{
+  uint32_t copyCycles, cycles, copyBytes;
+
+  memset(result, 0, sizeof(*result));
+  if(!wavPlayer_openFile(filePath))
+  {
+    return false;
+  }
+  result->fsType = wavFile.obj.fs->fs_type;
+#if _FS_EXFAT
+  result->noFatChain = (wavFile.obj.stat == 2);
+#endif
+  result->fragments = wavFragments;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  copyCycles = bench_pass(false, &copyBytes);
+  cycles = bench_pass(true, &result->bytes);
+  f_close(&wavFile);
+  if((copyCycles == 0) || (cycles == 0) || (copyBytes == 0) || (result->bytes == 0))
+  {
+    return false;
+  }
+
+  result->us = (uint32_t)(((uint64_t)cycles * 1000000) / SystemCoreClock);
+  result->kBps = (result->us == 0) ? 0 :
+      (uint32_t)(((uint64_t)result->bytes * 1000) / result->us);
+  result->copyCyclesPerSec = (uint32_t)(((uint64_t)copyCycles * byteRate) / copyBytes);
+  result->directCyclesPerSec = (uint32_t)(((uint64_t)cycles * byteRate) / result->bytes);
+  return true;
+}
+#endif
+
 /**
  * @brief The callback function for the TX completion interrupt
  * @param hi2s - The pointer to the I2S module whose interrupt is triggered
@@ -367,7 +1181,20 @@ void HAL_I2S_TxCpltCallback(I2S_HandleTypeDef *hi2s)
 {
   if(hi2s->Instance == SPI3)
   {
-	  playerControlSM = PLAYER_CONTROL_HalfBuffer;
+	  TRACE(TRACE_EV_DMA, 1, pauseState);
+	  if(pauseState != PLAYER_PAUSE_None)
+	  {
+		  audio_pause_refill(1);
+	  }
+	  else
+	  {
+		  audio_telemetry_request(1);
+		  playerControlSM = PLAYER_CONTROL_FullBuffer;
+		  if(refillNotify != NULL)
+		  {
+			  refillNotify();
+		  }
+	  }
   }
 }
 
@@ -379,7 +1206,20 @@ void HAL_I2S_TxHalfCpltCallback(I2S_HandleTypeDef *hi2s)
 {
   if(hi2s->Instance == SPI3)
   {
-	  playerControlSM = PLAYER_CONTROL_FullBuffer;
+	  TRACE(TRACE_EV_DMA, 0, pauseState);
+	  if(pauseState != PLAYER_PAUSE_None)
+	  {
+		  audio_pause_refill(0);
+	  }
+	  else
+	  {
+		  audio_telemetry_request(0);
+		  playerControlSM = PLAYER_CONTROL_HalfBuffer;
+		  if(refillNotify != NULL)
+		  {
+			  refillNotify();
+		  }
+	  }
   }
 }
 
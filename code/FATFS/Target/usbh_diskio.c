@@ -23,12 +23,13 @@
 /* Includes ------------------------------------------------------------------*/
 #include "ff_gen_drv.h"
 #include "usbh_diskio.h"
+#include "usb_host.h"
+#include "profile.h"
+#include <string.h>
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 
-#define USB_DEFAULT_BLOCK_SIZE 512
-
 /* Private variables ---------------------------------------------------------*/
 extern USBH_HandleTypeDef  hUSB_Host;
 
@@ -36,6 +37,7 @@ extern USBH_HandleTypeDef  hUSB_Host;
 DSTATUS USBH_initialize (BYTE);
 DSTATUS USBH_status (BYTE);
 DRESULT USBH_read (BYTE, BYTE*, DWORD, UINT);
+static USBH_StatusTypeDef USBH_ReadDevice(BYTE, BYTE*, DWORD, UINT);
 
 #if _USE_WRITE == 1
   DRESULT USBH_write (BYTE, const BYTE*, DWORD, UINT);
@@ -60,10 +62,500 @@ const Diskio_drvTypeDef  USBH_Driver =
 
 /* USER CODE BEGIN beforeFunctionSection */
 /* can be used to modify / undefine following code or add new code */
+
+/* Metadata sector cache
+ *
+ * FatFs reads FAT, directory and boot sectors one at a time into the
+ * window of the volume, so every chain lookup or directory listing used to
+ * be a READ10 of one sector. These reads, and other single sector reads
+ * that do not continue the previous data read (header probes), are kept
+ * in a small LRU cache. Multi-sector reads and single sector reads that
+ * continue a data read (the head and tail sectors of streamed audio)
+ * bypass the cache, so streaming never evicts metadata. Writes are
+ * written through and update the cached copies. */
+#define USBH_CACHE_SLOTS_MAX    (USBH_CACHE_SIZE / _MIN_SS)
+
+typedef struct
+{
+  DWORD sector;
+  DWORD lastUse;
+  BYTE  lun;
+  BYTE  valid;
+} USBH_CacheSlotTypeDef;
+
+extern FATFS USBHFatFS;
+
+#if USBH_CACHE_SIZE > 0
+static DWORD cacheData[USBH_CACHE_SIZE / sizeof(DWORD)];
+static USBH_CacheSlotTypeDef cacheSlot[USBH_CACHE_SLOTS_MAX];
+#endif
+static UINT cacheSlots;         /* slots for the sector size of the device */
+static UINT diskSectorSize;
+static DWORD diskSectors;
+static DWORD cacheClock;
+static DWORD dataReadEnd = 0xFFFFFFFF;
+static USBH_CacheStatsTypeDef cacheStats;
+
+/* Read-ahead of streamed data
+ *
+ * A data read that continues the previous data read, or the current
+ * stream, marks the stream as active. USBH_PrefetchProcess() then reads
+ * the sectors after the stream into a ring while the application has
+ * nothing else to do, so the next refill of the stream is a memcpy from
+ * the ring instead of a READ10. Sector s lives in ring slot s % pfSlots;
+ * the ring holds the pfCount sectors from pfFirst on. Reads that belong
+ * to other files (header probes, the library scan) do not touch the ring,
+ * and a read that leaves the stream restarts it at the new position.
+ *
+ * The read-ahead does not wait for the device: one READ10 is in flight
+ * and the next one is queued behind it, so the BOT sends its CBW as soon
+ * as the CSW of the first one is in. A demand read first waits for the
+ * read-ahead in flight, the BOT pipe runs one command at a time. The
+ * READ10 size adapts to the measured command time: it doubles while a
+ * command takes less than half of USBH_PREFETCH_TARGET_US and halves when
+ * it takes longer, so commands are large enough to hide the per-command
+ * latency of the device but a demand read never waits long behind them.
+ * It never drops below USBH_PREFETCH_CHUNK, about a ring half of the
+ * player: smaller commands do not bring a refill in any sooner, they only
+ * add the per-command latency, which NAKing sticks make long. */
+#if USBH_PREFETCH_SIZE > 0
+static DWORD pfData[USBH_PREFETCH_SIZE / sizeof(DWORD)];
+#endif
+static UINT pfSlots;            /* ring slots for the sector size of the device */
+static UINT pfChunk;            /* sectors per read-ahead READ10 */
+static UINT pfChunkMin;         /* the first size, never shrunk below */
+static DWORD pfFirst;
+static UINT pfCount;
+static DWORD pfCmdSector[2];    /* [0] in flight, [1] queued behind it */
+static UINT pfCmdCount[2];
+static UINT pfCmds;
+static DWORD pfCmdStart;        /* DWT cycles when pfCmd[0] went out */
+static DWORD streamNext = 0xFFFFFFFF;
+static BYTE streamLun;
+static BYTE streamActive;
+
+/**
+  * @brief  Size the cache to the sector size of the device and empty it
+  * @param  lun : lun id
+  */
+static void USBH_CacheReset(BYTE lun)
+{
+  MSC_LUNTypeDef info;
+
+  cacheSlots = 0;
+  diskSectorSize = 0;
+  diskSectors = 0;
+  dataReadEnd = 0xFFFFFFFF;
+  pfSlots = 0;
+  pfChunk = 0;
+  pfCount = 0;
+  pfCmds = 0;
+  streamNext = 0xFFFFFFFF;
+  streamActive = 0;
+#if USBH_CACHE_SIZE > 0
+  memset(cacheSlot, 0, sizeof(cacheSlot));
+#endif
+  if((USBH_MSC_GetLUNInfo(&hUSB_Host, lun, &info) == USBH_OK) &&
+     (info.capacity.block_size >= _MIN_SS) && (info.capacity.block_size <= _MAX_SS))
+  {
+    diskSectorSize = info.capacity.block_size;
+    diskSectors = info.capacity.block_nbr;
+    cacheSlots = USBH_CACHE_SIZE / diskSectorSize;
+    pfSlots = USBH_PREFETCH_SIZE / diskSectorSize;
+    pfChunk = USBH_PREFETCH_CHUNK / diskSectorSize;
+    if(pfChunk > (pfSlots / 2))
+    {
+      pfChunk = pfSlots / 2;
+    }
+    if(pfChunk == 0)
+    {
+      pfChunk = 1;
+    }
+  }
+  pfChunkMin = pfChunk;
+  cacheStats.prefetchChunk = pfChunk;
+
+  /* The command times are taken with the cycle counter */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+  * @brief  Get the cache slot of a sector
+  * @retval The slot holding the sector, otherwise the least recently used
+  *         slot with valid cleared, NULL when the cache is disabled
+  */
+static USBH_CacheSlotTypeDef *USBH_CacheLookup(BYTE lun, DWORD sector)
+{
+#if USBH_CACHE_SIZE > 0
+  USBH_CacheSlotTypeDef *victim = NULL;
+  UINT i;
+
+  for(i = 0; i < cacheSlots; i++)
+  {
+    if(cacheSlot[i].valid && (cacheSlot[i].lun == lun) && (cacheSlot[i].sector == sector))
+    {
+      cacheSlot[i].lastUse = ++cacheClock;
+      return &cacheSlot[i];
+    }
+    if((victim == NULL) || !cacheSlot[i].valid ||
+       (victim->valid && (cacheSlot[i].lastUse < victim->lastUse)))
+    {
+      victim = &cacheSlot[i];
+    }
+  }
+  if(victim != NULL)
+  {
+    victim->valid = 0;
+  }
+  return victim;
+#else
+  (void)lun;
+  (void)sector;
+  return NULL;
+#endif
+}
+
+/**
+  * @brief  Get the data of a cache slot
+  */
+static BYTE *USBH_CacheData(const USBH_CacheSlotTypeDef *slot)
+{
+#if USBH_CACHE_SIZE > 0
+  return (BYTE *)cacheData + ((UINT)(slot - cacheSlot) * diskSectorSize);
+#else
+  (void)slot;
+  return NULL;
+#endif
+}
+
+/**
+  * @brief  Check whether a read should go through the cache
+  */
+static BYTE USBH_CacheWanted(const BYTE *buff, DWORD sector, UINT count)
+{
+  if((cacheSlots == 0) || (count != 1))
+  {
+    return 0;
+  }
+  return (buff == USBHFatFS.win) || (sector != dataReadEnd);
+}
+
+/**
+  * @brief  Update the cached copies of written sectors
+  */
+static void USBH_CacheWrite(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+#if USBH_CACHE_SIZE > 0
+  UINT i;
+
+  for(i = 0; i < cacheSlots; i++)
+  {
+    if(cacheSlot[i].valid && (cacheSlot[i].lun == lun) &&
+       (cacheSlot[i].sector >= sector) && (cacheSlot[i].sector < (sector + count)))
+    {
+      memcpy(USBH_CacheData(&cacheSlot[i]),
+             buff + ((cacheSlot[i].sector - sector) * diskSectorSize), diskSectorSize);
+    }
+  }
+#else
+  (void)lun;
+  (void)buff;
+  (void)sector;
+  (void)count;
+#endif
+}
+
+/**
+  * @brief  Get the data of a ring slot
+  */
+static BYTE *USBH_PrefetchData(DWORD sector)
+{
+#if USBH_PREFETCH_SIZE > 0
+  return (BYTE *)pfData + ((sector % pfSlots) * diskSectorSize);
+#else
+  (void)sector;
+  return NULL;
+#endif
+}
+
+/**
+  * @brief  Serve the head of a data read from the ring and track the stream
+  * @retval The number of sectors copied to buff
+  */
+static UINT USBH_PrefetchServe(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  DWORD end = sector + count;
+  DWORD ringEnd = pfFirst + pfCount;
+  UINT n = 0;
+  UINT i;
+
+  if((pfCount > 0) && (lun == streamLun) && (sector >= pfFirst) && (sector < ringEnd))
+  {
+    n = ((ringEnd - sector) < count) ? (UINT)(ringEnd - sector) : count;
+    for(i = 0; i < n; i++)
+    {
+      memcpy(buff + (i * diskSectorSize), USBH_PrefetchData(sector + i), diskSectorSize);
+    }
+    cacheStats.prefetchHits += n;
+  }
+
+  if((n > 0) || (sector == streamNext) || (sector == dataReadEnd))
+  {
+    /* Part of the stream, drop what it consumed or skipped */
+    if((n == 0) || (lun != streamLun) || (end >= ringEnd))
+    {
+      pfCount = 0;
+    }
+    else
+    {
+      pfCount = (UINT)(ringEnd - end);
+    }
+    pfFirst = end;
+    streamNext = end;
+    streamLun = lun;
+    streamActive = (pfSlots > 0);
+  }
+  dataReadEnd = end;
+  return n;
+}
+
+/**
+  * @brief  Drop the buffered sectors a write overlaps
+  */
+static void USBH_PrefetchWrite(BYTE lun, DWORD sector, UINT count)
+{
+  if((pfCount > 0) && (lun == streamLun) &&
+     (sector < (pfFirst + pfCount)) && ((sector + count) > pfFirst))
+  {
+    pfCount = 0;
+    streamActive = 0;
+  }
+}
+
+/**
+  * @brief  Adapt the read-ahead size to the time a command took
+  * @param  cycles : DWT cycles from the CBW to the CSW of the command
+  */
+static void USBH_PrefetchAdapt(DWORD cycles)
+{
+  DWORD us = (DWORD)(((uint64_t)cycles * 1000000U) / SystemCoreClock);
+
+  if(((us * 2) < USBH_PREFETCH_TARGET_US) && ((pfChunk * 2) <= (pfSlots / 2)))
+  {
+    pfChunk *= 2;
+  }
+  else if((us > USBH_PREFETCH_TARGET_US) && (pfChunk > pfChunkMin))
+  {
+    pfChunk /= 2;
+  }
+  cacheStats.prefetchChunk = pfChunk;
+}
+
+/**
+  * @brief  Complete the read-ahead command that was in flight
+  * @param  status : The result of the command
+  */
+static void USBH_PrefetchComplete(USBH_StatusTypeDef status)
+{
+  DWORD now;
+
+  if(status != USBH_OK)
+  {
+    /* The queued command was dropped with the failed one. Read the failed
+       sectors again the way a demand read does: the unit keeps its error,
+       and FatFs its disk status, until a command passes */
+    pfCmds = 1;
+    cacheStats.retries++;
+    if(USBH_ReadDevice(streamLun, USBH_PrefetchData(pfCmdSector[0]), pfCmdSector[0],
+                       pfCmdCount[0]) != USBH_OK)
+    {
+      pfCmds = 0;
+      streamActive = 0;
+      return;
+    }
+  }
+
+  now = DWT->CYCCNT;
+  pfCount += pfCmdCount[0];
+  cacheStats.prefetched += pfCmdCount[0];
+  USBH_PrefetchAdapt(now - pfCmdStart);
+
+  /* The queued command went out with the CSW of this one */
+  pfCmdSector[0] = pfCmdSector[1];
+  pfCmdCount[0] = pfCmdCount[1];
+  pfCmdStart = now;
+  pfCmds--;
+}
+
+/**
+  * @brief  Advance the read-ahead in flight
+  */
+static void USBH_PrefetchPoll(void)
+{
+  USBH_StatusTypeDef status;
+
+  if(pfCmds > 0)
+  {
+    status = USBH_MSC_ReadPoll(&hUSB_Host, streamLun);
+    if(status != USBH_BUSY)
+    {
+      USBH_PrefetchComplete(status);
+    }
+  }
+}
+
+/**
+  * @brief  Wait until no read-ahead is in flight
+  * @note   The MSC read times out, so this always returns.
+  */
+static void USBH_PrefetchDrain(void)
+{
+  while(pfCmds > 0)
+  {
+    USBH_PrefetchPoll();
+  }
+}
+
+/**
+  * @brief  Find the next read-ahead command
+  * @param  next : The first sector of the command
+  * @retval The sectors of the command, 0 when none can be issued now
+  * @note   Only a full sized command is issued, or a shorter one at the end
+  *         of the ring or of the disk.
+  */
+static UINT USBH_PrefetchNext(DWORD *next)
+{
+  UINT busy = pfCount;
+  UINT n, i;
+
+  *next = pfFirst + pfCount;
+  if(!streamActive || (pfCmds >= 2))
+  {
+    return 0;
+  }
+  for(i = 0; i < pfCmds; i++)
+  {
+    *next += pfCmdCount[i];
+    busy += pfCmdCount[i];
+  }
+  if(*next >= diskSectors)
+  {
+    return 0;
+  }
+
+  /* up to the chunk size, the end of the ring and the end of the disk */
+  n = pfSlots - (UINT)(*next % pfSlots);
+  if(n > pfChunk)
+  {
+    n = pfChunk;
+  }
+  if(n > (diskSectors - *next))
+  {
+    n = (UINT)(diskSectors - *next);
+  }
+  return ((pfSlots - busy) < n) ? 0 : n;
+}
+
+/**
+  * @brief  Start or queue the next read-ahead command
+  */
+static void USBH_PrefetchIssue(void)
+{
+  DWORD next;
+  UINT n = USBH_PrefetchNext(&next);
+  USBH_StatusTypeDef status;
+
+  if(n == 0)
+  {
+    return;
+  }
+
+  if(pfCmds == 0)
+  {
+    status = USBH_MSC_ReadStart(&hUSB_Host, streamLun, next, USBH_PrefetchData(next), n);
+    pfCmdStart = DWT->CYCCNT;
+  }
+  else
+  {
+    status = USBH_MSC_ReadQueue(&hUSB_Host, streamLun, next, USBH_PrefetchData(next), n);
+    cacheStats.pipelined++;
+  }
+  if(status == USBH_OK)
+  {
+    pfCmdSector[pfCmds] = next;
+    pfCmdCount[pfCmds] = n;
+    pfCmds++;
+  }
+}
+
+/**
+  * @brief  Read ahead of the active stream
+  * @note   Never waits for the device: advances the command in flight and
+  *         keeps a second one queued behind it. Called by the player
+  *         whenever it has no refill to do.
+  */
+void USBH_PrefetchProcess(void)
+{
+  MX_USB_HOST_Lock();
+  USBH_PrefetchPoll();
+  USBH_PrefetchIssue();
+  USBH_PrefetchIssue();
+  MX_USB_HOST_Unlock();
+}
+
+/**
+  * @brief  Check whether the read-ahead has work to do
+  * @retval 1 while a command is in flight or the next one can be issued
+  * @note   Lets the caller poll only while the read-ahead makes progress,
+  *         not while it waits for the ring to drain.
+  */
+BYTE USBH_PrefetchPending(void)
+{
+  DWORD next;
+
+  return (pfCmds > 0) || (USBH_PrefetchNext(&next) != 0);
+}
+
+/**
+  * @brief  Get the cache counters
+  * @param  stats : The counters since the volume was mounted
+  */
+void USBH_CacheGetStats(USBH_CacheStatsTypeDef *stats)
+{
+  *stats = cacheStats;
+}
+
 /* USER CODE END beforeFunctionSection */
 
 /* Private functions ---------------------------------------------------------*/
 
+/**
+  * @brief  Read from the device, again after a failed command
+  * @note   A stick reports a transient error, e.g. an unrecovered read, with
+  *         a failed CSW. The MSC class has cleared the halt and fetched the
+  *         sense data by the time USBH_MSC_Read returns, so the command can
+  *         go out again right away. After a timeout or a disconnect the
+  *         retries fail at once.
+  */
+static USBH_StatusTypeDef USBH_ReadDevice(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  uint32_t start = PROFILE_START();
+  USBH_StatusTypeDef status = USBH_MSC_Read(&hUSB_Host, lun, sector, buff, count);
+  UINT tries = 0;
+
+  PROFILE_STOP(PROF_MSC_READ, start);
+  while((status != USBH_OK) && (tries < USBH_READ_RETRIES) && USBH_MSC_IsReady(&hUSB_Host))
+  {
+    tries++;
+    cacheStats.retries++;
+    start = PROFILE_START();
+    status = USBH_MSC_Read(&hUSB_Host, lun, sector, buff, count);
+    PROFILE_STOP(PROF_MSC_READ, start);
+  }
+  return status;
+}
+
 /**
   * @brief  Initializes a Drive
   * @param  lun : lun id
@@ -72,6 +564,12 @@ const Diskio_drvTypeDef  USBH_Driver =
 DSTATUS USBH_initialize(BYTE lun)
 {
   /* CAUTION : USB Host library has to be initialized in the application */
+  /* A new volume, nothing cached belongs to it */
+  MX_USB_HOST_Lock();
+  USBH_PrefetchDrain();
+  memset(&cacheStats, 0, sizeof(cacheStats));
+  USBH_CacheReset(lun);
+  MX_USB_HOST_Unlock();
 
   return RES_OK;
 }
@@ -85,6 +583,7 @@ DSTATUS USBH_status(BYTE lun)
 {
   DRESULT res = RES_ERROR;
 
+  MX_USB_HOST_Lock();
   if(USBH_MSC_UnitIsReady(&hUSB_Host, lun))
   {
     res = RES_OK;
@@ -93,6 +592,7 @@ DSTATUS USBH_status(BYTE lun)
   {
     res = RES_ERROR;
   }
+  MX_USB_HOST_Unlock();
 
   return res;
 }
@@ -113,11 +613,51 @@ DRESULT USBH_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
 {
   DRESULT res = RES_ERROR;
   MSC_LUNTypeDef info;
+  USBH_CacheSlotTypeDef *slot = NULL;
+  BYTE wanted = USBH_CacheWanted(buff, sector, count);
+  UINT done = 0;
+
+  /* The host process stays off the pipe until this read is done, and the
+     BOT pipe is free again once the read-ahead in flight is in */
+  MX_USB_HOST_Lock();
+  USBH_PrefetchDrain();
+  if(buff != USBHFatFS.win)
+  {
+    done = USBH_PrefetchServe(lun, buff, sector, count);
+  }
+  if(wanted && (done == 0))
+  {
+    slot = USBH_CacheLookup(lun, sector);
+  }
 
-  if(USBH_MSC_Read(&hUSB_Host, lun, sector, buff, count) == USBH_OK)
+  if(done == count)
   {
     res = RES_OK;
   }
+  else if((slot != NULL) && slot->valid)
+  {
+    cacheStats.hits++;
+    memcpy(buff, USBH_CacheData(slot), diskSectorSize);
+    res = RES_OK;
+  }
+  else if(USBH_ReadDevice(lun, buff + (done * diskSectorSize), sector + done,
+                          count - done) == USBH_OK)
+  {
+    if(slot != NULL)
+    {
+      cacheStats.misses++;
+      memcpy(USBH_CacheData(slot), buff, diskSectorSize);
+      slot->sector = sector;
+      slot->lun = lun;
+      slot->lastUse = ++cacheClock;
+      slot->valid = 1;
+    }
+    else
+    {
+      cacheStats.bypassed++;
+    }
+    res = RES_OK;
+  }
   else
   {
     USBH_MSC_GetLUNInfo(&hUSB_Host, lun, &info);
@@ -136,6 +676,7 @@ DRESULT USBH_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
       break;
     }
   }
+  MX_USB_HOST_Unlock();
 
   return res;
 }
@@ -158,8 +699,12 @@ DRESULT USBH_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
   DRESULT res = RES_ERROR;
   MSC_LUNTypeDef info;
 
+  MX_USB_HOST_Lock();
+  USBH_PrefetchDrain();
   if(USBH_MSC_Write(&hUSB_Host, lun, sector, (BYTE *)buff, count) == USBH_OK)
   {
+    USBH_CacheWrite(lun, buff, sector, count);
+    USBH_PrefetchWrite(lun, sector, count);
     res = RES_OK;
   }
   else
@@ -185,6 +730,7 @@ DRESULT USBH_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
       break;
     }
   }
+  MX_USB_HOST_Unlock();
 
   return res;
 }
@@ -207,6 +753,7 @@ DRESULT USBH_ioctl(BYTE lun, BYTE cmd, void *buff)
   DRESULT res = RES_ERROR;
   MSC_LUNTypeDef info;
 
+  MX_USB_HOST_Lock();
   switch (cmd)
   {
   /* Make sure that no pending write process */
@@ -229,9 +776,13 @@ DRESULT USBH_ioctl(BYTE lun, BYTE cmd, void *buff)
 
   /* Get R/W sector size (WORD) */
   case GET_SECTOR_SIZE :
-    if(USBH_MSC_GetLUNInfo(&hUSB_Host, lun, &info) == USBH_OK)
+    /* FatFs keeps the size in a WORD and only handles powers of two from
+       _MIN_SS to _MAX_SS, a device reporting anything else is refused */
+    if((USBH_MSC_GetLUNInfo(&hUSB_Host, lun, &info) == USBH_OK) &&
+       (info.capacity.block_size >= _MIN_SS) && (info.capacity.block_size <= _MAX_SS) &&
+       ((info.capacity.block_size & (info.capacity.block_size - 1)) == 0))
     {
-      *(DWORD*)buff = info.capacity.block_size;
+      *(WORD*)buff = (WORD)info.capacity.block_size;
       res = RES_OK;
     }
     else
@@ -242,21 +793,15 @@ DRESULT USBH_ioctl(BYTE lun, BYTE cmd, void *buff)
 
     /* Get erase block size in unit of sector (DWORD) */
   case GET_BLOCK_SIZE :
-
-    if(USBH_MSC_GetLUNInfo(&hUSB_Host, lun, &info) == USBH_OK)
-    {
-      *(DWORD*)buff = info.capacity.block_size / USB_DEFAULT_BLOCK_SIZE;
-      res = RES_OK;
-    }
-    else
-    {
-      res = RES_ERROR;
-    }
+    /* READ CAPACITY does not report the erase block size: unknown */
+    *(DWORD*)buff = 1;
+    res = RES_OK;
     break;
 
   default:
     res = RES_PARERR;
   }
+  MX_USB_HOST_Unlock();
 
   return res;
 }
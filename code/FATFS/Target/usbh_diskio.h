@@ -34,6 +34,38 @@ extern const Diskio_drvTypeDef  USBH_Driver;
 
 /* USER CODE BEGIN lastSection */
 /* can be used to modify / undefine previous code or add new definitions */
+#ifndef USBH_CACHE_SIZE
+#define USBH_CACHE_SIZE   8192    /* bytes of metadata sector cache, 0 disables it */
+#endif
+#ifndef USBH_PREFETCH_SIZE
+#define USBH_PREFETCH_SIZE  16384 /* bytes read ahead of a stream, 0 disables it */
+#endif
+#ifndef USBH_PREFETCH_CHUNK
+#define USBH_PREFETCH_CHUNK 2048  /* bytes of the first and smallest read-ahead transfer */
+#endif
+#ifndef USBH_PREFETCH_TARGET_US
+#define USBH_PREFETCH_TARGET_US 2000  /* read-ahead command time the size adapts to */
+#endif
+#ifndef USBH_READ_RETRIES
+#define USBH_READ_RETRIES   2     /* times a failed read goes out again */
+#endif
+
+/* Metadata sector cache and read-ahead counters */
+typedef struct
+{
+  uint32_t hits;          /* reads served from the cache */
+  uint32_t misses;        /* cacheable reads that went to the device */
+  uint32_t bypassed;      /* streaming reads that went to the device uncached */
+  uint32_t prefetched;    /* sectors read ahead of a stream */
+  uint32_t prefetchHits;  /* stream sectors served from the read-ahead ring */
+  uint32_t pipelined;     /* read-ahead commands queued behind another one */
+  uint32_t prefetchChunk; /* current read-ahead command size in sectors */
+  uint32_t retries;       /* reads sent again after a failed command */
+} USBH_CacheStatsTypeDef;
+
+void USBH_CacheGetStats(USBH_CacheStatsTypeDef *stats);
+void USBH_PrefetchProcess(void);
+BYTE USBH_PrefetchPending(void);
 /* USER CODE END lastSection */
 
 #endif /* __USBH_DISKIO_H */
@@ -182,6 +182,14 @@ USBH_StatusTypeDef USBH_MSC_GetLUNInfo(USBH_HandleTypeDef *phost, uint8_t lun,
 USBH_StatusTypeDef USBH_MSC_Read(USBH_HandleTypeDef *phost, uint8_t lun,
                                  uint32_t address, uint8_t *pbuf, uint32_t length);
 
+USBH_StatusTypeDef USBH_MSC_ReadStart(USBH_HandleTypeDef *phost, uint8_t lun,
+                                      uint32_t address, uint8_t *pbuf, uint32_t length);
+
+USBH_StatusTypeDef USBH_MSC_ReadQueue(USBH_HandleTypeDef *phost, uint8_t lun,
+                                      uint32_t address, uint8_t *pbuf, uint32_t length);
+
+USBH_StatusTypeDef USBH_MSC_ReadPoll(USBH_HandleTypeDef *phost, uint8_t lun);
+
 USBH_StatusTypeDef USBH_MSC_Write(USBH_HandleTypeDef *phost, uint8_t lun,
                                   uint32_t address, uint8_t *pbuf, uint32_t length);
 /**
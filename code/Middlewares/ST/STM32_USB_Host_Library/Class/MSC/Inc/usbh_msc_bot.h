@@ -133,6 +133,10 @@ typedef struct
   BOT_CSWTypeDef             csw;
   uint8_t                    Reserved2[3];
   uint8_t                    *pbuf;
+  BOT_CBWTypeDef             next_cbw;      /* command sent right after the current CSW */
+  uint8_t                    next_pending;
+  uint8_t                    Reserved3[3];
+  uint8_t                    *next_pbuf;
 }
 BOT_HandleTypeDef;
 
@@ -162,6 +166,12 @@ BOT_HandleTypeDef;
 
 #define BOT_PAGE_LENGTH              512U
 
+/* Max packets received by one data IN transfer, the channel re-arms itself
+   after every packet so the whole transfer needs no polling */
+#ifndef BOT_DATA_IN_MAX_PACKETS
+#define BOT_DATA_IN_MAX_PACKETS      128U
+#endif
+
 
 #define BOT_CBW_CB_LENGTH            16U
 
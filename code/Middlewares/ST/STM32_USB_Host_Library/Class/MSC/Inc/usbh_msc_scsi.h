@@ -186,6 +186,12 @@ USBH_StatusTypeDef USBH_MSC_SCSI_Read(USBH_HandleTypeDef *phost,
                                       uint8_t *pbuf,
                                       uint32_t length);
 
+USBH_StatusTypeDef USBH_MSC_SCSI_QueueRead(USBH_HandleTypeDef *phost,
+                                           uint8_t lun,
+                                           uint32_t address,
+                                           uint8_t *pbuf,
+                                           uint32_t length);
+
 
 /**
   * @}
@@ -572,7 +572,13 @@ static USBH_StatusTypeDef USBH_MSC_RdWrProcess(USBH_HandleTypeDef *phost, uint8_
 
       if (scsi_status == USBH_OK)
       {
-        MSC_Handle->unit[lun].state = MSC_IDLE;
+        /* A queued read went out right after the CSW, the unit stays busy */
+        if (MSC_Handle->hbot.cmd_state != BOT_CMD_WAIT)
+        {
+          MSC_Handle->unit[lun].state = MSC_IDLE;
+        }
+        /* The unit works again after a failed command */
+        MSC_Handle->unit[lun].error = MSC_OK;
         error = USBH_OK;
       }
       else if (scsi_status == USBH_FAIL)
@@ -604,6 +610,7 @@ static USBH_StatusTypeDef USBH_MSC_RdWrProcess(USBH_HandleTypeDef *phost, uint8_
       if (scsi_status == USBH_OK)
       {
         MSC_Handle->unit[lun].state = MSC_IDLE;
+        MSC_Handle->unit[lun].error = MSC_OK;
         error = USBH_OK;
       }
       else if (scsi_status == USBH_FAIL)
@@ -775,6 +782,7 @@ USBH_StatusTypeDef USBH_MSC_Read(USBH_HandleTypeDef *phost,
                                  uint32_t length)
 {
   uint32_t timeout;
+  USBH_StatusTypeDef status;
   MSC_HandleTypeDef *MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
 
   if ((phost->device.is_connected == 0U) ||
@@ -792,7 +800,8 @@ USBH_StatusTypeDef USBH_MSC_Read(USBH_HandleTypeDef *phost,
 
   timeout = phost->Timer;
 
-  while (USBH_MSC_RdWrProcess(phost, lun) == USBH_BUSY)
+  /* A failed command ends after its REQUEST SENSE, report it */
+  while ((status = USBH_MSC_RdWrProcess(phost, lun)) == USBH_BUSY)
   {
     if (((phost->Timer - timeout) > (10000U * length)) || (phost->device.is_connected == 0U))
     {
@@ -802,9 +811,130 @@ USBH_StatusTypeDef USBH_MSC_Read(USBH_HandleTypeDef *phost,
   }
   MSC_Handle->state = MSC_IDLE;
 
+  return status;
+}
+
+/**
+  * @brief  USBH_MSC_ReadStart
+  *         The function starts a Read operation and returns, the read is
+  *         completed by USBH_MSC_ReadPoll
+  * @param  phost: Host handle
+  * @param  lun: logical Unit Number
+  * @param  address: sector address
+  * @param  pbuf: pointer to data
+  * @param  length: number of sector to read
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_MSC_ReadStart(USBH_HandleTypeDef *phost,
+                                      uint8_t lun,
+                                      uint32_t address,
+                                      uint8_t *pbuf,
+                                      uint32_t length)
+{
+  MSC_HandleTypeDef *MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if ((phost->device.is_connected == 0U) ||
+      (phost->gState != HOST_CLASS) ||
+      (MSC_Handle->unit[lun].state != MSC_IDLE))
+  {
+    return  USBH_FAIL;
+  }
+
+  MSC_Handle->state = MSC_READ;
+  MSC_Handle->unit[lun].state = MSC_READ;
+  MSC_Handle->rw_lun = lun;
+  MSC_Handle->timer = phost->Timer;
+
+  (void)USBH_MSC_SCSI_Read(phost, lun, address, pbuf, length);
+
   return USBH_OK;
 }
 
+/**
+  * @brief  USBH_MSC_ReadQueue
+  *         The function queues a Read operation behind the one in flight,
+  *         its CBW is sent as soon as the current CSW is received. Without
+  *         a read in flight the read is started.
+  * @param  phost: Host handle
+  * @param  lun: logical Unit Number
+  * @param  address: sector address
+  * @param  pbuf: pointer to data
+  * @param  length: number of sector to read
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_MSC_ReadQueue(USBH_HandleTypeDef *phost,
+                                      uint8_t lun,
+                                      uint32_t address,
+                                      uint8_t *pbuf,
+                                      uint32_t length)
+{
+  MSC_HandleTypeDef *MSC_Handle;
+
+  /* The host process may have torn the class down since the last call */
+  if (phost->pActiveClass == NULL)
+  {
+    return USBH_FAIL;
+  }
+
+  MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  if (MSC_Handle->unit[lun].state == MSC_IDLE)
+  {
+    return USBH_MSC_ReadStart(phost, lun, address, pbuf, length);
+  }
+
+  if ((phost->device.is_connected == 0U) ||
+      (phost->gState != HOST_CLASS) ||
+      (MSC_Handle->unit[lun].state != MSC_READ))
+  {
+    return  USBH_FAIL;
+  }
+
+  return USBH_MSC_SCSI_QueueRead(phost, lun, address, pbuf, length);
+}
+
+/**
+  * @brief  USBH_MSC_ReadPoll
+  *         The function advances the Read operation in flight
+  * @param  phost: Host handle
+  * @param  lun: logical Unit Number
+  * @retval USBH_BUSY while the read runs, USBH_OK once it is done (a
+  *         queued read is then in flight), USBH_FAIL on error or timeout
+  */
+USBH_StatusTypeDef USBH_MSC_ReadPoll(USBH_HandleTypeDef *phost, uint8_t lun)
+{
+  MSC_HandleTypeDef *MSC_Handle;
+  USBH_StatusTypeDef status;
+
+  /* The host process may have torn the class down since the last call */
+  if (phost->pActiveClass == NULL)
+  {
+    return USBH_FAIL;
+  }
+
+  MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
+  status = USBH_MSC_RdWrProcess(phost, lun);
+
+  if (status == USBH_BUSY)
+  {
+    if (((phost->Timer - MSC_Handle->timer) > 10000U) || (phost->device.is_connected == 0U))
+    {
+      MSC_Handle->hbot.next_pending = 0U;
+      MSC_Handle->state = MSC_IDLE;
+      return USBH_FAIL;
+    }
+    return USBH_BUSY;
+  }
+
+  MSC_Handle->timer = phost->Timer;
+  if (MSC_Handle->unit[lun].state != MSC_READ)
+  {
+    MSC_Handle->state = MSC_IDLE;
+  }
+
+  return status;
+}
+
 /**
   * @brief  USBH_MSC_Write
   *         The function performs a Write operation
@@ -822,6 +952,7 @@ USBH_StatusTypeDef USBH_MSC_Write(USBH_HandleTypeDef *phost,
                                   uint32_t length)
 {
   uint32_t timeout;
+  USBH_StatusTypeDef status;
   MSC_HandleTypeDef *MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
 
   if ((phost->device.is_connected == 0U) ||
@@ -838,7 +969,8 @@ USBH_StatusTypeDef USBH_MSC_Write(USBH_HandleTypeDef *phost,
   (void)USBH_MSC_SCSI_Write(phost, lun, address, pbuf, length);
 
   timeout = phost->Timer;
-  while (USBH_MSC_RdWrProcess(phost, lun) == USBH_BUSY)
+  /* A failed command ends after its REQUEST SENSE, report it */
+  while ((status = USBH_MSC_RdWrProcess(phost, lun)) == USBH_BUSY)
   {
     if (((phost->Timer - timeout) > (10000U * length)) || (phost->device.is_connected == 0U))
     {
@@ -847,7 +979,7 @@ USBH_StatusTypeDef USBH_MSC_Write(USBH_HandleTypeDef *phost,
     }
   }
   MSC_Handle->state = MSC_IDLE;
-  return USBH_OK;
+  return status;
 }
 
 /**
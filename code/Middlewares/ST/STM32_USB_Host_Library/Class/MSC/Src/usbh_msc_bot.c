@@ -27,6 +27,7 @@ EndBSPDependencies */
 /* Includes ------------------------------------------------------------------*/
 #include "usbh_msc_bot.h"
 #include "usbh_msc.h"
+#include "trace.h"
 
 /** @addtogroup USBH_LIB
   * @{
@@ -82,6 +83,7 @@ EndBSPDependencies */
   */
 static USBH_StatusTypeDef USBH_MSC_BOT_Abort(USBH_HandleTypeDef *phost, uint8_t lun, uint8_t dir);
 static BOT_CSWStatusTypeDef USBH_MSC_DecodeCSW(USBH_HandleTypeDef *phost);
+static uint32_t USBH_MSC_BOT_InLength(MSC_HandleTypeDef *MSC_Handle);
 /**
   * @}
   */
@@ -156,10 +158,35 @@ USBH_StatusTypeDef USBH_MSC_BOT_Init(USBH_HandleTypeDef *phost)
   MSC_Handle->hbot.cbw.field.Tag = BOT_CBW_TAG;
   MSC_Handle->hbot.state = BOT_SEND_CBW;
   MSC_Handle->hbot.cmd_state = BOT_CMD_SEND;
+  MSC_Handle->hbot.next_pending = 0U;
 
   return USBH_OK;
 }
 
+/**
+  * @brief  USBH_MSC_BOT_InLength
+  *         The length of the next data IN transfer: the rest of the data
+  *         stage, up to BOT_DATA_IN_MAX_PACKETS packets.
+  * @param  MSC_Handle: MSC handle
+  * @retval Length in bytes
+  */
+static uint32_t USBH_MSC_BOT_InLength(MSC_HandleTypeDef *MSC_Handle)
+{
+  uint32_t max_len = (uint32_t)MSC_Handle->InEpSize * BOT_DATA_IN_MAX_PACKETS;
+
+  /* The transfer length of a pipe is 16 bits */
+  if (max_len > (0x10000U - MSC_Handle->InEpSize))
+  {
+    max_len = 0x10000U - MSC_Handle->InEpSize;
+  }
+
+  if (MSC_Handle->hbot.cbw.field.DataTransferLength < max_len)
+  {
+    return MSC_Handle->hbot.cbw.field.DataTransferLength;
+  }
+  return max_len;
+}
+
 
 
 /**
@@ -176,7 +203,10 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
   BOT_CSWStatusTypeDef CSW_Status = BOT_CSW_CMD_FAILED;
   USBH_URBStateTypeDef URB_Status = USBH_URB_IDLE;
   MSC_HandleTypeDef *MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
+  BOT_StateTypeDef entry_state = MSC_Handle->hbot.state;
   uint8_t toggle = 0U;
+  uint32_t in_len;
+  uint32_t xfer_len;
 
   switch (MSC_Handle->hbot.state)
   {
@@ -257,9 +287,10 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
       break;
 
     case BOT_DATA_IN:
-      /* Send first packet */
+      /* Receive as many packets as the channel takes in one transfer */
       (void)USBH_BulkReceiveData(phost, MSC_Handle->hbot.pbuf,
-                                 MSC_Handle->InEpSize, MSC_Handle->InPipe);
+                                 (uint16_t)USBH_MSC_BOT_InLength(MSC_Handle),
+                                 MSC_Handle->InPipe);
 
       MSC_Handle->hbot.state = BOT_DATA_IN_WAIT;
 
@@ -271,11 +302,13 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
 
       if (URB_Status == USBH_URB_DONE)
       {
-        /* Adjust Data pointer and data length */
-        if (MSC_Handle->hbot.cbw.field.DataTransferLength > MSC_Handle->InEpSize)
+        /* Adjust Data pointer and data length, a short packet ends the data stage */
+        in_len = USBH_MSC_BOT_InLength(MSC_Handle);
+        xfer_len = USBH_LL_GetLastXferSize(phost, MSC_Handle->InPipe);
+        if ((xfer_len == in_len) && (MSC_Handle->hbot.cbw.field.DataTransferLength > in_len))
         {
-          MSC_Handle->hbot.pbuf += MSC_Handle->InEpSize;
-          MSC_Handle->hbot.cbw.field.DataTransferLength -= MSC_Handle->InEpSize;
+          MSC_Handle->hbot.pbuf += in_len;
+          MSC_Handle->hbot.cbw.field.DataTransferLength -= in_len;
         }
         else
         {
@@ -285,9 +318,10 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
         /* More Data To be Received */
         if (MSC_Handle->hbot.cbw.field.DataTransferLength > 0U)
         {
-          /* Send next packet */
+          /* Receive the next packets */
           (void)USBH_BulkReceiveData(phost, MSC_Handle->hbot.pbuf,
-                                     MSC_Handle->InEpSize, MSC_Handle->InPipe);
+                                     (uint16_t)USBH_MSC_BOT_InLength(MSC_Handle),
+                                     MSC_Handle->InPipe);
         }
         else
         {
@@ -444,6 +478,26 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
           status = USBH_FAIL;
         }
 
+        /* The device takes a new CBW as soon as its CSW is in: send the
+           queued command right away, the caller sees this one completed
+           while the next one is already on the bus */
+        if ((status == USBH_OK) && (MSC_Handle->hbot.next_pending != 0U))
+        {
+          (void)USBH_memcpy(&MSC_Handle->hbot.cbw, &MSC_Handle->hbot.next_cbw,
+                            sizeof(BOT_CBWTypeDef));
+          MSC_Handle->hbot.pbuf = MSC_Handle->hbot.next_pbuf;
+          MSC_Handle->hbot.next_pending = 0U;
+          MSC_Handle->hbot.cbw.field.LUN = lun;
+          MSC_Handle->hbot.cmd_state = BOT_CMD_WAIT;
+          MSC_Handle->hbot.state = BOT_SEND_CBW_WAIT;
+          (void)USBH_BulkSendData(phost, MSC_Handle->hbot.cbw.data,
+                                  BOT_CBW_LENGTH, MSC_Handle->OutPipe, 1U);
+        }
+        else
+        {
+          MSC_Handle->hbot.next_pending = 0U;
+        }
+
 #if (USBH_USE_OS == 1U)
         phost->os_msg = (uint32_t)USBH_URB_EVENT;
 #if (osCMSIS < 0x20000U)
@@ -510,6 +564,7 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
 
 
     case BOT_UNRECOVERED_ERROR:
+      MSC_Handle->hbot.next_pending = 0U;
       status = USBH_MSC_BOT_REQ_Reset(phost);
       if (status == USBH_OK)
       {
@@ -520,6 +575,10 @@ USBH_StatusTypeDef USBH_MSC_BOT_Process(USBH_HandleTypeDef *phost, uint8_t lun)
     default:
       break;
   }
+  if (MSC_Handle->hbot.state != entry_state)
+  {
+    TRACE(TRACE_EV_BOT, MSC_Handle->hbot.state, MSC_Handle->hbot.cbw.field.CB[0]);
+  }
   return status;
 }
 
@@ -74,6 +74,10 @@ EndBSPDependencies */
 /** @defgroup USBH_MSC_SCSI_Private_FunctionPrototypes
   * @{
   */
+static void USBH_MSC_SCSI_FillRead10(MSC_HandleTypeDef *MSC_Handle,
+                                     BOT_CBWTypeDef *cbw,
+                                     uint32_t address,
+                                     uint32_t length);
 /**
   * @}
   */
@@ -379,6 +383,39 @@ USBH_StatusTypeDef USBH_MSC_SCSI_Write(USBH_HandleTypeDef *phost,
   return error;
 }
 
+/**
+  * @brief  USBH_MSC_SCSI_FillRead10
+  *         Prepare the CBW of a READ10 command.
+  * @param  MSC_Handle: MSC handle
+  * @param  cbw: CBW to fill
+  * @param  address: sector address
+  * @param  length: number of sector to read
+  * @retval None
+  */
+static void USBH_MSC_SCSI_FillRead10(MSC_HandleTypeDef *MSC_Handle,
+                                     BOT_CBWTypeDef *cbw,
+                                     uint32_t address,
+                                     uint32_t length)
+{
+  cbw->field.DataTransferLength = length * MSC_Handle->unit[0].capacity.block_size;
+  cbw->field.Flags = USB_EP_DIR_IN;
+  cbw->field.CBLength = CBW_LENGTH;
+
+  (void)USBH_memset(cbw->field.CB, 0, CBW_CB_LENGTH);
+  cbw->field.CB[0]  = OPCODE_READ10;
+
+  /*logical block address*/
+  cbw->field.CB[2]  = (((uint8_t *)(void *)&address)[3]);
+  cbw->field.CB[3]  = (((uint8_t *)(void *)&address)[2]);
+  cbw->field.CB[4]  = (((uint8_t *)(void *)&address)[1]);
+  cbw->field.CB[5]  = (((uint8_t *)(void *)&address)[0]);
+
+
+  /*Transfer length */
+  cbw->field.CB[7]  = (((uint8_t *)(void *)&length)[1]) ;
+  cbw->field.CB[8]  = (((uint8_t *)(void *)&length)[0]) ;
+}
+
 /**
   * @brief  USBH_MSC_SCSI_Read
   *         Issue Read10 command.
@@ -403,24 +440,7 @@ USBH_StatusTypeDef USBH_MSC_SCSI_Read(USBH_HandleTypeDef *phost,
     case BOT_CMD_SEND:
 
       /*Prepare the CBW and relevant field*/
-      MSC_Handle->hbot.cbw.field.DataTransferLength = length * MSC_Handle->unit[0].capacity.block_size;
-      MSC_Handle->hbot.cbw.field.Flags = USB_EP_DIR_IN;
-      MSC_Handle->hbot.cbw.field.CBLength = CBW_LENGTH;
-
-      (void)USBH_memset(MSC_Handle->hbot.cbw.field.CB, 0, CBW_CB_LENGTH);
-      MSC_Handle->hbot.cbw.field.CB[0]  = OPCODE_READ10;
-
-      /*logical block address*/
-      MSC_Handle->hbot.cbw.field.CB[2]  = (((uint8_t *)(void *)&address)[3]);
-      MSC_Handle->hbot.cbw.field.CB[3]  = (((uint8_t *)(void *)&address)[2]);
-      MSC_Handle->hbot.cbw.field.CB[4]  = (((uint8_t *)(void *)&address)[1]);
-      MSC_Handle->hbot.cbw.field.CB[5]  = (((uint8_t *)(void *)&address)[0]);
-
-
-      /*Transfer length */
-      MSC_Handle->hbot.cbw.field.CB[7]  = (((uint8_t *)(void *)&length)[1]) ;
-      MSC_Handle->hbot.cbw.field.CB[8]  = (((uint8_t *)(void *)&length)[0]) ;
-
+      USBH_MSC_SCSI_FillRead10(MSC_Handle, &MSC_Handle->hbot.cbw, address, length);
 
       MSC_Handle->hbot.state = BOT_SEND_CBW;
       MSC_Handle->hbot.cmd_state = BOT_CMD_WAIT;
@@ -439,6 +459,42 @@ USBH_StatusTypeDef USBH_MSC_SCSI_Read(USBH_HandleTypeDef *phost,
   return error;
 }
 
+/**
+  * @brief  USBH_MSC_SCSI_QueueRead
+  *         Prepare a READ10 that the BOT sends as soon as the CSW of the
+  *         command in flight is received.
+  * @param  phost: Host handle
+  * @param  lun: Logical unit number
+  * @param  address: sector address
+  * @param  pbuf: pointer to data
+  * @param  length: number of sector to read
+  * @retval USBH Status
+  */
+USBH_StatusTypeDef USBH_MSC_SCSI_QueueRead(USBH_HandleTypeDef *phost,
+                                           uint8_t lun,
+                                           uint32_t address,
+                                           uint8_t *pbuf,
+                                           uint32_t length)
+{
+  MSC_HandleTypeDef *MSC_Handle = (MSC_HandleTypeDef *) phost->pActiveClass->pData;
+
+  /* Prevent unused argument(s) compilation warning */
+  UNUSED(lun);
+
+  if ((MSC_Handle->hbot.cmd_state != BOT_CMD_WAIT) || (MSC_Handle->hbot.next_pending != 0U))
+  {
+    return USBH_FAIL;
+  }
+
+  /* Signature and tag are the ones of the current CBW */
+  (void)USBH_memcpy(&MSC_Handle->hbot.next_cbw, &MSC_Handle->hbot.cbw, sizeof(BOT_CBWTypeDef));
+  USBH_MSC_SCSI_FillRead10(MSC_Handle, &MSC_Handle->hbot.next_cbw, address, length);
+  MSC_Handle->hbot.next_pbuf = pbuf;
+  MSC_Handle->hbot.next_pending = 1U;
+
+  return USBH_OK;
+}
+
 
 /**
   * @}
@@ -1337,7 +1337,13 @@ static void USBH_Process_OS(void const *argument)
     event = osMessageGet(((USBH_HandleTypeDef *)argument)->os_event, osWaitForever);
     if (event.status == osEventMessage)
     {
+#ifdef USBH_OS_LOCK
+      USBH_OS_LOCK();
       USBH_Process((USBH_HandleTypeDef *)argument);
+      USBH_OS_UNLOCK();
+#else
+      USBH_Process((USBH_HandleTypeDef *)argument);
+#endif
     }
   }
 }
@@ -1352,7 +1358,13 @@ static void USBH_Process_OS(void *argument)
                                &((USBH_HandleTypeDef *)argument)->os_msg, NULL, osWaitForever);
     if (status == osOK)
     {
+#ifdef USBH_OS_LOCK
+      USBH_OS_LOCK();
       USBH_Process((USBH_HandleTypeDef *)argument);
+      USBH_OS_UNLOCK();
+#else
+      USBH_Process((USBH_HandleTypeDef *)argument);
+#endif
     }
   }
 }
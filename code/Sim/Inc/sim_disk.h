@@ -0,0 +1,104 @@
+/*
+ * sim_disk.h
+ *
+ * @description: The header file of the disk of the host simulation build.
+ * It is a FatFs disk driver like USBH_Driver that serves its sectors from
+ * RAM or from a FAT image file on the host. Its reads and writes take
+ * simulated time, during which the simulated interrupts keep coming.
+ *
+ * The time of a command comes from one of the latency models: a fixed
+ * command time plus the transfer time at a given throughput, the same
+ * with a random jitter on top, or the command times of a trace recorded
+ * on a real stick. Stalls, the long pauses of a stick that is busy with
+ * itself, can be added to any model.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef _SIM_DISK_H_
+#define _SIM_DISK_H_
+
+#include "ff_gen_drv.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define SIM_DISK_CMD_US			500		/* default command time of a USB stick */
+#define SIM_DISK_KBPS			900		/* default throughput in kB/s */
+#define SIM_DISK_HIST_BINS		10		/* command time histogram */
+#define SIM_DISK_HIST_BASE_US	250		/* bin i: below SIM_DISK_HIST_BASE_US << i */
+
+/***************************************
+* Public Type Definition
+****************************************/
+// Counters since the disk was created
+typedef struct
+{
+	uint32_t reads;			/* read commands */
+	uint32_t writes;		/* write commands */
+	uint32_t sectorsRead;
+	uint32_t sectorsWritten;
+	uint32_t seqReads;		/* reads starting where the previous read ended */
+	uint32_t rereadSectors;	/* sectors read before, hits of an ideal cache */
+	uint32_t stalls;
+	uint64_t busyNs;		/* time spent in commands */
+	uint64_t maxCmdNs;		/* longest command */
+	uint32_t hist[SIM_DISK_HIST_BINS];	/* commands by time, the last bin takes the rest */
+}simDisk_stats_t;
+
+/***************************************
+* Public Variable Declaration
+****************************************/
+extern const Diskio_drvTypeDef SimDisk_Driver;
+
+/***************************************
+* Public function declaration
+****************************************/
+// allocate an empty disk in RAM, the sector size is 512 to 4096 bytes
+bool simDisk_create(uint32_t sectors, uint16_t sectorSize);
+
+// serve the sectors of an image file, writes stay in RAM and never reach the file
+bool simDisk_open(const char *path, uint16_t sectorSize);
+
+// store the disk as an image file
+bool simDisk_save(const char *path);
+
+// the number of sectors and the sector size
+uint32_t simDisk_sectors(void);
+uint16_t simDisk_sectorSize(void);
+
+// account for a command, its time by the latency model in ns, no time passes
+uint64_t simDisk_access(bool write, DWORD sector, UINT count);
+
+// the transfer time of some bytes at the throughput
+uint64_t simDisk_transferNs(uint32_t bytes);
+
+// copy sectors out of or into the disk, no time passes
+bool simDisk_readRaw(DWORD sector, UINT count, BYTE *buff);
+bool simDisk_writeRaw(DWORD sector, UINT count, const BYTE *buff);
+
+// set the command time and the throughput, 0 and 0 for a disk without delay
+void simDisk_setTiming(uint32_t cmdUs, uint32_t kBps);
+
+// add a random time of 0 to jitterUs to every command
+void simDisk_setJitter(uint32_t jitterUs, uint32_t seed);
+
+// stall for stallUs once in everyCmds commands on average, 0 for no stalls
+void simDisk_setStalls(uint32_t everyCmds, uint32_t stallUs);
+
+// replay the command times of a trace instead of the fixed command time
+bool simDisk_loadTrace(const char *path);
+
+// the counters since the disk was created or the counters were cleared
+void simDisk_getStats(simDisk_stats_t *stats);
+
+// clear the counters
+void simDisk_clearStats(void);
+
+#endif /* _SIM_DISK_H_ */
@@ -0,0 +1,139 @@
+/*
+ * sim_hal.h
+ *
+ * @description: The control interface of the simulated board behind the
+ * HAL mock. The simulator keeps a clock in nanoseconds that only moves
+ * when the firmware waits or polls (HAL_Delay, HAL_GetTick, the TIM1 and
+ * DWT counters) or when the scenario lets time pass. On the way, the
+ * interrupts that fall due are taken in order by calling the handlers of
+ * stm32f4xx_it.h, unless the firmware masked them. A PendSV requested
+ * through SCB->ICSR is taken when no other handler runs, and __WFI()
+ * lets the time pass up to the next interrupt.
+ *
+ * The I2S DMA consumes the audio ring at the sample rate of the I2S init
+ * and raises the half and full transfer interrupts, I2C transactions take
+ * their bus time at 100 kHz and talk to a CS43L22 register model. Every
+ * I2C transaction, GPIO write and DMA interrupt is reported to an
+ * optional observer, and the audio the I2S reads to an optional tap.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef _SIM_HAL_H_
+#define _SIM_HAL_H_
+
+#include "stm32f4xx_hal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define SIM_NEVER				UINT64_MAX
+#define SIM_NS_PER_US			1000ULL
+#define SIM_NS_PER_MS			1000000ULL
+#define SIM_NS_PER_S			1000000000ULL
+#define SIM_CORE_CLOCK			168000000U	/* SYSCLK of the board */
+#define SIM_POLL_NS				100			/* CPU time of one register poll */
+#define SIM_I2C_BIT_NS			10000		/* 100 kHz bus */
+#define SIM_CODEC_ADDR			0x94		/* CS43L22, 8-bit address */
+#define SIM_RECORD_DATA			16			/* bytes of a transaction kept in a record */
+
+/***************************************
+* Public Type Definition
+****************************************/
+// The simulated interrupt lines, at the same time and priority taken in this order
+typedef enum
+{
+	SIM_IRQ_SYSTICK = 0,
+	SIM_IRQ_DMA1_STREAM5,
+	SIM_IRQ_I2C1_EV,
+	SIM_IRQ_OTG_FS,
+	SIM_IRQ_NUM
+}simHal_irq_t;
+
+typedef enum
+{
+	SIM_REC_I2C_WRITE = 0,	/* addr, data: MAP and register values */
+	SIM_REC_I2C_READ,		/* addr, data: register values read */
+	SIM_REC_GPIO,			/* port (0: GPIOA), pin mask and state */
+	SIM_REC_DMA_HALF,		/* first half of the ring played */
+	SIM_REC_DMA_FULL,		/* second half of the ring played */
+}simHal_recordType_t;
+
+// One observed bus transaction or interrupt
+typedef struct
+{
+	uint64_t timeNs;
+	simHal_recordType_t type;
+	uint8_t  addr;		/* I2C device address or GPIO port index */
+	uint8_t  status;	/* I2C: 0 on ACK, 1 on NACK, GPIO: pin state */
+	uint16_t pin;
+	uint8_t  len;		/* I2C bytes, may exceed SIM_RECORD_DATA */
+	uint8_t  data[SIM_RECORD_DATA];
+}simHal_record_t;
+
+typedef void (*simHal_observer_t)(const simHal_record_t *rec);
+
+// The audio the I2S reads, DMA items in the order they are played
+typedef void (*simHal_tap_t)(const int16_t *items, uint32_t count);
+
+// Counters since simHal_reset()
+typedef struct
+{
+	uint32_t i2cWrites;
+	uint32_t i2cReads;
+	uint32_t i2cBytes;
+	uint32_t i2cNacks;
+	uint64_t i2cBusyNs;		/* bus time of all transactions */
+	uint32_t gpioWrites;
+	uint32_t dmaEvents;		/* half and full transfer interrupts */
+	uint32_t irqDeferred;	/* interrupts taken late because they were masked */
+	uint64_t irqMaxLatencyNs[SIM_IRQ_NUM];	/* longest wait from raise to handler entry */
+	uint32_t pendSvRuns;
+	uint64_t pendSvNs;		/* time in PendSV, including the handlers preempting it */
+	uint32_t sleeps;		/* WFI that waited for an interrupt */
+	uint64_t sleepNs;
+}simHal_stats_t;
+
+/***************************************
+* Public function declaration
+****************************************/
+// bring the board to its reset state, time starts at 0
+void simHal_reset(void);
+
+// the simulated time in nanoseconds
+uint64_t simHal_now(void);
+
+// let time pass, taking the interrupts that fall due
+void simHal_advance(uint64_t ns);
+
+// raise an interrupt at a point in time, SIM_NEVER cancels it
+void simHal_schedule(simHal_irq_t irq, uint64_t atNs);
+
+// report every transaction and DMA interrupt to an observer, NULL for none
+void simHal_setObserver(simHal_observer_t observer);
+
+// pass every item the I2S reads to a tap, NULL for none
+void simHal_setTap(simHal_tap_t tap);
+
+// pass a record to the observer
+void simHal_record(const simHal_record_t *rec);
+
+// the counters since the reset
+void simHal_getStats(simHal_stats_t *stats);
+
+// the time the I2S DMA reaches the next half of the ring, SIM_NEVER if stopped
+uint64_t simHal_dmaNextEvent(void);
+
+// a register of the CS43L22 model
+uint8_t simHal_codecRegister(uint8_t reg);
+
+// drive an input pin, e.g. a push button
+void simHal_setInput(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+
+#endif /* _SIM_HAL_H_ */
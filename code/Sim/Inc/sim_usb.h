@@ -0,0 +1,96 @@
+/*
+ * sim_usb.h
+ *
+ * @description: The header file of the simulated USB host port of the
+ * host simulation build. It stands in for the USBH_LL_* functions of
+ * usbh_conf.c and the OTG_FS controller behind them, with a USB mass
+ * storage stick (Bulk-Only Transport, SCSI transparent command set) on
+ * the port. The stick serves the sectors of the simulated disk, its media
+ * time follows the latency model of sim_disk.
+ *
+ * The real USB host library, MSC class and usbh_diskio run on top of it:
+ * transfers take full speed packet time on the bus, URB completions and
+ * SOFs come in through the OTG_FS interrupt, which kicks PendSV as the
+ * HCD callbacks of usbh_conf.c do. NAK bursts, STALLed data stages with
+ * their sense codes and a NOT READY phase after attach can be injected,
+ * all drawn from a seeded random sequence so a run is repeatable.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef _SIM_USB_H_
+#define _SIM_USB_H_
+
+#include "sim_hal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/***************************************
+* Public Macro Definition
+****************************************/
+#define SIM_USB_BYTE_NS			667		/* 12 Mbit/s full speed */
+#define SIM_USB_PKT_OVERHEAD	12		/* token, PID, CRC, handshake and gaps in bytes */
+#define SIM_USB_NAK_NS			10000	/* spacing of the IN tokens the HCD retries on NAK */
+#define SIM_USB_FIFO_NS			1200	/* CPU time of the OTG interrupt per packet */
+#define SIM_USB_SCSI_NS			50000	/* device time of a command without media access */
+#define SIM_USB_RESET_NS		(12 * SIM_NS_PER_MS)	/* port reset until enabled */
+#define SIM_USB_ATTACH_NS		(5 * SIM_NS_PER_MS)		/* connect debounce */
+
+/***************************************
+* Public Type Definition
+****************************************/
+// Faults of the simulated stick
+typedef struct
+{
+	uint32_t nakPerMille;	/* bulk transfers hitting a NAK burst, per mille */
+	uint32_t nakBurstUs;	/* time the stick NAKs during a burst */
+	uint32_t errorEvery;	/* one READ10 in this many fails with MEDIUM ERROR on average, 0: never */
+	uint32_t notReadyTurs;	/* TEST UNIT READY commands failed with UNIT ATTENTION after attach */
+	uint32_t seed;			/* seed of the random sequence, 0 is taken as 1 */
+}simUsb_config_t;
+
+// Counters since the last simUsb_configure() or simUsb_clearStats()
+typedef struct
+{
+	uint32_t urbs;
+	uint32_t packets;		/* data packets on the bus */
+	uint32_t naks;			/* NAKed IN tokens and OUT packets */
+	uint32_t stalls;		/* URBs ended by a STALL */
+	uint32_t sofs;
+	uint32_t ctrlRequests;
+	uint32_t cbws;
+	uint32_t read10;
+	uint32_t write10;
+	uint32_t failedCmds;	/* CSWs with command failed */
+	uint32_t clearHalts;
+	uint32_t botResets;
+	uint64_t busNs;			/* bus time of all packets */
+	uint64_t irqNs;			/* CPU time of the OTG interrupt */
+	uint32_t gaps;			/* CSW to next CBW gaps measured */
+	uint64_t gapNs;			/* sum of the gaps, what command pipelining hides */
+	uint64_t maxGapNs;
+}simUsb_stats_t;
+
+/***************************************
+* Public function declaration
+****************************************/
+// set the faults and clear the counters
+void simUsb_configure(const simUsb_config_t *cfg);
+
+// plug the stick in, the host sees it once its port is started
+void simUsb_attach(void);
+
+// the OTG_FS interrupt: port events, SOF and URB completions
+void simUsb_IRQHandler(void);
+
+// the counters since the last simUsb_configure() or simUsb_clearStats()
+void simUsb_getStats(simUsb_stats_t *stats);
+
+// clear the counters, the next gap is measured from the next CSW on
+void simUsb_clearStats(void);
+
+#endif /* _SIM_USB_H_ */
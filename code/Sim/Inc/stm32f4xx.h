@@ -0,0 +1,20 @@
+/*
+ * stm32f4xx.h
+ *
+ * @description: The device header of the host simulation build. The
+ * register blocks of the simulated board are declared together with the
+ * HAL mock, see stm32f4xx_hal.h.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#include "stm32f4xx_hal.h"
+
+#endif /* __STM32F4xx_H */
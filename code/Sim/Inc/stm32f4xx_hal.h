@@ -0,0 +1,492 @@
+/*
+ * stm32f4xx_hal.h
+ *
+ * @description: The mock of the STM32F4 HAL for the host simulation
+ * build. It declares the subset of the HAL types, macros and functions
+ * that the player pipeline uses, with the same names and layouts as the
+ * ST headers, so the firmware sources compile unchanged on the host.
+ *
+ * The peripheral registers the firmware reads directly (the DMA item
+ * counter, the TIM1 counter, the DWT cycle counter and the I2C busy flag)
+ * are routed to the simulator, so they follow the simulated time. The
+ * interrupt mask of the CMSIS intrinsics defers simulated interrupts.
+ *
+ * @reference:
+ * 1.ST open-source HAL drivers
+ * 2.ARM CMSIS Cortex-M4 core peripheral access layer
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#ifndef __STM32F4xx_HAL_H
+#define __STM32F4xx_HAL_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************
+* CMSIS and HAL definitions
+****************************************/
+#define __I     volatile const
+#define __O     volatile
+#define __IO    volatile
+#define __IM    volatile const
+#define __OM    volatile
+#define __IOM   volatile
+
+#ifndef __weak
+#define __weak  __attribute__((weak))
+#endif
+#ifndef __packed
+#define __packed  __attribute__((__packed__))
+#endif
+#define UNUSED(X) (void)X
+
+typedef enum
+{
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+  HAL_UNLOCKED = 0x00U,
+  HAL_LOCKED   = 0x01U
+} HAL_LockTypeDef;
+
+typedef enum
+{
+  RESET = 0U,
+  SET = !RESET
+} FlagStatus, ITStatus;
+
+typedef enum
+{
+  DISABLE = 0U,
+  ENABLE = !DISABLE
+} FunctionalState;
+
+#define HAL_MAX_DELAY      0xFFFFFFFFU
+#define TICK_INT_PRIORITY  7U    /* as in stm32f4xx_hal_conf.h */
+
+#define __HAL_LOCK(__HANDLE__)    ((__HANDLE__)->Lock = HAL_LOCKED)
+#define __HAL_UNLOCK(__HANDLE__)  ((__HANDLE__)->Lock = HAL_UNLOCKED)
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__)               \
+                        do{                                                      \
+                              (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__); \
+                              (__DMA_HANDLE__).Parent = (__HANDLE__);             \
+                          } while(0U)
+
+/***************************************
+* Peripheral register blocks
+****************************************/
+typedef struct
+{
+  __IO uint32_t MODER;
+  __IO uint32_t OTYPER;
+  __IO uint32_t OSPEEDR;
+  __IO uint32_t PUPDR;
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+  __IO uint32_t BSRR;
+  __IO uint32_t LCKR;
+  __IO uint32_t AFR[2];
+} GPIO_TypeDef;
+
+typedef struct
+{
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t SR;
+  __IO uint32_t DR;
+  __IO uint32_t CRCPR;
+  __IO uint32_t RXCRCR;
+  __IO uint32_t TXCRCR;
+  __IO uint32_t I2SCFGR;
+  __IO uint32_t I2SPR;
+} SPI_TypeDef;
+
+typedef struct
+{
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t OAR1;
+  __IO uint32_t OAR2;
+  __IO uint32_t DR;
+  __IO uint32_t SR1;
+  __IO uint32_t SR2;
+  __IO uint32_t CCR;
+  __IO uint32_t TRISE;
+  __IO uint32_t FLTR;
+} I2C_TypeDef;
+
+typedef struct
+{
+  __IO uint32_t CR;
+  __IO uint32_t NDTR;
+  __IO uint32_t PAR;
+  __IO uint32_t M0AR;
+  __IO uint32_t M1AR;
+  __IO uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct
+{
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t SMCR;
+  __IO uint32_t DIER;
+  __IO uint32_t SR;
+  __IO uint32_t EGR;
+  __IO uint32_t CCMR1;
+  __IO uint32_t CCMR2;
+  __IO uint32_t CCER;
+  __IO uint32_t CNT;
+  __IO uint32_t PSC;
+  __IO uint32_t ARR;
+} TIM_TypeDef;
+
+typedef struct
+{
+  __IOM uint32_t CTRL;
+  __IOM uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  __OM  union
+  {
+    __OM  uint8_t  u8;
+    __OM  uint16_t u16;
+    __OM  uint32_t u32;
+  } PORT[32U];
+  __IOM uint32_t TER;
+  __IOM uint32_t TCR;
+} ITM_Type;
+
+typedef struct
+{
+  __IOM uint32_t DHCSR;
+  __OM  uint32_t DCRSR;
+  __IOM uint32_t DCRDR;
+  __IOM uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct
+{
+  __IM  uint32_t CPUID;
+  __IOM uint32_t ICSR;
+  __IOM uint32_t VTOR;
+  __IOM uint32_t AIRCR;
+  __IOM uint32_t SCR;
+  __IOM uint32_t CCR;
+} SCB_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk            (1UL)
+#define ITM_TCR_ITMENA_Msk                (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk        (1UL << 24U)
+#define SCB_ICSR_PENDSVSET_Msk            (1UL << 28U)
+#define SPI_I2SCFGR_I2SE                  (1UL << 10U)
+
+/* The peripherals of the simulated board, see sim_hal.c */
+extern GPIO_TypeDef simGpio[5];
+extern SPI_TypeDef simSpi3;
+extern I2C_TypeDef simI2c1;
+extern DMA_Stream_TypeDef simDma1Stream5;
+extern TIM_TypeDef simTim1;
+extern SCB_Type simScb;
+extern CoreDebug_Type simCoreDebug;
+extern ITM_Type simItm;
+DWT_Type *simHal_dwt(void);
+
+#define GPIOA               (&simGpio[0])
+#define GPIOB               (&simGpio[1])
+#define GPIOC               (&simGpio[2])
+#define GPIOD               (&simGpio[3])
+#define GPIOE               (&simGpio[4])
+#define SPI3                (&simSpi3)
+#define I2C1                (&simI2c1)
+#define DMA1_Stream5        (&simDma1Stream5)
+#define TIM1                (&simTim1)
+#define SCB                 (&simScb)
+#define CoreDebug           (&simCoreDebug)
+#define ITM                 (&simItm)
+#define DWT                 (simHal_dwt())
+
+extern uint32_t SystemCoreClock;
+
+/***************************************
+* Core intrinsics
+****************************************/
+uint32_t simHal_getPrimask(void);
+void simHal_setPrimask(uint32_t primask);
+void simHal_waitForInterrupt(void);
+
+static inline uint32_t __get_PRIMASK(void)
+{
+  return simHal_getPrimask();
+}
+
+static inline void __set_PRIMASK(uint32_t priMask)
+{
+  simHal_setPrimask(priMask);
+}
+
+static inline void __disable_irq(void)
+{
+  simHal_setPrimask(1U);
+}
+
+static inline void __enable_irq(void)
+{
+  simHal_setPrimask(0U);
+}
+
+static inline uint8_t __CLZ(uint32_t value)
+{
+  return (value == 0U) ? 32U : (uint8_t)__builtin_clz(value);
+}
+
+static inline void __WFI(void)
+{
+  simHal_waitForInterrupt();
+}
+
+#define __NOP()             do {} while (0)
+#define __DSB()             do {} while (0)
+#define __ISB()             do {} while (0)
+
+/***************************************
+* GPIO
+****************************************/
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_0                 ((uint16_t)0x0001)
+#define GPIO_PIN_1                 ((uint16_t)0x0002)
+#define GPIO_PIN_2                 ((uint16_t)0x0004)
+#define GPIO_PIN_3                 ((uint16_t)0x0008)
+#define GPIO_PIN_4                 ((uint16_t)0x0010)
+#define GPIO_PIN_5                 ((uint16_t)0x0020)
+#define GPIO_PIN_6                 ((uint16_t)0x0040)
+#define GPIO_PIN_7                 ((uint16_t)0x0080)
+#define GPIO_PIN_8                 ((uint16_t)0x0100)
+#define GPIO_PIN_9                 ((uint16_t)0x0200)
+#define GPIO_PIN_10                ((uint16_t)0x0400)
+#define GPIO_PIN_11                ((uint16_t)0x0800)
+#define GPIO_PIN_12                ((uint16_t)0x1000)
+#define GPIO_PIN_13                ((uint16_t)0x2000)
+#define GPIO_PIN_14                ((uint16_t)0x4000)
+#define GPIO_PIN_15                ((uint16_t)0x8000)
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+/***************************************
+* DMA
+****************************************/
+typedef struct __DMA_HandleTypeDef
+{
+  DMA_Stream_TypeDef *Instance;
+  HAL_LockTypeDef    Lock;
+  void               *Parent;
+} DMA_HandleTypeDef;
+
+#define __HAL_DMA_GET_COUNTER(__HANDLE__) (simHal_dmaCounter(__HANDLE__))
+
+uint32_t simHal_dmaCounter(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+/***************************************
+* I2S
+****************************************/
+typedef struct
+{
+  uint32_t Mode;
+  uint32_t Standard;
+  uint32_t DataFormat;
+  uint32_t MCLKOutput;
+  uint32_t AudioFreq;
+  uint32_t CPOL;
+  uint32_t ClockSource;
+  uint32_t FullDuplexMode;
+} I2S_InitTypeDef;
+
+typedef enum
+{
+  HAL_I2S_STATE_RESET      = 0x00U,
+  HAL_I2S_STATE_READY      = 0x01U,
+  HAL_I2S_STATE_BUSY       = 0x02U,
+  HAL_I2S_STATE_BUSY_TX    = 0x03U,
+  HAL_I2S_STATE_ERROR      = 0x07U
+} HAL_I2S_StateTypeDef;
+
+typedef struct __I2S_HandleTypeDef
+{
+  SPI_TypeDef                *Instance;
+  I2S_InitTypeDef            Init;
+  uint16_t                   *pTxBuffPtr;
+  __IO uint16_t              TxXferSize;
+  __IO uint16_t              TxXferCount;
+  DMA_HandleTypeDef          *hdmatx;
+  DMA_HandleTypeDef          *hdmarx;
+  __IO HAL_LockTypeDef       Lock;
+  __IO HAL_I2S_StateTypeDef  State;
+  __IO uint32_t              ErrorCode;
+} I2S_HandleTypeDef;
+
+#define I2S_MODE_MASTER_TX         (0x00000200U)
+#define I2S_STANDARD_PHILIPS       (0x00000000U)
+#define I2S_DATAFORMAT_16B         (0x00000000U)
+#define I2S_MCLKOUTPUT_ENABLE      (0x00000200U)
+#define I2S_AUDIOFREQ_48K          (48000U)
+#define I2S_CPOL_LOW               (0x00000000U)
+
+#define __HAL_I2S_ENABLE(__HANDLE__)  ((__HANDLE__)->Instance->I2SCFGR |= SPI_I2SCFGR_I2SE)
+#define __HAL_I2S_DISABLE(__HANDLE__) ((__HANDLE__)->Instance->I2SCFGR &= (~SPI_I2SCFGR_I2SE))
+
+HAL_StatusTypeDef HAL_I2S_Init(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2S_Transmit_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2S_DMAPause(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2S_DMAResume(I2S_HandleTypeDef *hi2s);
+HAL_StatusTypeDef HAL_I2S_DMAStop(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_TxHalfCpltCallback(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_TxCpltCallback(I2S_HandleTypeDef *hi2s);
+
+/***************************************
+* I2C
+****************************************/
+typedef struct
+{
+  uint32_t ClockSpeed;
+  uint32_t DutyCycle;
+  uint32_t OwnAddress1;
+  uint32_t AddressingMode;
+  uint32_t DualAddressMode;
+  uint32_t OwnAddress2;
+  uint32_t GeneralCallMode;
+  uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef enum
+{
+  HAL_I2C_STATE_RESET             = 0x00U,
+  HAL_I2C_STATE_READY             = 0x20U,
+  HAL_I2C_STATE_BUSY              = 0x24U,
+  HAL_I2C_STATE_BUSY_TX           = 0x21U,
+  HAL_I2C_STATE_BUSY_RX           = 0x22U,
+  HAL_I2C_STATE_ERROR             = 0xE0U
+} HAL_I2C_StateTypeDef;
+
+typedef struct __I2C_HandleTypeDef
+{
+  I2C_TypeDef                *Instance;
+  I2C_InitTypeDef            Init;
+  uint8_t                    *pBuffPtr;
+  uint16_t                   XferSize;
+  __IO uint16_t              XferCount;
+  HAL_LockTypeDef            Lock;
+  __IO HAL_I2C_StateTypeDef  State;
+  __IO uint32_t              ErrorCode;
+} I2C_HandleTypeDef;
+
+#define I2C_DUTYCYCLE_2                 0x00000000U
+#define I2C_ADDRESSINGMODE_7BIT         0x00004000U
+#define I2C_DUALADDRESS_DISABLE         0x00000000U
+#define I2C_GENERALCALL_DISABLE         0x00000000U
+#define I2C_NOSTRETCH_DISABLE           0x00000000U
+#define I2C_MEMADD_SIZE_8BIT            0x00000001U
+#define I2C_FLAG_BUSY                   0x00100002U
+
+#define __HAL_I2C_GET_FLAG(__HANDLE__, __FLAG__) (simHal_i2cFlag((__HANDLE__), (__FLAG__)))
+
+FlagStatus simHal_i2cFlag(I2C_HandleTypeDef *hi2c, uint32_t flag);
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                                             uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                                      uint16_t MemAddress, uint16_t MemAddSize,
+                                      uint8_t *pData, uint16_t Size);
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+/***************************************
+* TIM
+****************************************/
+typedef struct
+{
+  TIM_TypeDef     *Instance;
+  HAL_LockTypeDef Lock;
+} TIM_HandleTypeDef;
+
+#define __HAL_TIM_GET_COUNTER(__HANDLE__)          (simHal_timCounter(__HANDLE__))
+#define __HAL_TIM_SET_COUNTER(__HANDLE__, __CNT__) (simHal_timSetCounter((__HANDLE__), (__CNT__)))
+
+uint32_t simHal_timCounter(TIM_HandleTypeDef *htim);
+void simHal_timSetCounter(TIM_HandleTypeDef *htim, uint32_t cnt);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim);
+
+/***************************************
+* USB OTG, the endpoint types of stm32f4xx_ll_usb.h
+****************************************/
+#define EP_TYPE_CTRL              0U
+#define EP_TYPE_ISOC              1U
+#define EP_TYPE_BULK              2U
+#define EP_TYPE_INTR              3U
+#define EP_TYPE_MSK               3U
+
+/***************************************
+* RCC
+****************************************/
+typedef struct
+{
+  uint32_t PLLI2SN;
+  uint32_t PLLI2SR;
+} RCC_PLLI2SInitTypeDef;
+
+typedef struct
+{
+  uint32_t PeriphClockSelection;
+  RCC_PLLI2SInitTypeDef PLLI2S;
+  uint32_t RTCClockSelection;
+} RCC_PeriphCLKInitTypeDef;
+
+#define RCC_PERIPHCLK_I2S         0x00000001U
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit);
+void HAL_RCCEx_GetPeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit);
+
+/***************************************
+* HAL core
+****************************************/
+HAL_StatusTypeDef HAL_Init(void);
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F4xx_HAL_H */
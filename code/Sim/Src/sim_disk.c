@@ -0,0 +1,642 @@
+/*
+ * sim_disk.c
+ *
+ * @description: The implementation file of the disk of the host
+ * simulation build.
+ *
+ * @note A command lets the simulated time pass in one go, so a DMA
+ * interrupt that falls due during a read is taken in the middle of it, as
+ * it is on the board while the USB host waits for the stick.
+ *
+ * @note A latency trace is a text file with one command per line, the
+ * number of sectors and the time of the command in microseconds, lines
+ * starting with '#' are skipped:
+ *
+ *     # sectors  us
+ *     1          612
+ *     64         38120
+ *
+ * The commands are replayed in order and the trace starts over at its
+ * end. When the command at hand moves more or fewer sectors than the one
+ * of the trace, the transfer time of the difference at the throughput of
+ * simDisk_setTiming() is added or taken off.
+ *
+ * @reference:
+ * 1.FatFs R0.12c low level disk interface
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "sim_disk.h"
+#include "sim_hal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/***************************************
+* Local Struct Definition
+****************************************/
+// A sector written to an image disk, kept in RAM
+typedef struct
+{
+	DWORD sector;
+	uint8_t *data;
+}simDisk_overlay_t;
+
+// One command of a latency trace
+typedef struct
+{
+	uint32_t sectors;
+	uint32_t us;
+}simDisk_traceCmd_t;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static uint8_t *diskData;				/* RAM disk, NULL for an image disk */
+static int diskFd = -1;					/* image disk */
+static simDisk_overlay_t *overlay;
+static uint32_t overlayNum;
+static uint32_t diskSectors;
+static uint16_t diskSectorSize;
+static uint8_t *readMap;				/* one bit per sector read so far */
+static DWORD nextSeqSector;
+
+static uint32_t cmdTimeUs;
+static uint32_t throughputKBps;
+static uint32_t jitterMaxUs;
+static uint32_t randState = 1;
+static uint32_t stallEvery;
+static uint32_t stallTimeUs;
+static simDisk_traceCmd_t *trace;
+static uint32_t traceNum;
+static uint32_t traceIdx;
+
+static simDisk_stats_t diskStats;
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief A pseudo random number, the same sequence for the same seed
+ */
+static uint32_t simDisk_rand(void)
+{
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+	return randState;
+}
+
+/**
+ * @brief The transfer time of some bytes at the throughput
+ */
+static uint64_t simDisk_transfer_ns(uint64_t bytes)
+{
+	return (throughputKBps != 0) ? ((bytes * SIM_NS_PER_MS) / throughputKBps) : 0;
+}
+
+/**
+ * @brief The time of the next command by the latency model
+ * @param count - The sectors moved by the command
+ */
+static uint64_t simDisk_cmd_ns(UINT count)
+{
+	const simDisk_traceCmd_t *cmd;
+	uint64_t ns;
+	uint64_t diff;
+
+	if(traceNum != 0)
+	{
+		cmd = &trace[traceIdx];
+		traceIdx = (traceIdx + 1) % traceNum;
+		ns = (uint64_t)cmd->us * SIM_NS_PER_US;
+		if(count >= cmd->sectors){
+			ns += simDisk_transfer_ns((uint64_t)(count - cmd->sectors) * diskSectorSize);
+		}
+		else
+		{
+			diff = simDisk_transfer_ns((uint64_t)(cmd->sectors - count) * diskSectorSize);
+			ns = (ns > diff) ? (ns - diff) : 0;
+		}
+	}
+	else{
+		ns = ((uint64_t)cmdTimeUs * SIM_NS_PER_US) + simDisk_transfer_ns((uint64_t)count * diskSectorSize);
+	}
+
+	if(jitterMaxUs != 0){
+		ns += (uint64_t)(simDisk_rand() % (jitterMaxUs + 1)) * SIM_NS_PER_US;
+	}
+	if((stallEvery != 0) && ((simDisk_rand() % stallEvery) == 0))
+	{
+		ns += (uint64_t)stallTimeUs * SIM_NS_PER_US;
+		diskStats.stalls++;
+	}
+	return ns;
+}
+
+/**
+ * @brief Account for the read pattern of a read command
+ */
+static void simDisk_track_read(DWORD sector, UINT count)
+{
+	UINT i;
+
+	if((diskStats.reads != 0) && (sector == nextSeqSector)){
+		diskStats.seqReads++;
+	}
+	nextSeqSector = sector + count;
+	if(readMap == NULL){
+		return;
+	}
+	for(i = 0; i < count; i++, sector++)
+	{
+		if(readMap[sector >> 3] & (1U << (sector & 7))){
+			diskStats.rereadSectors++;
+		}
+		readMap[sector >> 3] |= (uint8_t)(1U << (sector & 7));
+	}
+}
+
+/**
+ * @brief Find a sector written to an image disk
+ * @return its data, NULL when it was not written
+ */
+static uint8_t *simDisk_overlay_find(DWORD sector)
+{
+	uint32_t i;
+
+	for(i = 0; i < overlayNum; i++)
+	{
+		if(overlay[i].sector == sector){
+			return overlay[i].data;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Read a sector of an image disk
+ */
+static bool simDisk_image_read(DWORD sector, BYTE *buff)
+{
+	uint8_t *data = simDisk_overlay_find(sector);
+
+	if(data != NULL)
+	{
+		memcpy(buff, data, diskSectorSize);
+		return true;
+	}
+	return pread(diskFd, buff, diskSectorSize, (off_t)sector * diskSectorSize) == diskSectorSize;
+}
+
+/**
+ * @brief Write a sector of an image disk to the overlay
+ */
+static bool simDisk_image_write(DWORD sector, const BYTE *buff)
+{
+	simDisk_overlay_t *grown;
+	uint8_t *data = simDisk_overlay_find(sector);
+
+	if(data == NULL)
+	{
+		grown = realloc(overlay, (overlayNum + 1) * sizeof(*overlay));
+		data = malloc(diskSectorSize);
+		if((grown == NULL) || (data == NULL))
+		{
+			overlay = (grown != NULL) ? grown : overlay;
+			free(data);
+			return false;
+		}
+		overlay = grown;
+		overlay[overlayNum].sector = sector;
+		overlay[overlayNum].data = data;
+		overlayNum++;
+	}
+	memcpy(data, buff, diskSectorSize);
+	return true;
+}
+
+/**
+ * @brief Drop the storage of the disk
+ */
+static void simDisk_release(void)
+{
+	uint32_t i;
+
+	free(diskData);
+	diskData = NULL;
+	if(diskFd >= 0){
+		close(diskFd);
+	}
+	diskFd = -1;
+	for(i = 0; i < overlayNum; i++){
+		free(overlay[i].data);
+	}
+	free(overlay);
+	overlay = NULL;
+	overlayNum = 0;
+	free(readMap);
+	readMap = NULL;
+	diskSectors = 0;
+}
+
+/**
+ * @brief Check a sector size
+ */
+static bool simDisk_valid_size(uint16_t sectorSize)
+{
+	return (sectorSize >= _MIN_SS) && (sectorSize <= _MAX_SS) &&
+		   ((sectorSize & (sectorSize - 1)) == 0);
+}
+
+static bool simDisk_ready(void)
+{
+	return (diskData != NULL) || (diskFd >= 0);
+}
+
+static DSTATUS simDisk_initialize(BYTE lun)
+{
+	(void)lun;
+	return simDisk_ready() ? RES_OK : STA_NOINIT;
+}
+
+static DSTATUS simDisk_status(BYTE lun)
+{
+	(void)lun;
+	return simDisk_ready() ? RES_OK : STA_NOINIT;
+}
+
+static bool simDisk_in_range(DWORD sector, UINT count)
+{
+	return simDisk_ready() && (sector < diskSectors) && (count <= (diskSectors - sector));
+}
+
+static DRESULT simDisk_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+	(void)lun;
+	if(!simDisk_in_range(sector, count)){
+		return RES_PARERR;
+	}
+	simHal_advance(simDisk_access(false, sector, count));
+	return simDisk_readRaw(sector, count, buff) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT simDisk_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+	(void)lun;
+	if(!simDisk_in_range(sector, count)){
+		return RES_PARERR;
+	}
+	simHal_advance(simDisk_access(true, sector, count));
+	return simDisk_writeRaw(sector, count, buff) ? RES_OK : RES_ERROR;
+}
+
+static DRESULT simDisk_ioctl(BYTE lun, BYTE cmd, void *buff)
+{
+	(void)lun;
+	switch(cmd)
+	{
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD *)buff = diskSectors;
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD *)buff = diskSectorSize;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD *)buff = 1;
+		return RES_OK;
+	default:
+		return RES_PARERR;
+	}
+}
+
+/***************************************
+* Public Variable Definition
+****************************************/
+const Diskio_drvTypeDef SimDisk_Driver =
+{
+	simDisk_initialize,
+	simDisk_status,
+	simDisk_read,
+	simDisk_write,
+	simDisk_ioctl,
+};
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief Allocate an empty disk in RAM
+ * @param sectors - The number of sectors
+ * @param sectorSize - The sector size, a power of two from _MIN_SS to _MAX_SS
+ * @return false if the size is not supported or the memory is short
+ */
+bool simDisk_create(uint32_t sectors, uint16_t sectorSize)
+{
+	if(!simDisk_valid_size(sectorSize) || (sectors == 0)){
+		return false;
+	}
+	simDisk_release();
+	diskData = calloc(sectors, sectorSize);
+	readMap = calloc((sectors + 7) / 8, 1);
+	if((diskData == NULL) || (readMap == NULL))
+	{
+		simDisk_release();
+		return false;
+	}
+	diskSectors = sectors;
+	diskSectorSize = sectorSize;
+	simDisk_clearStats();
+	return true;
+}
+
+/**
+ * @brief Serve the sectors of an image file
+ * @param path - The image, a whole FAT or exFAT volume without partition table
+ * @param sectorSize - The sector size the image was formatted with
+ * @return false if the file can not be read or the size is not supported
+ * @note The image is opened read only. Sectors written by FatFs, e.g. the
+ * index file of the track library, are kept in RAM and read back from
+ * there, so a benchmark never changes the image.
+ */
+bool simDisk_open(const char *path, uint16_t sectorSize)
+{
+	struct stat st;
+	uint32_t sectors;
+
+	if(!simDisk_valid_size(sectorSize)){
+		return false;
+	}
+	simDisk_release();
+	diskFd = open(path, O_RDONLY);
+	if((diskFd < 0) || (fstat(diskFd, &st) != 0) || (st.st_size < sectorSize))
+	{
+		simDisk_release();
+		return false;
+	}
+	sectors = (uint32_t)(st.st_size / sectorSize);
+	readMap = calloc((sectors + 7) / 8, 1);
+	if(readMap == NULL)
+	{
+		simDisk_release();
+		return false;
+	}
+	diskSectors = sectors;
+	diskSectorSize = sectorSize;
+	simDisk_clearStats();
+	return true;
+}
+
+/**
+ * @brief Store the disk as an image file
+ * @param path - The image to write
+ * @return false if the file can not be written
+ * @note Takes no simulated time and leaves the counters alone.
+ */
+bool simDisk_save(const char *path)
+{
+	static uint8_t sector[_MAX_SS];
+	FILE *fp;
+	uint32_t i;
+	bool ok = simDisk_ready();
+
+	fp = ok ? fopen(path, "wb") : NULL;
+	if(fp == NULL){
+		return false;
+	}
+	for(i = 0; ok && (i < diskSectors); i++)
+	{
+		if(diskData != NULL){
+			ok = (fwrite(&diskData[(size_t)i * diskSectorSize], diskSectorSize, 1, fp) == 1);
+		}
+		else{
+			ok = simDisk_image_read(i, sector) && (fwrite(sector, diskSectorSize, 1, fp) == 1);
+		}
+	}
+	return (fclose(fp) == 0) && ok;
+}
+
+/**
+ * @brief Get the number of sectors, 0 without a disk
+ */
+uint32_t simDisk_sectors(void)
+{
+	return diskSectors;
+}
+
+/**
+ * @brief Get the sector size
+ */
+uint16_t simDisk_sectorSize(void)
+{
+	return diskSectorSize;
+}
+
+/**
+ * @brief Account for a command and get its time by the latency model
+ * @param write - true for a write command
+ * @param sector - The first sector
+ * @param count - The sectors moved
+ * @return the time of the command in nanoseconds, no time passes
+ * @note The driver lets the time pass in one go, the simulated USB stick
+ * spreads it over the transfer.
+ */
+uint64_t simDisk_access(bool write, DWORD sector, UINT count)
+{
+	uint64_t ns = simDisk_cmd_ns(count);
+	uint64_t us = ns / SIM_NS_PER_US;
+	uint8_t bin = 0;
+
+	while((bin < (SIM_DISK_HIST_BINS - 1)) && (us >= ((uint64_t)SIM_DISK_HIST_BASE_US << bin))){
+		bin++;
+	}
+	diskStats.hist[bin]++;
+	diskStats.busyNs += ns;
+	if(ns > diskStats.maxCmdNs){
+		diskStats.maxCmdNs = ns;
+	}
+	if(write)
+	{
+		diskStats.writes++;
+		diskStats.sectorsWritten += count;
+	}
+	else
+	{
+		simDisk_track_read(sector, count);
+		diskStats.reads++;
+		diskStats.sectorsRead += count;
+	}
+	return ns;
+}
+
+/**
+ * @brief Get the transfer time of some bytes at the throughput
+ */
+uint64_t simDisk_transferNs(uint32_t bytes)
+{
+	return simDisk_transfer_ns(bytes);
+}
+
+/**
+ * @brief Copy sectors out of the disk, no time passes
+ */
+bool simDisk_readRaw(DWORD sector, UINT count, BYTE *buff)
+{
+	UINT i;
+
+	if(!simDisk_in_range(sector, count)){
+		return false;
+	}
+	if(diskData != NULL)
+	{
+		memcpy(buff, &diskData[(size_t)sector * diskSectorSize], (size_t)count * diskSectorSize);
+		return true;
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(!simDisk_image_read(sector + i, &buff[(size_t)i * diskSectorSize])){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Copy sectors into the disk, no time passes
+ */
+bool simDisk_writeRaw(DWORD sector, UINT count, const BYTE *buff)
+{
+	UINT i;
+
+	if(!simDisk_in_range(sector, count)){
+		return false;
+	}
+	if(diskData != NULL)
+	{
+		memcpy(&diskData[(size_t)sector * diskSectorSize], buff, (size_t)count * diskSectorSize);
+		return true;
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(!simDisk_image_write(sector + i, &buff[(size_t)i * diskSectorSize])){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Set the timing of the commands
+ * @param cmdUs - The fixed time of every command in microseconds
+ * @param kBps - The transfer rate in kB/s, 0 for no transfer time
+ */
+void simDisk_setTiming(uint32_t cmdUs, uint32_t kBps)
+{
+	cmdTimeUs = cmdUs;
+	throughputKBps = kBps;
+}
+
+/**
+ * @brief Add a random jitter to every command
+ * @param jitterUs - The largest extra time in microseconds, 0 for none
+ * @param seed - The seed of the random sequence, 0 is taken as 1
+ */
+void simDisk_setJitter(uint32_t jitterUs, uint32_t seed)
+{
+	jitterMaxUs = jitterUs;
+	randState = (seed != 0) ? seed : 1;
+}
+
+/**
+ * @brief Let the disk stall now and then
+ * @param everyCmds - One stall in this many commands on average, 0 for none
+ * @param stallUs - The time of a stall in microseconds
+ * @note The stalls are drawn from the random sequence of simDisk_setJitter().
+ */
+void simDisk_setStalls(uint32_t everyCmds, uint32_t stallUs)
+{
+	stallEvery = everyCmds;
+	stallTimeUs = stallUs;
+}
+
+/**
+ * @brief Load a latency trace
+ * @param path - The trace file, NULL to go back to the fixed command time
+ * @return false if the file can not be read or holds no command
+ */
+bool simDisk_loadTrace(const char *path)
+{
+	simDisk_traceCmd_t *grown;
+	unsigned long sectors, us;
+	char line[128];
+	FILE *fp;
+
+	free(trace);
+	trace = NULL;
+	traceNum = 0;
+	traceIdx = 0;
+	if(path == NULL){
+		return true;
+	}
+	fp = fopen(path, "r");
+	if(fp == NULL){
+		return false;
+	}
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		if((line[0] == '#') || (sscanf(line, "%lu %lu", &sectors, &us) != 2)){
+			continue;
+		}
+		grown = realloc(trace, (traceNum + 1) * sizeof(*trace));
+		if(grown == NULL){
+			break;
+		}
+		trace = grown;
+		trace[traceNum].sectors = (uint32_t)sectors;
+		trace[traceNum].us = (uint32_t)us;
+		traceNum++;
+	}
+	fclose(fp);
+	return (traceNum != 0);
+}
+
+/**
+ * @brief Get the counters
+ */
+void simDisk_getStats(simDisk_stats_t *stats)
+{
+	*stats = diskStats;
+}
+
+/**
+ * @brief Clear the counters
+ * @note Forgets the sectors read so far as well.
+ */
+void simDisk_clearStats(void)
+{
+	memset(&diskStats, 0, sizeof(diskStats));
+	if(readMap != NULL){
+		memset(readMap, 0, (diskSectors + 7) / 8);
+	}
+}
+
+/**
+ * @brief Gets Time from RTC
+ * @retval Time in DWORD, fixed at 2026-10-18 00:00:00
+ */
+DWORD get_fattime(void)
+{
+	return ((DWORD)(2026 - 1980) << 25) | ((DWORD)10 << 21) | ((DWORD)18 << 16);
+}
@@ -0,0 +1,896 @@
+/*
+ * sim_hal.c
+ *
+ * @description: The implementation file of the simulated board behind
+ * the HAL mock: the clock and interrupt dispatch, SysTick, GPIO, TIM1,
+ * DWT, the I2S DMA consumer and the I2C bus with its CS43L22 model.
+ *
+ * @note The interrupt lines have the priorities of irq_prio.h as on the
+ * board: a line preempts the handlers of lower priority lines, lines of
+ * the same priority are taken one at a time. PendSV has the lowest
+ * priority: it is taken once no other handler runs, and every other line
+ * preempts it. An interrupt that falls due while the firmware masked
+ * interrupts or while a handler it can not preempt is running is taken as
+ * soon as that ends, and counted as deferred with the time it waited.
+ *
+ * @reference:
+ * 1.ST open-source HAL I2S, I2C and DMA drivers
+ * 2.Cirrus Logic CS43L22 datasheet
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "sim_hal.h"
+#include "stm32f4xx_it.h"
+#include "irq_prio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#define SIM_I2S_ITEMS_PER_FRAME		2		/* 16-bit stereo frames */
+#define SIM_CODEC_REG_NUM			0x48
+#define SIM_CODEC_MAP_INCR			0x80
+#define SIM_CODEC_CHIP_ID			0xE3	/* CS43L22 revision B1 */
+#define SIM_I2C_MAX_XFER			64
+#define SIM_PRIO_THREAD				256		/* below every exception priority */
+
+/***************************************
+* Local Struct Definition
+****************************************/
+// The I2S TX DMA stream in circular mode
+typedef struct
+{
+	DMA_HandleTypeDef *hdma;
+	uint32_t items;			/* ring size in DMA items */
+	uint64_t rate;			/* DMA items per second */
+	bool running;
+	bool paused;
+	uint64_t baseItems;		/* items consumed up to baseNs */
+	uint64_t baseNs;
+	uint64_t firedItems;	/* the half boundary of the last interrupt */
+	const int16_t *ring;
+	uint64_t tappedItems;	/* items passed to the tap */
+}sim_i2s_t;
+
+// The I2C transaction on the bus
+typedef struct
+{
+	I2C_HandleTypeDef *hi2c;
+	bool isRead;
+	uint8_t addr;
+	uint8_t map;
+	uint8_t len;
+	uint8_t data[SIM_I2C_MAX_XFER];
+	uint8_t *dst;
+}sim_i2c_t;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+GPIO_TypeDef simGpio[5];
+SPI_TypeDef simSpi3;
+I2C_TypeDef simI2c1;
+DMA_Stream_TypeDef simDma1Stream5;
+TIM_TypeDef simTim1;
+SCB_Type simScb;
+CoreDebug_Type simCoreDebug;
+ITM_Type simItm;			/* never enabled, there is no SWO on the host */
+uint32_t SystemCoreClock = SIM_CORE_CLOCK;
+
+static DWT_Type simDwt;
+static uint64_t simNow;
+static uint64_t irqAt[SIM_IRQ_NUM];
+static uint32_t primask;
+static uint16_t activePrio = SIM_PRIO_THREAD;
+static simHal_observer_t observer;
+static simHal_tap_t tap;
+static simHal_stats_t stats;
+
+static volatile uint32_t uwTick;
+static uint64_t timBaseNs;
+static uint32_t i2sAudioFreq;
+static RCC_PeriphCLKInitTypeDef rccConfig;
+static sim_i2s_t i2s;
+static sim_i2c_t i2cXfer;
+static uint8_t codecReg[SIM_CODEC_REG_NUM];
+
+/* The handlers of the interrupt lines, see stm32f4xx_it.h */
+static void (*const irqHandler[SIM_IRQ_NUM])(void) =
+{
+	SysTick_Handler,
+	DMA1_Stream5_IRQHandler,
+	I2C1_EV_IRQHandler,
+	OTG_FS_IRQHandler,
+};
+
+/* The priorities of the lines, as set by the MSP init functions */
+static const uint8_t irqPrio[SIM_IRQ_NUM] =
+{
+	TICK_INT_PRIORITY,
+	IRQ_PRIO_AUDIO_DMA,
+	IRQ_PRIO_I2C,
+	IRQ_PRIO_USB,
+};
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Check whether an interrupt line may preempt what runs now
+ */
+static bool sim_can_take(simHal_irq_t irq)
+{
+	return (primask == 0) && (irqPrio[irq] < activePrio);
+}
+
+/**
+ * @brief Find the interrupt that falls due first among those that may
+ * preempt what runs now
+ * @return the line, SIM_IRQ_NUM if none is scheduled
+ */
+static simHal_irq_t sim_next_irq(void)
+{
+	simHal_irq_t irq, next = SIM_IRQ_NUM;
+
+	for(irq = 0; irq < SIM_IRQ_NUM; irq++)
+	{
+		if((irqAt[irq] != SIM_NEVER) && sim_can_take(irq) &&
+		   ((next == SIM_IRQ_NUM) || (irqAt[irq] < irqAt[next])))
+		{
+			next = irq;
+		}
+	}
+	return next;
+}
+
+/**
+ * @brief Find the due interrupt the NVIC takes next
+ * @return the line with the highest priority among those due by now that
+ * may preempt what runs, the earliest among equals, SIM_IRQ_NUM if none
+ */
+static simHal_irq_t sim_due_irq(void)
+{
+	simHal_irq_t irq, next = SIM_IRQ_NUM;
+
+	for(irq = 0; irq < SIM_IRQ_NUM; irq++)
+	{
+		if((irqAt[irq] > simNow) || !sim_can_take(irq)){
+			continue;
+		}
+		if((next == SIM_IRQ_NUM) || (irqPrio[irq] < irqPrio[next]) ||
+		   ((irqPrio[irq] == irqPrio[next]) && (irqAt[irq] < irqAt[next])))
+		{
+			next = irq;
+		}
+	}
+	return next;
+}
+
+/**
+ * @brief The number of DMA items the I2S has consumed by now
+ */
+static uint64_t sim_i2s_consumed(void)
+{
+	if(!i2s.running || i2s.paused){
+		return i2s.baseItems;
+	}
+	return i2s.baseItems + (((simNow - i2s.baseNs) * i2s.rate) / SIM_NS_PER_S);
+}
+
+/**
+ * @brief Pass the items the I2S consumed since the last call to the tap
+ * @note Called whenever the firmware may write the ring next, so each
+ * item is taken as it was when the I2S read it.
+ */
+static void sim_i2s_tap(void)
+{
+	uint64_t consumed;
+	uint32_t idx, chunk;
+
+	if(!i2s.running || (i2s.items == 0)){
+		return;
+	}
+	consumed = sim_i2s_consumed();
+	while(i2s.tappedItems < consumed)
+	{
+		idx = (uint32_t)(i2s.tappedItems % i2s.items);
+		chunk = i2s.items - idx;
+		if((consumed - i2s.tappedItems) < chunk){
+			chunk = (uint32_t)(consumed - i2s.tappedItems);
+		}
+		if(tap != NULL){
+			tap(&i2s.ring[idx], chunk);
+		}
+		i2s.tappedItems += chunk;
+	}
+}
+
+/**
+ * @brief Take the interrupts that are due by now
+ * @note Nothing is taken while masked or inside a handler of the same or
+ * a higher priority, the pending ones are taken once that ends. PendSV
+ * comes last, as tail-chaining does on the board.
+ */
+static void sim_dispatch(void)
+{
+	uint16_t prev = activePrio;
+	uint64_t start;
+	simHal_irq_t irq;
+
+	for(;;)
+	{
+		//What the I2S read so far, before a handler writes the ring
+		sim_i2s_tap();
+		irq = sim_due_irq();
+		if(irq != SIM_IRQ_NUM)
+		{
+			if(irqAt[irq] < simNow){
+				stats.irqDeferred++;
+				if((simNow - irqAt[irq]) > stats.irqMaxLatencyNs[irq]){
+					stats.irqMaxLatencyNs[irq] = simNow - irqAt[irq];
+				}
+			}
+			if(irq == SIM_IRQ_SYSTICK){
+				irqAt[irq] += SIM_NS_PER_MS;
+			}
+			else{
+				irqAt[irq] = SIM_NEVER;
+			}
+			activePrio = irqPrio[irq];
+			irqHandler[irq]();
+			activePrio = prev;
+		}
+		else if((simScb.ICSR & SCB_ICSR_PENDSVSET_Msk) && (primask == 0) && (IRQ_PRIO_DEFERRED < activePrio))
+		{
+			simScb.ICSR &= ~SCB_ICSR_PENDSVSET_Msk;
+			stats.pendSvRuns++;
+			start = simNow;
+			activePrio = IRQ_PRIO_DEFERRED;
+			PendSV_Handler();
+			activePrio = prev;
+			stats.pendSvNs += simNow - start;
+		}
+		else{
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Schedule the DMA interrupt of the next half boundary
+ */
+static void sim_i2s_schedule(void)
+{
+	uint64_t half, next;
+
+	if(!i2s.running || i2s.paused || (i2s.items < 2) || (i2s.rate == 0))
+	{
+		simHal_schedule(SIM_IRQ_DMA1_STREAM5, SIM_NEVER);
+		return;
+	}
+	half = i2s.items / 2;
+	next = ((i2s.firedItems / half) + 1) * half;
+	simHal_schedule(SIM_IRQ_DMA1_STREAM5, i2s.baseNs +
+			((((next - i2s.baseItems) * SIM_NS_PER_S) + i2s.rate - 1) / i2s.rate));
+}
+
+/**
+ * @brief Let the time of one register poll pass
+ */
+static void sim_poll(void)
+{
+	simHal_advance(SIM_POLL_NS);
+}
+
+/**
+ * @brief Bus time of an I2C transaction
+ * @param bytes - The bytes after the address bytes
+ * @param addrBytes - The address bytes, two with a repeated start
+ */
+static uint64_t sim_i2c_time(uint32_t bytes, uint32_t addrBytes)
+{
+	return (uint64_t)(bytes + addrBytes) * 9 * SIM_I2C_BIT_NS + (2 * SIM_I2C_BIT_NS);
+}
+
+/**
+ * @brief Report an I2C transaction
+ */
+static void sim_i2c_record(simHal_recordType_t type, const uint8_t *data, uint8_t len, bool nack)
+{
+	simHal_record_t rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.timeNs = simNow;
+	rec.type = type;
+	rec.addr = i2cXfer.addr;
+	rec.status = nack ? 1 : 0;
+	rec.len = len;
+	memcpy(rec.data, data, (len < SIM_RECORD_DATA) ? len : SIM_RECORD_DATA);
+	simHal_record(&rec);
+}
+
+/**
+ * @brief Register writes to the CS43L22 model
+ * @note The first byte is the MAP, with bit 7 set the address increments
+ * after every byte.
+ */
+static void sim_codec_write(const uint8_t *data, uint8_t len)
+{
+	uint8_t reg = data[0] & ~SIM_CODEC_MAP_INCR;
+	uint8_t i;
+
+	for(i = 1; i < len; i++)
+	{
+		if(reg < SIM_CODEC_REG_NUM){
+			codecReg[reg] = data[i];
+		}
+		if(data[0] & SIM_CODEC_MAP_INCR){
+			reg++;
+		}
+	}
+}
+
+/**
+ * @brief Register reads from the CS43L22 model
+ */
+static void sim_codec_read(uint8_t map, uint8_t *dst, uint8_t len)
+{
+	uint8_t reg = map & ~SIM_CODEC_MAP_INCR;
+	uint8_t i;
+
+	for(i = 0; i < len; i++)
+	{
+		dst[i] = (reg < SIM_CODEC_REG_NUM) ? codecReg[reg] : 0;
+		if(map & SIM_CODEC_MAP_INCR){
+			reg++;
+		}
+	}
+}
+
+/***************************************
+* Simulator Function Definition
+****************************************/
+
+/**
+ * @brief Bring the board to its reset state
+ */
+void simHal_reset(void)
+{
+	simHal_irq_t irq;
+
+	simNow = 0;
+	primask = 0;
+	activePrio = SIM_PRIO_THREAD;
+	uwTick = 0;
+	for(irq = 0; irq < SIM_IRQ_NUM; irq++){
+		irqAt[irq] = SIM_NEVER;
+	}
+	memset(simGpio, 0, sizeof(simGpio));
+	memset(&simSpi3, 0, sizeof(simSpi3));
+	memset(&simI2c1, 0, sizeof(simI2c1));
+	memset(&simDma1Stream5, 0, sizeof(simDma1Stream5));
+	memset(&simTim1, 0, sizeof(simTim1));
+	memset(&simScb, 0, sizeof(simScb));
+	memset(&simDwt, 0, sizeof(simDwt));
+	memset(&stats, 0, sizeof(stats));
+	memset(&i2s, 0, sizeof(i2s));
+	memset(&i2cXfer, 0, sizeof(i2cXfer));
+	memset(codecReg, 0, sizeof(codecReg));
+	codecReg[0x01] = SIM_CODEC_CHIP_ID;
+	codecReg[0x02] = 0x01;
+	i2sAudioFreq = I2S_AUDIOFREQ_48K;
+	timBaseNs = 0;
+}
+
+/**
+ * @brief Get the simulated time
+ */
+uint64_t simHal_now(void)
+{
+	return simNow;
+}
+
+/**
+ * @brief Let time pass
+ * @param ns - The time in nanoseconds
+ * @note The interrupts that fall due are taken at their time, each one
+ * sees the clock at the point it was raised. Inside a handler only the
+ * lines that preempt it are taken.
+ */
+void simHal_advance(uint64_t ns)
+{
+	uint64_t target = simNow + ns;
+	simHal_irq_t irq;
+
+	sim_dispatch();
+	while(((irq = sim_next_irq()) != SIM_IRQ_NUM) && (irqAt[irq] <= target))
+	{
+		if(irqAt[irq] > simNow){
+			simNow = irqAt[irq];
+		}
+		sim_dispatch();
+	}
+	if(target > simNow){
+		simNow = target;
+	}
+	sim_i2s_tap();
+}
+
+/**
+ * @brief Raise an interrupt at a point in time
+ */
+void simHal_schedule(simHal_irq_t irq, uint64_t atNs)
+{
+	irqAt[irq] = atNs;
+}
+
+/**
+ * @brief Set the observer of transactions and DMA interrupts
+ */
+void simHal_setObserver(simHal_observer_t obs)
+{
+	observer = obs;
+}
+
+/**
+ * @brief Set the tap of the audio the I2S reads
+ */
+void simHal_setTap(simHal_tap_t fn)
+{
+	tap = fn;
+}
+
+/**
+ * @brief Pass a record to the observer
+ */
+void simHal_record(const simHal_record_t *rec)
+{
+	if(observer != NULL){
+		observer(rec);
+	}
+}
+
+/**
+ * @brief Get the counters since the reset
+ */
+void simHal_getStats(simHal_stats_t *out)
+{
+	*out = stats;
+}
+
+/**
+ * @brief Get the time the DMA reaches the next half of the ring
+ */
+uint64_t simHal_dmaNextEvent(void)
+{
+	return irqAt[SIM_IRQ_DMA1_STREAM5];
+}
+
+/**
+ * @brief Get a register of the CS43L22 model
+ */
+uint8_t simHal_codecRegister(uint8_t reg)
+{
+	return (reg < SIM_CODEC_REG_NUM) ? codecReg[reg] : 0;
+}
+
+/**
+ * @brief Drive an input pin
+ */
+void simHal_setInput(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+	if(state == GPIO_PIN_SET){
+		port->IDR |= pin;
+	}
+	else{
+		port->IDR &= ~(uint32_t)pin;
+	}
+}
+
+/***************************************
+* HAL Mock Function Definition
+****************************************/
+
+uint32_t simHal_getPrimask(void)
+{
+	return primask;
+}
+
+void simHal_setPrimask(uint32_t mask)
+{
+	primask = mask;
+	sim_dispatch();
+}
+
+/**
+ * @brief WFI: sleep until an interrupt is pending
+ * @note Wakes on any scheduled line or a pending PendSV, also while
+ * PRIMASK masks them, as the core does. The handlers run when the mask
+ * allows, with no mask right away.
+ */
+void simHal_waitForInterrupt(void)
+{
+	uint64_t wake = SIM_NEVER;
+	simHal_irq_t irq;
+
+	if(simScb.ICSR & SCB_ICSR_PENDSVSET_Msk){
+		return;
+	}
+	for(irq = 0; irq < SIM_IRQ_NUM; irq++)
+	{
+		if(irqAt[irq] < wake){
+			wake = irqAt[irq];
+		}
+	}
+	if((wake == SIM_NEVER) || (wake <= simNow)){
+		return;
+	}
+	stats.sleeps++;
+	stats.sleepNs += wake - simNow;
+	simNow = wake;
+	sim_dispatch();
+}
+
+DWT_Type *simHal_dwt(void)
+{
+	sim_poll();
+	simDwt.CYCCNT = (uint32_t)((simNow * (SystemCoreClock / 1000000U)) / SIM_NS_PER_US);
+	return &simDwt;
+}
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+	simHal_reset();
+	simHal_schedule(SIM_IRQ_SYSTICK, SIM_NS_PER_MS);
+	return HAL_OK;
+}
+
+void HAL_IncTick(void)
+{
+	uwTick++;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	sim_poll();
+	return uwTick;
+}
+
+/**
+ * @brief Wait like the HAL does, at least Delay + 1 ticks
+ * @note The clock jumps from tick to tick instead of polling. Waiting with
+ * interrupts masked would hang the board, the simulation stops instead.
+ */
+void HAL_Delay(uint32_t Delay)
+{
+	uint32_t tickstart = uwTick;
+	uint32_t wait = Delay;
+
+	if(wait < HAL_MAX_DELAY){
+		wait++;
+	}
+	while((uwTick - tickstart) < wait)
+	{
+		if(!sim_can_take(SIM_IRQ_SYSTICK) || (irqAt[SIM_IRQ_SYSTICK] == SIM_NEVER))
+		{
+			fprintf(stderr, "sim: HAL_Delay(%lu) without SysTick at %llu ns\n",
+					(unsigned long)Delay, (unsigned long long)simNow);
+			exit(EXIT_FAILURE);
+		}
+		simHal_advance(irqAt[SIM_IRQ_SYSTICK] - simNow);
+	}
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	sim_poll();
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	simHal_record_t rec;
+
+	if(PinState == GPIO_PIN_SET){
+		GPIOx->ODR |= GPIO_Pin;
+	}
+	else{
+		GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+	}
+	stats.gpioWrites++;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.timeNs = simNow;
+	rec.type = SIM_REC_GPIO;
+	rec.addr = (uint8_t)(GPIOx - simGpio);
+	rec.pin = GPIO_Pin;
+	rec.status = (uint8_t)PinState;
+	simHal_record(&rec);
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	HAL_GPIO_WritePin(GPIOx, GPIO_Pin,
+			(GPIOx->ODR & GPIO_Pin) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin)
+{
+	HAL_GPIO_EXTI_Callback(GPIO_Pin);
+}
+
+__weak void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+	UNUSED(GPIO_Pin);
+}
+
+uint32_t simHal_timCounter(TIM_HandleTypeDef *htim)
+{
+	UNUSED(htim);
+	sim_poll();
+	/* TIM1 counts microseconds */
+	return (uint32_t)((simNow - timBaseNs) / SIM_NS_PER_US);
+}
+
+void simHal_timSetCounter(TIM_HandleTypeDef *htim, uint32_t cnt)
+{
+	UNUSED(htim);
+	timBaseNs = simNow - ((uint64_t)cnt * SIM_NS_PER_US);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim)
+{
+	simHal_timSetCounter(htim, 0);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit)
+{
+	rccConfig = *PeriphClkInit;
+	return HAL_OK;
+}
+
+void HAL_RCCEx_GetPeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit)
+{
+	*PeriphClkInit = rccConfig;
+}
+
+/**
+ * @brief The NDTR register of a stream
+ * @note Only the I2S TX stream moves, it counts down from the ring size
+ * and reloads in circular mode.
+ */
+uint32_t simHal_dmaCounter(DMA_HandleTypeDef *hdma)
+{
+	if((hdma != i2s.hdma) || (i2s.items == 0)){
+		return hdma->Instance->NDTR;
+	}
+	return i2s.items - (uint32_t)(sim_i2s_consumed() % i2s.items);
+}
+
+/**
+ * @brief The DMA interrupt: one half boundary of the ring passed
+ */
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+	I2S_HandleTypeDef *hi2s = (I2S_HandleTypeDef *)hdma->Parent;
+	simHal_record_t rec;
+	bool half;
+
+	if((hdma != i2s.hdma) || !i2s.running || i2s.paused){
+		return;
+	}
+	i2s.firedItems = ((i2s.firedItems / (i2s.items / 2)) + 1) * (i2s.items / 2);
+	half = ((i2s.firedItems % i2s.items) != 0);
+	sim_i2s_schedule();
+	stats.dmaEvents++;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.timeNs = simNow;
+	rec.type = half ? SIM_REC_DMA_HALF : SIM_REC_DMA_FULL;
+	simHal_record(&rec);
+
+	if(half){
+		HAL_I2S_TxHalfCpltCallback(hi2s);
+	}
+	else{
+		HAL_I2S_TxCpltCallback(hi2s);
+	}
+}
+
+HAL_StatusTypeDef HAL_I2S_Init(I2S_HandleTypeDef *hi2s)
+{
+	i2sAudioFreq = hi2s->Init.AudioFreq;
+	hi2s->State = HAL_I2S_STATE_READY;
+	return HAL_OK;
+}
+
+/**
+ * @brief Start the circular TX DMA of the audio ring
+ * @note The I2S sends one 16-bit item per channel, two per frame.
+ */
+HAL_StatusTypeDef HAL_I2S_Transmit_DMA(I2S_HandleTypeDef *hi2s, uint16_t *pData, uint16_t Size)
+{
+	if((pData == NULL) || (Size == 0) || (hi2s->hdmatx == NULL)){
+		return HAL_ERROR;
+	}
+	hi2s->pTxBuffPtr = pData;
+	hi2s->TxXferSize = Size;
+	hi2s->State = HAL_I2S_STATE_BUSY_TX;
+	__HAL_I2S_ENABLE(hi2s);
+
+	i2s.hdma = hi2s->hdmatx;
+	i2s.items = Size;
+	i2s.rate = (uint64_t)i2sAudioFreq * SIM_I2S_ITEMS_PER_FRAME;
+	i2s.running = true;
+	i2s.paused = false;
+	i2s.baseItems = 0;
+	i2s.baseNs = simNow;
+	i2s.firedItems = 0;
+	i2s.ring = (const int16_t *)pData;
+	i2s.tappedItems = 0;
+	sim_i2s_schedule();
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAPause(I2S_HandleTypeDef *hi2s)
+{
+	UNUSED(hi2s);
+	if(i2s.running && !i2s.paused)
+	{
+		sim_i2s_tap();
+		i2s.baseItems = sim_i2s_consumed();
+		i2s.baseNs = simNow;
+		i2s.paused = true;
+		sim_i2s_schedule();
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAResume(I2S_HandleTypeDef *hi2s)
+{
+	UNUSED(hi2s);
+	if(i2s.running && i2s.paused)
+	{
+		i2s.baseNs = simNow;
+		i2s.paused = false;
+		sim_i2s_schedule();
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2S_DMAStop(I2S_HandleTypeDef *hi2s)
+{
+	sim_i2s_tap();
+	i2s.running = false;
+	i2s.paused = false;
+	sim_i2s_schedule();
+	hi2s->State = HAL_I2S_STATE_READY;
+	__HAL_I2S_DISABLE(hi2s);
+	return HAL_OK;
+}
+
+FlagStatus simHal_i2cFlag(I2C_HandleTypeDef *hi2c, uint32_t flag)
+{
+	if(flag == I2C_FLAG_BUSY){
+		return (hi2c->State != HAL_I2C_STATE_READY) ? SET : RESET;
+	}
+	return RESET;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+	hi2c->State = HAL_I2C_STATE_READY;
+	hi2c->ErrorCode = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+	if(i2cXfer.hi2c == hi2c)
+	{
+		i2cXfer.hi2c = NULL;
+		simHal_schedule(SIM_IRQ_I2C1_EV, SIM_NEVER);
+	}
+	hi2c->State = HAL_I2C_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c)
+{
+	return hi2c->State;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                                             uint8_t *pData, uint16_t Size)
+{
+	if(hi2c->State != HAL_I2C_STATE_READY){
+		return HAL_BUSY;
+	}
+	if((Size == 0) || (Size > SIM_I2C_MAX_XFER)){
+		return HAL_ERROR;
+	}
+	hi2c->State = HAL_I2C_STATE_BUSY_TX;
+	i2cXfer.hi2c = hi2c;
+	i2cXfer.isRead = false;
+	i2cXfer.addr = (uint8_t)DevAddress;
+	i2cXfer.len = (uint8_t)Size;
+	memcpy(i2cXfer.data, pData, Size);
+	simHal_schedule(SIM_IRQ_I2C1_EV, simNow + sim_i2c_time(Size, 1));
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress,
+                                      uint16_t MemAddress, uint16_t MemAddSize,
+                                      uint8_t *pData, uint16_t Size)
+{
+	if(hi2c->State != HAL_I2C_STATE_READY){
+		return HAL_BUSY;
+	}
+	if((Size == 0) || (Size > SIM_I2C_MAX_XFER)){
+		return HAL_ERROR;
+	}
+	hi2c->State = HAL_I2C_STATE_BUSY_RX;
+	i2cXfer.hi2c = hi2c;
+	i2cXfer.isRead = true;
+	i2cXfer.addr = (uint8_t)DevAddress;
+	i2cXfer.map = (uint8_t)MemAddress;
+	i2cXfer.len = (uint8_t)Size;
+	i2cXfer.dst = pData;
+	simHal_schedule(SIM_IRQ_I2C1_EV, simNow + sim_i2c_time(Size + MemAddSize, 2));
+	return HAL_OK;
+}
+
+/**
+ * @brief The I2C event interrupt: the transaction on the bus is done
+ * @note Only the codec acknowledges, any other address ends in a NACK.
+ */
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c)
+{
+	bool nack = (i2cXfer.addr != SIM_CODEC_ADDR);
+
+	if((i2cXfer.hi2c != hi2c) || (hi2c->State == HAL_I2C_STATE_READY)){
+		return;
+	}
+	i2cXfer.hi2c = NULL;
+	hi2c->State = HAL_I2C_STATE_READY;
+	stats.i2cBusyNs += i2cXfer.isRead ? sim_i2c_time(i2cXfer.len + 1, 2) :
+	                                    sim_i2c_time(i2cXfer.len, 1);
+	stats.i2cBytes += i2cXfer.len;
+	if(nack)
+	{
+		stats.i2cNacks++;
+		sim_i2c_record(i2cXfer.isRead ? SIM_REC_I2C_READ : SIM_REC_I2C_WRITE,
+				i2cXfer.data, 0, true);
+		HAL_I2C_ErrorCallback(hi2c);
+		return;
+	}
+
+	if(i2cXfer.isRead)
+	{
+		stats.i2cReads++;
+		sim_codec_read(i2cXfer.map, i2cXfer.dst, i2cXfer.len);
+		sim_i2c_record(SIM_REC_I2C_READ, i2cXfer.dst, i2cXfer.len, false);
+		HAL_I2C_MemRxCpltCallback(hi2c);
+	}
+	else
+	{
+		stats.i2cWrites++;
+		sim_codec_write(i2cXfer.data, i2cXfer.len);
+		sim_i2c_record(SIM_REC_I2C_WRITE, i2cXfer.data, i2cXfer.len, false);
+		HAL_I2C_MasterTxCpltCallback(hi2c);
+	}
+}
+
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c)
+{
+	UNUSED(hi2c);
+}
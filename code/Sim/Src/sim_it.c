@@ -0,0 +1,98 @@
+/*
+ * sim_it.c
+ *
+ * @description: The interrupt handlers of the host simulation build, the
+ * counterpart of stm32f4xx_it.c. The simulated board calls them when
+ * their interrupt falls due, they forward to the HAL mock and the
+ * firmware exactly as the handlers on the board do.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "stm32f4xx_hal.h"
+#include "stm32f4xx_it.h"
+#include "i2c_queue.h"
+#include "usb_host.h"
+#include "profile.h"
+#include "sim_usb.h"
+
+/***************************************
+* External Variable Definition
+****************************************/
+extern DMA_HandleTypeDef hdma_spi3_tx;
+extern I2C_HandleTypeDef hi2c1;
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief This function handles Pendable request for system service.
+ */
+void PendSV_Handler(void)
+{
+	uint32_t start = PROFILE_START();
+
+	MX_USB_HOST_PendSV();
+	PROFILE_STOP(PROF_IRQ_PENDSV, start);
+}
+
+/**
+ * @brief This function handles System tick timer.
+ */
+void SysTick_Handler(void)
+{
+	uint32_t start = PROFILE_START();
+
+	HAL_IncTick();
+	i2cQueue_poll();
+	PROFILE_STOP(PROF_IRQ_SYSTICK, start);
+}
+
+/**
+ * @brief This function handles DMA1 stream5 global interrupt.
+ */
+void DMA1_Stream5_IRQHandler(void)
+{
+	uint32_t start = PROFILE_START();
+
+	HAL_DMA_IRQHandler(&hdma_spi3_tx);
+	PROFILE_STOP(PROF_IRQ_DMA, start);
+}
+
+/**
+ * @brief This function handles I2C1 event interrupt.
+ */
+void I2C1_EV_IRQHandler(void)
+{
+	uint32_t start = PROFILE_START();
+
+	HAL_I2C_EV_IRQHandler(&hi2c1);
+	PROFILE_STOP(PROF_IRQ_I2C_EV, start);
+}
+
+/**
+ * @brief This function handles I2C1 error interrupt.
+ */
+void I2C1_ER_IRQHandler(void)
+{
+	uint32_t start = PROFILE_START();
+
+	HAL_I2C_ER_IRQHandler(&hi2c1);
+	PROFILE_STOP(PROF_IRQ_I2C_ER, start);
+}
+
+/**
+ * @brief This function handles USB On The Go FS global interrupt.
+ */
+void OTG_FS_IRQHandler(void)
+{
+	uint32_t start = PROFILE_START();
+
+	simUsb_IRQHandler();
+	PROFILE_STOP(PROF_IRQ_OTG_FS, start);
+}
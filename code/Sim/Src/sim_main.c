@@ -0,0 +1,1154 @@
+/*
+ * sim_main.c
+ *
+ * @description: The scenario runner of the host simulation build. It
+ * builds a FAT volume on the RAM disk with one WAV file (a generated tone
+ * or a copy of a host file), or mounts a FAT image file and picks a track
+ * of its library, brings up the player pipeline the way main() does on the
+ * board and plays the file in simulated time.
+ *
+ * Every DMA interrupt asks for a refill of the ring half it handed over,
+ * the refill has to be done before the DMA comes back to that half. The
+ * runner measures how long each refill took and how much time was left
+ * (the slack), and counts an underrun when the DMA hands over the next
+ * half while the previous refill is still not done. It also checks what
+ * the DMA reads: every half has to hold the file data at the position the
+ * player reports for it, follow the half before it and stay untouched
+ * while the DMA reads it. The I2C and GPIO traffic is counted and can be
+ * traced, the disk reports its read pattern and the spread of its command
+ * times.
+ *
+ * With --usb the volume is served by a simulated USB stick instead: the
+ * USB host library enumerates it in PendSV, the player reads through
+ * usbh_diskio and the MSC class, and the runner reports the bus traffic,
+ * the NAKs and STALLs, the gaps between commands and the hit rates of the
+ * disk layer.
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "sim_hal.h"
+#include "sim_disk.h"
+#include "sim_usb.h"
+#include "cs43l22.h"
+#include "lcd.h"
+#include "lcd_ui.h"
+#include "wav_player.h"
+#include "wav_library.h"
+#include "fatfs.h"
+#include "usb_host.h"
+#include "usbh_diskio.h"
+#include "profile.h"
+#include "trace.h"
+#include "scheduler.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#define SIM_TRACK_NAME			"TRACK01.WAV"
+#define SIM_VOLUME_MIN			(64UL * 1024 * 1024)	/* bytes of the smallest volume */
+#define SIM_VOLUME_SPARE		(16UL * 1024 * 1024)	/* room next to the file */
+#define SIM_FAT32_CLUSTERS		66000	/* a little over the FAT32 minimum */
+#define SIM_MKFS_WORK			(64 * 1024)
+#define SIM_COPY_CHUNK			(32 * 1024)
+#define SIM_TONE_HZ				440.0
+#define SIM_TONE_AMPLITUDE		8000.0
+#define SIM_LOOP_NS				2000	/* CPU time of a main loop pass */
+#define SIM_DEFAULT_VOLUME		200
+#define SIM_EXIT_UNDERRUN		2
+#define SIM_EXIT_STUCK			3
+#define SIM_EXIT_CONTENT		4
+#define SIM_STUCK_MS			5000	/* play time past the track length taken as stuck */
+#define SIM_SCAN_BUDGET_US		1000000
+#define SIM_USB_READY_MS		5000	/* enumeration timeout */
+#define SIM_AUDIO_DEADLINE_MS	2		/* as the board's task table has them */
+#define SIM_AUDIO_URGENT_US		4000
+#define SIM_BACKGROUND_DEADLINE_MS	1
+#define SIM_UI_PERIOD_MS		10
+#define SIM_HALF_MAX			(16 * 1024)	/* bytes of the largest ring half checked */
+
+/***************************************
+* Local Struct Definition
+****************************************/
+typedef struct
+{
+	const char *wavPath;		/* host file to play, NULL for a tone */
+	const char *imagePath;		/* FAT image to play from, NULL for the RAM disk */
+	const char *trackName;		/* name of the track on the RAM disk */
+	const char *savePath;		/* store the RAM disk as an image */
+	const char *tracePath;		/* latency trace */
+	const char *dumpPath;		/* event trace dump */
+	uint32_t track;				/* library index of the track on an image */
+	uint32_t seconds;			/* tone length */
+	uint32_t rate;				/* tone sample rate */
+	uint16_t channels;			/* tone channels */
+	uint16_t sectorSize;
+	uint32_t clusterSize;		/* bytes, 0 for the FatFs default */
+	BYTE fsType;				/* FM_FAT32 or FM_EXFAT */
+	uint32_t cmdUs;
+	uint32_t kBps;
+	uint32_t jitterUs;
+	uint32_t seed;
+	uint32_t stallEvery;
+	uint32_t stallMs;
+	uint32_t loopNs;
+	bool zeroCopy;
+	uint32_t pauseAtMs;			/* 0: no pause */
+	uint32_t resumeAtMs;
+	bool trace;
+	bool traceGpio;
+	bool strict;
+	bool usb;					/* play through the USB host and a simulated stick */
+	simUsb_config_t usbCfg;
+}sim_options_t;
+
+typedef struct
+{
+	bool paused;
+	bool waiting;				/* a refill was asked for and is not done */
+	uint64_t requestNs;
+	uint64_t dueNs;
+	uint32_t requests;
+	uint32_t refills;
+	uint32_t underruns;
+	uint64_t firstUnderrunNs;
+	int64_t minSlackNs;
+	int64_t sumSlackNs;
+	uint64_t minRefillNs;
+	uint64_t maxRefillNs;
+	uint64_t sumRefillNs;
+}sim_audio_t;
+
+// The check of the audio the DMA reads against the file
+typedef struct
+{
+	uint8_t *data;				/* the sample data of the track, NULL: no check */
+	uint32_t size;
+	uint32_t blockAlign;
+	bool taken;					/* snap holds the half the DMA is in */
+	bool settle;				/* the next half may hold a resume fade-in */
+	uint32_t nextSample;		/* where the next half has to start, UINT32_MAX: anywhere */
+	uint32_t halves;
+	uint32_t differ;			/* halves that are not the file data */
+	uint32_t jumps;				/* halves that do not follow the half before */
+	uint32_t rewritten;			/* halves written to while the DMA read them */
+	uint64_t firstBadNs;
+	uint8_t snap[SIM_HALF_MAX];	/* the half the DMA is in, as the DMA found it */
+}sim_content_t;
+
+// The check of the audio played around a pause and a resume
+typedef struct
+{
+	int32_t limit;				/* largest step between samples of the file, with a margin */
+	int16_t last[2];			/* the sample played before, per I2S channel */
+	uint32_t items;				/* items played */
+	uint32_t window;			/* items left to check, UINT32_MAX while paused */
+	uint32_t resumes;
+	int32_t maxStep;			/* largest step played in the windows */
+	uint32_t clicks;			/* steps above the limit */
+	uint64_t firstClickNs;
+}sim_resume_t;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+/* The board objects, as defined by main.c and stm32f4xx_hal_msp.c */
+I2C_HandleTypeDef hi2c1;
+I2S_HandleTypeDef hi2s3;
+DMA_HandleTypeDef hdma_spi3_tx;
+TIM_HandleTypeDef htim1;
+
+extern ApplicationTypeDef Appli_state;
+
+/* The USBH logical drive, as defined by fatfs.c */
+char USBHPath[4];
+FATFS USBHFatFS;
+
+static sim_options_t opt =
+{
+	.wavPath = NULL,
+	.trackName = SIM_TRACK_NAME,
+	.seconds = 10,
+	.rate = 44100,
+	.channels = 2,
+	.sectorSize = 512,
+	.clusterSize = 32768,
+	.fsType = FM_FAT32,
+	.cmdUs = SIM_DISK_CMD_US,
+	.kBps = SIM_DISK_KBPS,
+	.seed = 1,
+	.loopNs = SIM_LOOP_NS,
+	.zeroCopy = true,
+	.usbCfg = { .nakBurstUs = 2000 },
+};
+static sim_audio_t audio;
+static sim_content_t content;
+static sim_resume_t resume;
+static char trackPath[WAVLIB_PATH_MAX];	/* the track as the library has it */
+static BYTE simWork[SIM_MKFS_WORK];
+
+/* The tasks of the board's main loop that take part in playing */
+static sched_task_t simTasks[] =
+{
+	{ .name = "audio", .run = wavPlayer_proceed, .ready = wavPlayer_refillPending,
+	  .slack = wavPlayer_refillSlackUs, .priority = 1,
+	  .deadlineMs = SIM_AUDIO_DEADLINE_MS, .urgentUs = SIM_AUDIO_URGENT_US },
+	{ .name = "background", .run = wavPlayer_background, .ready = wavPlayer_backgroundPending,
+	  .priority = 2, .deadlineMs = SIM_BACKGROUND_DEADLINE_MS },
+	{ .name = "ui", .run = lcdUi_process, .priority = 3,
+	  .periodMs = SIM_UI_PERIOD_MS, .deadlineMs = SIM_UI_PERIOD_MS },
+};
+
+/***************************************
+* Local Function Helper Definition
+****************************************/
+
+/**
+ * @brief Bring up the peripherals as the MX_*_Init functions do
+ */
+static void sim_board_init(void)
+{
+	hi2c1.Instance = I2C1;
+	hi2c1.Init.ClockSpeed = 100000;
+	hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+	HAL_I2C_Init(&hi2c1);
+
+	hdma_spi3_tx.Instance = DMA1_Stream5;
+	hi2s3.Instance = SPI3;
+	hi2s3.Init.Mode = I2S_MODE_MASTER_TX;
+	hi2s3.Init.Standard = I2S_STANDARD_PHILIPS;
+	hi2s3.Init.DataFormat = I2S_DATAFORMAT_16B;
+	hi2s3.Init.MCLKOutput = I2S_MCLKOUTPUT_ENABLE;
+	hi2s3.Init.AudioFreq = I2S_AUDIOFREQ_48K;
+	hi2s3.Init.CPOL = I2S_CPOL_LOW;
+	__HAL_LINKDMA(&hi2s3, hdmatx, hdma_spi3_tx);
+	HAL_I2S_Init(&hi2s3);
+
+	htim1.Instance = TIM1;
+	HAL_TIM_Base_Start(&htim1);
+}
+
+/**
+ * @brief Store a little-endian field of a WAV header
+ */
+static void sim_put_le(uint8_t *dst, uint32_t value, uint8_t bytes)
+{
+	while(bytes--)
+	{
+		*dst++ = (uint8_t)value;
+		value >>= 8;
+	}
+}
+
+/**
+ * @brief Write a sine tone as a 16-bit PCM WAV file
+ */
+static bool sim_write_tone(FIL *fp)
+{
+	uint8_t hdr[44];
+	int16_t frame[2];
+	uint32_t frames = opt.seconds * opt.rate;
+	uint32_t dataSize = frames * opt.channels * sizeof(int16_t);
+	uint32_t i;
+	UINT bw;
+
+	memcpy(&hdr[0], "RIFF", 4);
+	sim_put_le(&hdr[4], 36 + dataSize, 4);
+	memcpy(&hdr[8], "WAVEfmt ", 8);
+	sim_put_le(&hdr[16], 16, 4);
+	sim_put_le(&hdr[20], 1, 2);
+	sim_put_le(&hdr[22], opt.channels, 2);
+	sim_put_le(&hdr[24], opt.rate, 4);
+	sim_put_le(&hdr[28], opt.rate * opt.channels * sizeof(int16_t), 4);
+	sim_put_le(&hdr[32], opt.channels * sizeof(int16_t), 2);
+	sim_put_le(&hdr[34], 16, 2);
+	memcpy(&hdr[36], "data", 4);
+	sim_put_le(&hdr[40], dataSize, 4);
+	if((f_write(fp, hdr, sizeof(hdr), &bw) != FR_OK) || (bw != sizeof(hdr))){
+		return false;
+	}
+
+	for(i = 0; i < frames; i++)
+	{
+		frame[0] = (int16_t)(SIM_TONE_AMPLITUDE * sin((2.0 * M_PI * SIM_TONE_HZ * i) / opt.rate));
+		frame[1] = frame[0];
+		if((f_write(fp, frame, opt.channels * sizeof(int16_t), &bw) != FR_OK) ||
+		   (bw != (opt.channels * sizeof(int16_t))))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Copy a host file into the volume
+ */
+static bool sim_copy_file(FIL *fp, FILE *src)
+{
+	static uint8_t chunk[SIM_COPY_CHUNK];
+	size_t len;
+	UINT bw;
+
+	while((len = fread(chunk, 1, sizeof(chunk), src)) > 0)
+	{
+		if((f_write(fp, chunk, (UINT)len, &bw) != FR_OK) || (bw != len)){
+			return false;
+		}
+	}
+	return !ferror(src);
+}
+
+/**
+ * @brief Create the RAM disk, format it and store the track
+ */
+static bool sim_volume_init(void)
+{
+	uint64_t bytes = SIM_VOLUME_MIN;
+	FILE *src = NULL;
+	FIL fp;
+	bool ok;
+
+	if(opt.wavPath != NULL)
+	{
+		src = fopen(opt.wavPath, "rb");
+		if(src == NULL)
+		{
+			fprintf(stderr, "sim: can not open %s\n", opt.wavPath);
+			return false;
+		}
+		fseek(src, 0, SEEK_END);
+		bytes = (uint64_t)ftell(src) + SIM_VOLUME_SPARE;
+		bytes = (bytes < SIM_VOLUME_MIN) ? SIM_VOLUME_MIN : bytes;
+		rewind(src);
+	}
+	//FAT32 needs enough clusters, the untouched part of the disk takes no memory
+	if((opt.fsType == FM_FAT32) && (bytes < ((uint64_t)opt.clusterSize * SIM_FAT32_CLUSTERS))){
+		bytes = (uint64_t)opt.clusterSize * SIM_FAT32_CLUSTERS;
+	}
+
+	simDisk_setTiming(0, 0);
+	if(!simDisk_create((uint32_t)(bytes / opt.sectorSize), opt.sectorSize) ||
+	   (FATFS_LinkDriver(&SimDisk_Driver, USBHPath) != 0) ||
+	   (f_mkfs(USBHPath, opt.fsType, opt.clusterSize, simWork, sizeof(simWork)) != FR_OK) ||
+	   (f_mount(&USBHFatFS, USBHPath, 1) != FR_OK) ||
+	   (f_open(&fp, opt.trackName, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK))
+	{
+		fprintf(stderr, "sim: can not create the volume\n");
+		if(src != NULL){
+			fclose(src);
+		}
+		return false;
+	}
+	ok = (src != NULL) ? sim_copy_file(&fp, src) : sim_write_tone(&fp);
+	ok = (f_close(&fp) == FR_OK) && ok;
+	if(src != NULL){
+		fclose(src);
+	}
+	if(!ok){
+		fprintf(stderr, "sim: can not write the track\n");
+	}
+	else if((opt.savePath != NULL) && !simDisk_save(opt.savePath))
+	{
+		fprintf(stderr, "sim: can not save the image %s\n", opt.savePath);
+		ok = false;
+	}
+	return ok;
+}
+
+/**
+ * @brief Pick the track from the library of the mounted volume
+ * @param path - The path of the track
+ * @param len - The size of path
+ * @note The RAM disk track is looked up this way too, so its name is
+ * matched and its path built as the board does it.
+ */
+static bool sim_library_path(char *path, uint32_t len)
+{
+	if(!wavLib_mount()){
+		while(wavLib_process(SIM_SCAN_BUDGET_US));
+	}
+	if(!wavLib_path(opt.track, path, len))
+	{
+		fprintf(stderr, "sim: the volume holds %lu tracks, no track %lu\n",
+				(unsigned long)wavLib_count(), (unsigned long)opt.track);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Set the step limit of the resume check from the track
+ * @note The steps are taken between items two apart, the same channel of
+ * a stereo file as the I2S plays it. A fade only adds a little to the
+ * steps of the file, a jump of the gain or a dropped piece of the song
+ * adds a step of the size of the audio.
+ */
+static void sim_resume_limit(void)
+{
+	const int16_t *data = (const int16_t *)content.data;
+	uint32_t i, count = content.size / sizeof(int16_t);
+	int32_t step, maxStep = 0;
+
+	for(i = 2; i < count; i++)
+	{
+		step = abs(data[i] - data[i - 2]);
+		maxStep = (step > maxStep) ? step : maxStep;
+	}
+	resume.limit = maxStep + (maxStep / 4) + 2;
+}
+
+/**
+ * @brief Keep the sample data of the track for the content check
+ * @param path - The path of the track
+ * @note Read straight from the simulated disk before the play starts, so
+ * the check does not depend on the read path it checks.
+ */
+static void sim_content_load(const char *path)
+{
+	//f_open of FatFs R0.12c leaves the exFAT fragment count of a file
+	//opened for reading alone, the file object has to start zeroed
+	static FIL fp;
+	wavLib_format_t fmt;
+	UINT br;
+
+	if(f_open(&fp, path, FA_READ) != FR_OK){
+		return;
+	}
+	if(wavLib_parseHeader(&fp, &fmt) && (fmt.blockAlign != 0) &&
+	   (f_lseek(&fp, fmt.dataOffset) == FR_OK) &&
+	   ((content.data = malloc(fmt.dataSize + 1)) != NULL))
+	{
+		if((f_read(&fp, content.data, fmt.dataSize, &br) == FR_OK) && (br == fmt.dataSize))
+		{
+			content.size = fmt.dataSize;
+			content.blockAlign = fmt.blockAlign;
+			sim_resume_limit();
+		}
+		else
+		{
+			free(content.data);
+			content.data = NULL;
+		}
+	}
+	content.nextSample = UINT32_MAX;
+	f_close(&fp);
+}
+
+/**
+ * @brief Mount an image file and pick the track from its library
+ * @param path - The path of the track
+ * @param len - The size of path
+ */
+static bool sim_image_init(char *path, uint32_t len)
+{
+	if(!simDisk_open(opt.imagePath, opt.sectorSize) ||
+	   (FATFS_LinkDriver(&SimDisk_Driver, USBHPath) != 0) ||
+	   (f_mount(&USBHFatFS, USBHPath, 1) != FR_OK))
+	{
+		fprintf(stderr, "sim: can not mount the image %s\n", opt.imagePath);
+		return false;
+	}
+	return sim_library_path(path, len);
+}
+
+/**
+ * @brief Move the volume behind the simulated USB stick
+ * @note The sectors stay where they are, the drive is linked to the USB
+ * disk layer once the host has enumerated the stick and its MSC class is
+ * ready, as the APPLICATION_READY branch of main() does.
+ */
+static bool sim_usb_init(void)
+{
+	uint64_t timeout = simHal_now() + (SIM_USB_READY_MS * SIM_NS_PER_MS);
+
+	f_mount(NULL, USBHPath, 0);
+	FATFS_UnLinkDriver(USBHPath);
+
+	simUsb_configure(&opt.usbCfg);
+	simUsb_attach();
+	MX_USB_HOST_Init();
+	while((Appli_state != APPLICATION_READY) && (simHal_now() < timeout)){
+		simHal_advance(opt.loopNs);
+	}
+	if(Appli_state != APPLICATION_READY)
+	{
+		fprintf(stderr, "sim: the USB stick did not enumerate\n");
+		return false;
+	}
+	if((FATFS_LinkDriver(&USBH_Driver, USBHPath) != 0) ||
+	   (f_mount(&USBHFatFS, USBHPath, 1) != FR_OK))
+	{
+		fprintf(stderr, "sim: can not mount the USB stick\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Print a record of the trace
+ */
+static void sim_trace(const simHal_record_t *rec)
+{
+	uint8_t i;
+
+	printf("%12.6f ms  ", (double)rec->timeNs / SIM_NS_PER_MS);
+	switch(rec->type)
+	{
+	case SIM_REC_I2C_WRITE:
+	case SIM_REC_I2C_READ:
+		printf("I2C %c %02X%s", (rec->type == SIM_REC_I2C_READ) ? 'R' : 'W',
+				rec->addr, rec->status ? " NACK" : ":");
+		for(i = 0; (i < rec->len) && (i < SIM_RECORD_DATA); i++){
+			printf(" %02X", rec->data[i]);
+		}
+		printf("\n");
+		break;
+	case SIM_REC_GPIO:
+		printf("GPIO%c %04X=%u\n", 'A' + rec->addr, rec->pin, rec->status);
+		break;
+	case SIM_REC_DMA_HALF:
+	case SIM_REC_DMA_FULL:
+		printf("DMA %s\n", (rec->type == SIM_REC_DMA_HALF) ? "half" : "full");
+		break;
+	}
+}
+
+/**
+ * @brief Count a half that failed the content check
+ */
+static void sim_content_bad(uint32_t *counter, uint64_t timeNs)
+{
+	if((content.differ + content.jumps + content.rewritten) == 0){
+		content.firstBadNs = timeNs;
+	}
+	(*counter)++;
+}
+
+/**
+ * @brief Check the ring half the DMA has finished and the one it enters
+ * @note Runs in the simulated DMA interrupt, before the player's callback.
+ * The half the DMA enters has to hold the file data from the sample the
+ * player reports for the DMA position on, silence past the end of the
+ * data, and the half the DMA finished has to be what the DMA found when
+ * it entered it. The halves around a pause and a resume are faded or
+ * silenced on purpose and left out.
+ */
+static void sim_content_check(const simHal_record_t *rec)
+{
+	uint32_t halfBytes = hi2s3.TxXferSize;	/* DMA items of the ring, 2 bytes each */
+	uint32_t halfItems = halfBytes / 2;
+	uint8_t entered = (rec->type == SIM_REC_DMA_HALF) ? 1 : 0;
+	uint8_t *ring = (uint8_t *)hi2s3.pTxBuffPtr;
+	uint8_t *half = ring + (entered * halfBytes);
+	uint32_t into, sample, offset, len, i;
+
+	if((content.data == NULL) || (halfBytes > SIM_HALF_MAX)){
+		return;
+	}
+	if(content.taken &&
+	   (memcmp(ring + ((entered ^ 1) * halfBytes), content.snap, halfBytes) != 0))
+	{
+		sim_content_bad(&content.rewritten, rec->timeNs);
+	}
+	memcpy(content.snap, half, halfBytes);
+	content.taken = !audio.paused;
+	if(audio.paused || content.settle)
+	{
+		content.settle = audio.paused;
+		content.nextSample = UINT32_MAX;
+		return;
+	}
+
+	//The interrupt may be taken a few items past the boundary
+	into = ((hi2s3.TxXferSize - simHal_dmaCounter(&hdma_spi3_tx)) % hi2s3.TxXferSize) -
+			(entered * halfItems);
+	sample = wavPlayer_getPositionSamples() - (into / (content.blockAlign / 2));
+	if((content.nextSample != UINT32_MAX) && (sample != content.nextSample)){
+		sim_content_bad(&content.jumps, rec->timeNs);
+	}
+	content.nextSample = sample + (halfBytes / content.blockAlign);
+	content.halves++;
+
+	offset = sample * content.blockAlign;
+	len = (offset < content.size) ? (content.size - offset) : 0;
+	len = (len < halfBytes) ? len : halfBytes;
+	if(memcmp(half, content.data + offset, len) != 0)
+	{
+		sim_content_bad(&content.differ, rec->timeNs);
+		return;
+	}
+	for(i = len; i < halfBytes; i++)
+	{
+		if(half[i] != 0)
+		{
+			sim_content_bad(&content.differ, rec->timeNs);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief The tap of the audio the I2S reads
+ * @note From the pause to one ring after the resume every step between two
+ * samples of a channel has to stay within the steps of the file: the
+ * fade-out, the silence and the fade-in around a resume must not click.
+ */
+static void sim_resume_tap(const int16_t *items, uint32_t count)
+{
+	uint32_t i, ch;
+	int32_t step;
+
+	for(i = 0; i < count; i++, resume.items++)
+	{
+		ch = resume.items & 1;
+		step = abs(items[i] - resume.last[ch]);
+		resume.last[ch] = items[i];
+		if((resume.window == 0) || (resume.limit == 0)){
+			continue;
+		}
+		if(resume.window != UINT32_MAX){
+			resume.window--;
+		}
+		resume.maxStep = (step > resume.maxStep) ? step : resume.maxStep;
+		if(step > resume.limit)
+		{
+			if(resume.clicks == 0){
+				resume.firstClickNs = simHal_now();
+			}
+			resume.clicks++;
+		}
+	}
+}
+
+/**
+ * @brief The observer of the simulated board
+ * @note Runs in the simulated DMA interrupt for the DMA records.
+ */
+static void sim_observe(const simHal_record_t *rec)
+{
+	if(opt.trace && ((rec->type != SIM_REC_GPIO) || opt.traceGpio)){
+		sim_trace(rec);
+	}
+	if((rec->type != SIM_REC_DMA_HALF) && (rec->type != SIM_REC_DMA_FULL)){
+		return;
+	}
+	sim_content_check(rec);
+	if(audio.paused){
+		return;
+	}
+
+	if(audio.waiting)
+	{
+		if(audio.underruns == 0){
+			audio.firstUnderrunNs = rec->timeNs;
+		}
+		audio.underruns++;
+		if(opt.trace){
+			printf("%12.6f ms  UNDERRUN\n", (double)rec->timeNs / SIM_NS_PER_MS);
+		}
+	}
+	audio.waiting = true;
+	audio.requests++;
+	audio.requestNs = rec->timeNs;
+	audio.dueNs = simHal_dmaNextEvent();
+}
+
+/**
+ * @brief Account for a refill that was completed
+ */
+static void sim_refill_check(void)
+{
+	uint64_t now = simHal_now();
+	uint64_t took;
+	int64_t slack;
+
+	if(!audio.waiting || wavPlayer_refillPending()){
+		return;
+	}
+	audio.waiting = false;
+	if(audio.dueNs == SIM_NEVER){
+		return;
+	}
+	took = now - audio.requestNs;
+	slack = (int64_t)(audio.dueNs - now);
+	if((audio.refills == 0) || (slack < audio.minSlackNs)){
+		audio.minSlackNs = slack;
+	}
+	if((audio.refills == 0) || (took < audio.minRefillNs)){
+		audio.minRefillNs = took;
+	}
+	if(took > audio.maxRefillNs){
+		audio.maxRefillNs = took;
+	}
+	audio.sumSlackNs += slack;
+	audio.sumRefillNs += took;
+	audio.refills++;
+}
+
+/**
+ * @brief Pause and resume at the scripted times
+ * @param playMs - The simulated time since the play started
+ */
+static void sim_script(uint64_t playMs)
+{
+	if((opt.pauseAtMs != 0) && !audio.paused && (playMs >= opt.pauseAtMs) &&
+	   (playMs < opt.resumeAtMs))
+	{
+		audio.paused = true;
+		audio.waiting = false;
+		content.taken = false;
+		resume.window = UINT32_MAX;
+		wavPlayer_pause();
+	}
+	else if(audio.paused && (playMs >= opt.resumeAtMs))
+	{
+		wavPlayer_resume();
+		audio.paused = false;
+		content.taken = false;
+		content.settle = true;
+		resume.window = hi2s3.TxXferSize;
+		resume.resumes++;
+		opt.pauseAtMs = 0;
+	}
+}
+
+/**
+ * @brief The name of the track for the report
+ */
+static const char *sim_track_name(void)
+{
+	if(opt.imagePath != NULL){
+		return wavLib_title(opt.track);
+	}
+	return (opt.wavPath != NULL) ? opt.wavPath : "tone";
+}
+
+/**
+ * @brief Print a line of the profile
+ */
+static void sim_print_line(const char *line)
+{
+	printf("%s\n", line);
+}
+
+/**
+ * @brief Print the results of the run
+ */
+static void sim_report(uint64_t playNs, double hostMs)
+{
+	simHal_stats_t hal;
+	simDisk_stats_t disk;
+	wavPlayer_telemetry_t tele;
+	uint8_t i;
+
+	simHal_getStats(&hal);
+	simDisk_getStats(&disk);
+	wavPlayer_getTelemetry(&tele);
+	printf("track      : %s, %lu Hz, %lu ms, %s\n", sim_track_name(),
+			(unsigned long)wavPlayer_getSampleRate(), (unsigned long)wavPlayer_getDurationMs(),
+			opt.zeroCopy ? "zero-copy" : "copied");
+	printf("file       : %s, \"%s\"\n", trackPath, wavLib_title(opt.track));
+	printf("disk       : %u B sectors, %lu B clusters, %lu us/cmd, %lu kB/s\n", opt.sectorSize,
+			(unsigned long)opt.clusterSize, (unsigned long)opt.cmdUs, (unsigned long)opt.kBps);
+	printf("played     : %.1f ms, simulated in %.1f ms\n", (double)playNs / SIM_NS_PER_MS, hostMs);
+	printf("refills    : %lu of %lu done, %lu underruns",
+			(unsigned long)audio.refills, (unsigned long)audio.requests,
+			(unsigned long)audio.underruns);
+	if(audio.underruns != 0){
+		printf(", first at %.3f ms", (double)audio.firstUnderrunNs / SIM_NS_PER_MS);
+	}
+	printf("\n");
+	if(audio.refills != 0)
+	{
+		printf("refill time: min %.1f avg %.1f max %.1f us\n",
+				(double)audio.minRefillNs / SIM_NS_PER_US,
+				(double)audio.sumRefillNs / audio.refills / SIM_NS_PER_US,
+				(double)audio.maxRefillNs / SIM_NS_PER_US);
+		printf("slack      : min %.1f avg %.1f us\n",
+				(double)audio.minSlackNs / SIM_NS_PER_US,
+				(double)audio.sumSlackNs / audio.refills / SIM_NS_PER_US);
+	}
+	if(content.data != NULL)
+	{
+		printf("content    : %lu halves checked, %lu differ from the file, %lu out of order, "
+				"%lu written while played", (unsigned long)content.halves,
+				(unsigned long)content.differ, (unsigned long)content.jumps,
+				(unsigned long)content.rewritten);
+		if((content.differ + content.jumps + content.rewritten) != 0){
+			printf(", first at %.3f ms", (double)content.firstBadNs / SIM_NS_PER_MS);
+		}
+		printf("\n");
+	}
+	if((content.data != NULL) && (resume.resumes != 0))
+	{
+		printf("resume     : %lu checked, largest step %ld of %ld allowed, %lu clicks",
+				(unsigned long)resume.resumes, (long)resume.maxStep, (long)resume.limit,
+				(unsigned long)resume.clicks);
+		if(resume.clicks != 0){
+			printf(", first at %.3f ms", (double)resume.firstClickNs / SIM_NS_PER_MS);
+		}
+		printf("\n");
+	}
+	printf("telemetry  : fill min %lu avg %lu B, slack min %ld avg %ld us, %lu underruns\n",
+			(unsigned long)tele.minFillBytes, (unsigned long)tele.avgFillBytes,
+			(long)tele.minSlackUs, (long)tele.avgSlackUs, (unsigned long)tele.trackUnderruns);
+	printf("disk reads : %lu commands, %lu sectors, longest %.1f us\n",
+			(unsigned long)disk.reads, (unsigned long)disk.sectorsRead,
+			(double)disk.maxCmdNs / SIM_NS_PER_US);
+	if(disk.reads != 0)
+	{
+		printf("read order : %.1f%% sequential, %.1f%% of the sectors read again, %lu stalls\n",
+				(100.0 * disk.seqReads) / disk.reads,
+				(100.0 * disk.rereadSectors) / disk.sectorsRead, (unsigned long)disk.stalls);
+		printf("cmd time   :");
+		for(i = 0; i < SIM_DISK_HIST_BINS; i++)
+		{
+			if(i < (SIM_DISK_HIST_BINS - 1)){
+				printf(" <%lu:%lu", (unsigned long)SIM_DISK_HIST_BASE_US << i, (unsigned long)disk.hist[i]);
+			}
+			else{
+				printf(" more:%lu", (unsigned long)disk.hist[i]);
+			}
+		}
+		printf(" (us:commands)\n");
+	}
+	if(opt.usb)
+	{
+		simUsb_stats_t usb;
+		USBH_CacheStatsTypeDef cache;
+
+		simUsb_getStats(&usb);
+		USBH_CacheGetStats(&cache);
+		printf("usb        : %lu URBs, %lu packets, %.1f ms on the bus, %lu SOFs\n",
+				(unsigned long)usb.urbs, (unsigned long)usb.packets,
+				(double)usb.busNs / SIM_NS_PER_MS, (unsigned long)usb.sofs);
+		printf("usb cmds   : %lu CBWs, %lu READ10, %lu WRITE10, %lu failed, %lu control\n",
+				(unsigned long)usb.cbws, (unsigned long)usb.read10,
+				(unsigned long)usb.write10, (unsigned long)usb.failedCmds,
+				(unsigned long)usb.ctrlRequests);
+		printf("usb faults : %lu NAKs, %lu STALLs, %lu halts cleared, %lu BOT resets\n",
+				(unsigned long)usb.naks, (unsigned long)usb.stalls,
+				(unsigned long)usb.clearHalts, (unsigned long)usb.botResets);
+		if(usb.gaps != 0)
+		{
+			printf("usb gaps   : avg %.1f max %.1f us from a CSW to the next CBW\n",
+					(double)usb.gapNs / usb.gaps / SIM_NS_PER_US,
+					(double)usb.maxGapNs / SIM_NS_PER_US);
+		}
+		printf("usb cpu    : %.1f ms in the OTG interrupt, %lu PendSV passes, %.1f ms in PendSV\n",
+				(double)usb.irqNs / SIM_NS_PER_MS, (unsigned long)hal.pendSvRuns,
+				(double)hal.pendSvNs / SIM_NS_PER_MS);
+		printf("disk layer : %lu cache hits, %lu misses, %lu bypassed, %lu read ahead, "
+				"%lu served, %lu pipelined, chunk %lu, %lu retries\n",
+				(unsigned long)cache.hits, (unsigned long)cache.misses,
+				(unsigned long)cache.bypassed, (unsigned long)cache.prefetched,
+				(unsigned long)cache.prefetchHits, (unsigned long)cache.pipelined,
+				(unsigned long)cache.prefetchChunk, (unsigned long)cache.retries);
+	}
+	printf("i2c        : %lu writes, %lu reads, %lu bytes, %lu NACKs, %.1f ms on the bus\n",
+			(unsigned long)hal.i2cWrites, (unsigned long)hal.i2cReads,
+			(unsigned long)hal.i2cBytes, (unsigned long)hal.i2cNacks,
+			(double)hal.i2cBusyNs / SIM_NS_PER_MS);
+	printf("gpio       : %lu writes\n", (unsigned long)hal.gpioWrites);
+	printf("interrupts : %lu DMA, %lu taken late\n",
+			(unsigned long)hal.dmaEvents, (unsigned long)hal.irqDeferred);
+	printf("sleep      : %lu WFI, %.1f ms asleep\n",
+			(unsigned long)hal.sleeps, (double)hal.sleepNs / SIM_NS_PER_MS);
+	printf("irq latency: max %.1f us DMA, %.1f us OTG, %.1f us SysTick, %.1f us I2C\n",
+			(double)hal.irqMaxLatencyNs[SIM_IRQ_DMA1_STREAM5] / SIM_NS_PER_US,
+			(double)hal.irqMaxLatencyNs[SIM_IRQ_OTG_FS] / SIM_NS_PER_US,
+			(double)hal.irqMaxLatencyNs[SIM_IRQ_SYSTICK] / SIM_NS_PER_US,
+			(double)hal.irqMaxLatencyNs[SIM_IRQ_I2C1_EV] / SIM_NS_PER_US);
+	profile_report(sim_print_line);
+	sched_report(sim_print_line);
+}
+
+/**
+ * @brief Store the event trace ring as the debugger would dump it
+ */
+static void sim_trace_dump(void)
+{
+#if TRACE_ENABLE
+	FILE *fp;
+
+	if(opt.dumpPath == NULL){
+		return;
+	}
+	fp = fopen(opt.dumpPath, "wb");
+	if((fp == NULL) || (fwrite(&traceLog, sizeof(traceLog), 1, fp) != 1)){
+		fprintf(stderr, "sim: can not store the trace %s\n", opt.dumpPath);
+	}
+	if(fp != NULL){
+		fclose(fp);
+	}
+#else
+	if(opt.dumpPath != NULL){
+		fprintf(stderr, "sim: built without the event trace\n");
+	}
+#endif
+}
+
+/**
+ * @brief The host time in milliseconds
+ */
+static double sim_host_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1e6);
+}
+
+/**
+ * @brief Print the usage
+ */
+static void sim_usage(const char *prog)
+{
+	printf("usage: %s [options]\n"
+		"  --wav FILE         play a host WAV file instead of a tone\n"
+		"  --seconds N        tone length (10)\n"
+		"  --rate HZ          tone sample rate (44100)\n"
+		"  --mono             mono tone\n"
+		"  --name NAME        file name of the track on the RAM disk (%s)\n"
+		"  --image FILE       play from a FAT image file instead of the RAM disk\n"
+		"  --track N          library index of the track on the image (0)\n"
+		"  --save-image FILE  store the RAM disk volume as an image file\n"
+		"  --sector-size N    disk sector size, 512 to 4096 (512)\n"
+		"  --cluster N        cluster size in bytes, 0 for the FatFs default (32768)\n"
+		"  --exfat            format the volume as exFAT instead of FAT32\n"
+		"  --cmd-us N         disk command time in us (%u)\n"
+		"  --kbps N           disk throughput in kB/s, 0 for no transfer time (%u)\n"
+		"  --jitter-us N      random extra time of 0 to N us per command\n"
+		"  --seed N           seed of the jitter and the stalls (1)\n"
+		"  --stall-every N    stall once in N commands on average\n"
+		"  --stall-ms N       time of a stall in ms\n"
+		"  --latency-trace F  replay the command times of a trace file\n"
+		"  --usb              read through the USB host and a simulated stick\n"
+		"  --usb-nak-permille N  bulk transfers hitting a NAK burst, per mille\n"
+		"  --usb-nak-us N     length of a NAK burst in us (2000)\n"
+		"  --usb-error-every N  fail one READ10 in N with MEDIUM ERROR on average\n"
+		"  --usb-not-ready N  fail the first N TEST UNIT READY with UNIT ATTENTION\n"
+		"  --loop-us N        CPU time of a main loop pass in us (%u)\n"
+		"  --no-zero-copy     copy through the FatFs sector buffer\n"
+		"  --pause-at MS      pause after MS of playing\n"
+		"  --resume-at MS     resume after MS\n"
+		"  --trace            print the I2C and DMA events\n"
+		"  --trace-gpio       print the GPIO writes as well\n"
+		"  --trace-dump FILE  store the event trace ring for Tools/trace_decode.py\n"
+		"  --strict           exit with %d on an underrun, %d on audio that is not the file's\n"
+		"                     or that clicks around a resume\n"
+		"exits with %d when the track does not end in time\n",
+		prog, SIM_TRACK_NAME, SIM_DISK_CMD_US, SIM_DISK_KBPS, SIM_LOOP_NS / 1000, SIM_EXIT_UNDERRUN,
+		SIM_EXIT_CONTENT, SIM_EXIT_STUCK);
+}
+
+/**
+ * @brief Parse the command line
+ */
+static bool sim_parse(int argc, char **argv)
+{
+	static const struct option longOpts[] =
+	{
+		{"wav",          required_argument, NULL, 'w'},
+		{"seconds",      required_argument, NULL, 's'},
+		{"rate",         required_argument, NULL, 'r'},
+		{"mono",         no_argument,       NULL, 'm'},
+		{"name",         required_argument, NULL, 'n'},
+		{"image",        required_argument, NULL, 'i'},
+		{"track",        required_argument, NULL, 'T'},
+		{"save-image",   required_argument, NULL, 'o'},
+		{"sector-size",  required_argument, NULL, 'S'},
+		{"cluster",      required_argument, NULL, 'C'},
+		{"exfat",        no_argument,       NULL, 'x'},
+		{"cmd-us",       required_argument, NULL, 'c'},
+		{"kbps",         required_argument, NULL, 'k'},
+		{"jitter-us",    required_argument, NULL, 'j'},
+		{"seed",         required_argument, NULL, 'D'},
+		{"stall-every",  required_argument, NULL, 'E'},
+		{"stall-ms",     required_argument, NULL, 'M'},
+		{"latency-trace",required_argument, NULL, 'L'},
+		{"usb",          no_argument,       NULL, 'u'},
+		{"usb-nak-permille", required_argument, NULL, 'N'},
+		{"usb-nak-us",   required_argument, NULL, 'B'},
+		{"usb-error-every", required_argument, NULL, 'X'},
+		{"usb-not-ready",required_argument, NULL, 'U'},
+		{"loop-us",      required_argument, NULL, 'l'},
+		{"no-zero-copy", no_argument,       NULL, 'z'},
+		{"pause-at",     required_argument, NULL, 'p'},
+		{"resume-at",    required_argument, NULL, 'R'},
+		{"trace",        no_argument,       NULL, 't'},
+		{"trace-gpio",   no_argument,       NULL, 'g'},
+		{"trace-dump",   required_argument, NULL, 'Y'},
+		{"strict",       no_argument,       NULL, 'e'},
+		{"help",         no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int c;
+
+	while((c = getopt_long(argc, argv, "h", longOpts, NULL)) != -1)
+	{
+		switch(c)
+		{
+		case 'w': opt.wavPath = optarg; break;
+		case 's': opt.seconds = strtoul(optarg, NULL, 0); break;
+		case 'r': opt.rate = strtoul(optarg, NULL, 0); break;
+		case 'm': opt.channels = 1; break;
+		case 'n': opt.trackName = optarg; break;
+		case 'i': opt.imagePath = optarg; break;
+		case 'T': opt.track = strtoul(optarg, NULL, 0); break;
+		case 'o': opt.savePath = optarg; break;
+		case 'S': opt.sectorSize = (uint16_t)strtoul(optarg, NULL, 0); break;
+		case 'C': opt.clusterSize = strtoul(optarg, NULL, 0); break;
+		case 'x': opt.fsType = FM_EXFAT; break;
+		case 'c': opt.cmdUs = strtoul(optarg, NULL, 0); break;
+		case 'k': opt.kBps = strtoul(optarg, NULL, 0); break;
+		case 'j': opt.jitterUs = strtoul(optarg, NULL, 0); break;
+		case 'D': opt.seed = strtoul(optarg, NULL, 0); break;
+		case 'E': opt.stallEvery = strtoul(optarg, NULL, 0); break;
+		case 'M': opt.stallMs = strtoul(optarg, NULL, 0); break;
+		case 'L': opt.tracePath = optarg; break;
+		case 'u': opt.usb = true; break;
+		case 'N': opt.usbCfg.nakPerMille = strtoul(optarg, NULL, 0); break;
+		case 'B': opt.usbCfg.nakBurstUs = strtoul(optarg, NULL, 0); break;
+		case 'X': opt.usbCfg.errorEvery = strtoul(optarg, NULL, 0); break;
+		case 'U': opt.usbCfg.notReadyTurs = strtoul(optarg, NULL, 0); break;
+		case 'l': opt.loopNs = strtoul(optarg, NULL, 0) * 1000; break;
+		case 'z': opt.zeroCopy = false; break;
+		case 'p': opt.pauseAtMs = strtoul(optarg, NULL, 0); break;
+		case 'R': opt.resumeAtMs = strtoul(optarg, NULL, 0); break;
+		case 't': opt.trace = true; break;
+		case 'g': opt.trace = true; opt.traceGpio = true; break;
+		case 'Y': opt.dumpPath = optarg; break;
+		case 'e': opt.strict = true; break;
+		default:
+			sim_usage(argv[0]);
+			return false;
+		}
+	}
+	if((opt.pauseAtMs != 0) && (opt.resumeAtMs <= opt.pauseAtMs)){
+		opt.resumeAtMs = opt.pauseAtMs + 1000;
+	}
+	opt.usbCfg.seed = opt.seed;
+	return true;
+}
+
+/***************************************
+* Public Function Definition
+****************************************/
+
+/**
+ * @brief The error handler of the CubeMX code, as main.c has it
+ */
+void Error_Handler(void)
+{
+	fprintf(stderr, "sim: Error_Handler called\n");
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief The entry of the simulation
+ */
+int main(int argc, char **argv)
+{
+	uint64_t playStart;
+	uint64_t playLimit;
+	double hostStart;
+	bool ran;
+
+	if(!sim_parse(argc, argv)){
+		return EXIT_FAILURE;
+	}
+
+	HAL_Init();
+	sim_board_init();
+	if(opt.imagePath != NULL)
+	{
+		if(!sim_image_init(trackPath, sizeof(trackPath))){
+			return EXIT_FAILURE;
+		}
+	}
+	else if(!sim_volume_init() || !sim_library_path(trackPath, sizeof(trackPath))){
+		return EXIT_FAILURE;
+	}
+	sim_content_load(trackPath);
+	if((opt.tracePath != NULL) && !simDisk_loadTrace(opt.tracePath))
+	{
+		fprintf(stderr, "sim: can not load the latency trace %s\n", opt.tracePath);
+		return EXIT_FAILURE;
+	}
+	simDisk_setTiming(opt.cmdUs, opt.kBps);
+	simDisk_setJitter(opt.jitterUs, opt.seed);
+	simDisk_setStalls(opt.stallEvery, opt.stallMs * 1000);
+	trace_init();
+	if(opt.usb && !sim_usb_init()){
+		return EXIT_FAILURE;
+	}
+	simDisk_clearStats();
+	simUsb_clearStats();
+	profile_init();
+	simHal_setObserver(sim_observe);
+	simHal_setTap(sim_resume_tap);
+
+	lcd_init();
+	lcdUi_init();
+	CS43_init(&hi2c1);
+	wavPlayer_reset();
+	wavPlayer_setVolume(SIM_DEFAULT_VOLUME);
+	wavPlayer_setZeroCopy(opt.zeroCopy);
+
+	if(!wavPlayer_openFile(trackPath))
+	{
+		fprintf(stderr, "sim: %s is not a playable WAV file\n", sim_track_name());
+		return EXIT_FAILURE;
+	}
+	lcdUi_setTitle(wavLib_title(opt.track));
+
+	hostStart = sim_host_ms();
+	playStart = simHal_now();
+	playLimit = (uint64_t)wavPlayer_getDurationMs() + SIM_STUCK_MS;
+	if(opt.pauseAtMs != 0){
+		playLimit += opt.resumeAtMs - opt.pauseAtMs;
+	}
+	playLimit = playStart + (playLimit * SIM_NS_PER_MS);
+	sched_init(simTasks, sizeof(simTasks) / sizeof(simTasks[0]));
+	wavPlayer_play();
+	while(!is_wavPlayer_finished_Playing())
+	{
+		//A player that lost its file never finishes, e.g. after a read error
+		if(simHal_now() > playLimit)
+		{
+			sim_report(simHal_now() - playStart, sim_host_ms() - hostStart);
+			sim_trace_dump();
+			fprintf(stderr, "sim: the player is stuck\n");
+			return SIM_EXIT_STUCK;
+		}
+		ran = sched_run();
+		sim_refill_check();
+		sim_script((simHal_now() - playStart) / SIM_NS_PER_MS);
+		if(!ran){
+			sched_idle();
+		}
+		simHal_advance(opt.loopNs);
+	}
+
+	sim_report(simHal_now() - playStart, sim_host_ms() - hostStart);
+	sim_trace_dump();
+	if(opt.strict && (audio.underruns != 0)){
+		return SIM_EXIT_UNDERRUN;
+	}
+	if(opt.strict && ((content.differ + content.jumps + content.rewritten + resume.clicks) != 0)){
+		return SIM_EXIT_CONTENT;
+	}
+	return EXIT_SUCCESS;
+}
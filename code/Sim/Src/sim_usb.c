@@ -0,0 +1,1027 @@
+/*
+ * sim_usb.c
+ *
+ * @description: The implementation file of the simulated USB host port of
+ * the host simulation build.
+ *
+ * @note The port keeps one URB per pipe in flight as the HCD does. A
+ * submitted URB gets its outcome and the time it ends on the bus at once,
+ * the OTG_FS interrupt is scheduled for the earliest such time and hands
+ * the outcome to the host: the URB state, the transfer count and, for an
+ * IN URB, the data. The interrupt costs SIM_USB_FIFO_NS of CPU time per
+ * packet, the time the real handler spends moving the FIFO.
+ *
+ * @note The stick answers a READ10 as a stick streaming from its flash:
+ * the command takes the time of the latency model, the sectors come out
+ * at the throughput of the model towards its end, so an IN URB ends when
+ * both the bus and the media got that far. Between commands the stick
+ * idles, the gap from a CSW to the next CBW is what pipelining the
+ * commands can win back.
+ *
+ * @note Faults follow the Bulk-Only Transport specification: a failed
+ * command with a data stage STALLs it, the host clears the halt, reads a
+ * CSW with command failed and asks REQUEST SENSE for the reason. A NAK
+ * burst makes the stick NAK every bulk token for its duration: an OUT
+ * URB ends NOTREADY after one NAK and the host resends it, an IN URB is
+ * retried by the controller until the burst is over.
+ *
+ * @reference:
+ * 1.USB Mass Storage Class Bulk-Only Transport Rev 1.0
+ * 2.SCSI Primary Commands, SCSI Block Commands
+ * 3.UM1720 STM32Cube USB host library
+ *
+ * @Author: Shuran Xu
+ *
+ * @Revision: 1.0
+ *
+ * @Date 2026-10-18
+ */
+
+#include "sim_usb.h"
+#include "sim_disk.h"
+#include "usb_host.h"
+#include "usbh_core.h"
+#include "usbh_msc_bot.h"
+#include "usbh_msc_scsi.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+/***************************************
+* Local Macro Definition
+****************************************/
+#define SIM_USB_MPS				64		/* EP0 and bulk max packet size */
+#define SIM_USB_EP_IN			0x81
+#define SIM_USB_EP_OUT			0x02
+#define SIM_USB_SOF_NS			SIM_NS_PER_MS
+#define SIM_USB_SENSE_LEN		18
+#define SIM_USB_RESP_MAX		64
+
+#define SIM_USB_REQ_STANDARD	0x00	/* bmRequestType, host to device */
+#define SIM_USB_REQ_ENDPOINT	0x02
+#define SIM_USB_REQ_GET			0x80
+#define SIM_USB_REQ_CLASS_OUT	0x21
+#define SIM_USB_REQ_CLASS_IN	0xA1
+
+/***************************************
+* Local Type Definition
+****************************************/
+// Stages of the Bulk-Only Transport on the device side
+typedef enum
+{
+	SIM_BOT_CBW = 0,
+	SIM_BOT_DATA_IN,
+	SIM_BOT_DATA_OUT,
+	SIM_BOT_CSW,
+}simUsb_botState_t;
+
+// What the device does with a URB once it is on the bus
+typedef enum
+{
+	SIM_ACT_NONE = 0,
+	SIM_ACT_CTRL_IN,
+	SIM_ACT_CBW,
+	SIM_ACT_DATA_IN,
+	SIM_ACT_DATA_OUT,
+	SIM_ACT_CSW,
+}simUsb_action_t;
+
+// A host channel with its URB in flight
+typedef struct
+{
+	uint8_t epAddr;
+	uint8_t toggleIn;
+	uint8_t toggleOut;
+	USBH_URBStateTypeDef urb;	/* state the host sees */
+	uint32_t xferCount;
+	bool busy;
+	uint64_t doneAt;
+	USBH_URBStateTypeDef result;
+	simUsb_action_t action;
+	uint8_t *buf;
+	uint32_t count;
+	uint32_t packets;
+}simUsb_pipe_t;
+
+// The command the stick works on
+typedef struct
+{
+	simUsb_botState_t state;
+	uint32_t tag;
+	uint32_t hostLen;		/* dCBWDataTransferLength */
+	uint32_t devLen;		/* bytes the stick moves in the data stage */
+	uint32_t offset;		/* bytes moved so far */
+	uint8_t opcode;
+	DWORD lba;
+	UINT blocks;
+	bool failed;
+	uint64_t cmdAt;			/* the CBW came in */
+	uint64_t mediaNs;		/* media time of a READ10 or WRITE10 */
+	uint64_t cswAt;			/* the CSW is ready */
+	uint8_t resp[SIM_USB_RESP_MAX];
+}simUsb_bot_t;
+
+/***************************************
+* Local Variable Definition
+****************************************/
+static const uint8_t devDesc[USB_DEVICE_DESC_SIZE] =
+{
+	0x12, USB_DESC_TYPE_DEVICE, 0x00, 0x02,	/* USB 2.0 */
+	0x00, 0x00, 0x00, SIM_USB_MPS,			/* class per interface */
+	0x09, 0x12, 0x01, 0x00,					/* VID 0x1209, PID 0x0001 */
+	0x00, 0x01, 0x01, 0x02, 0x03, 0x01		/* bcdDevice 1.00, strings, 1 config */
+};
+
+static const uint8_t cfgDesc[32] =
+{
+	0x09, USB_DESC_TYPE_CONFIGURATION, 32, 0x00, 0x01, 0x01, 0x00, 0x80, 50,
+	0x09, USB_DESC_TYPE_INTERFACE, 0x00, 0x00, 0x02,
+	USB_MSC_CLASS, MSC_TRANSPARENT, MSC_BOT, 0x00,
+	0x07, USB_DESC_TYPE_ENDPOINT, SIM_USB_EP_IN, USBH_EP_BULK, SIM_USB_MPS, 0x00, 0x00,
+	0x07, USB_DESC_TYPE_ENDPOINT, SIM_USB_EP_OUT, USBH_EP_BULK, SIM_USB_MPS, 0x00, 0x00
+};
+
+static const char *const strDesc[] = { NULL, "Sim", "USB Flash Disk", "0123456789AB" };
+
+static USBH_HandleTypeDef *host;
+static simUsb_pipe_t pipes[USBH_MAX_PIPES_NBR];
+static simUsb_config_t config;
+static simUsb_stats_t stats;
+static uint32_t randState = 1;
+
+/* port */
+static bool attached;
+static bool started;
+static bool connected;
+static uint64_t connectAt = SIM_NEVER;
+static uint64_t enableAt = SIM_NEVER;
+static uint64_t sofAt = SIM_NEVER;
+static uint64_t busFreeAt;
+
+/* device */
+static const uint8_t *ctrlData;
+static uint16_t ctrlLen;
+static bool ctrlStall;
+static uint8_t ctrlBuf[SIM_USB_RESP_MAX];
+static bool haltIn;
+static bool haltOut;
+static uint64_t nakUntil;
+static uint32_t notReadyLeft;
+static uint8_t senseKey;
+static uint8_t senseAsc;
+static uint8_t senseAscq;
+static uint64_t lastCswAt = SIM_NEVER;
+static simUsb_bot_t bot;
+static uint8_t *dataBuf;		/* WRITE10 data and READ10 sector staging */
+static uint32_t dataBufSize;
+
+/***************************************
+* Local function implementation
+****************************************/
+static uint32_t simUsb_random(void)
+{
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+	return randState;
+}
+
+static uint32_t simUsb_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t simUsb_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void simUsb_putBe32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint64_t simUsb_max(uint64_t a, uint64_t b)
+{
+	return a > b ? a : b;
+}
+
+static uint32_t simUsb_min(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+// bus time of one packet
+static uint64_t simUsb_pktNs(uint32_t bytes)
+{
+	return (uint64_t)(bytes + SIM_USB_PKT_OVERHEAD) * SIM_USB_BYTE_NS;
+}
+
+// bus time of a transfer cut into max size packets
+static uint64_t simUsb_xferNs(uint32_t bytes, uint32_t *packets)
+{
+	uint32_t n = bytes / SIM_USB_MPS;
+	uint32_t rest = bytes % SIM_USB_MPS;
+	uint64_t ns = n * simUsb_pktNs(SIM_USB_MPS);
+
+	if(rest != 0 || bytes == 0)
+	{
+		ns += simUsb_pktNs(rest);
+		n++;
+	}
+	*packets = n;
+	return ns;
+}
+
+static bool simUsb_dataBuf(uint32_t size)
+{
+	if(size > dataBufSize)
+	{
+		uint8_t *p = realloc(dataBuf, size);
+		if(p == NULL)
+		{
+			return false;
+		}
+		dataBuf = p;
+		dataBufSize = size;
+	}
+	return true;
+}
+
+static void simUsb_setSense(uint8_t key, uint8_t asc, uint8_t ascq)
+{
+	senseKey = key;
+	senseAsc = asc;
+	senseAscq = ascq;
+}
+
+// the stick starts a NAK burst now and then, never inside one
+static void simUsb_nakRoll(uint64_t now)
+{
+	if(config.nakPerMille != 0 && now >= nakUntil
+		&& simUsb_random() % 1000 < config.nakPerMille)
+	{
+		nakUntil = now + config.nakBurstUs * SIM_NS_PER_US;
+	}
+}
+
+static void simUsb_reschedule(void)
+{
+	uint64_t at = connectAt;
+
+	if(enableAt < at)
+	{
+		at = enableAt;
+	}
+	if(sofAt < at)
+	{
+		at = sofAt;
+	}
+	for(uint32_t i = 0; i < USBH_MAX_PIPES_NBR; i++)
+	{
+		if(pipes[i].busy && pipes[i].doneAt < at)
+		{
+			at = pipes[i].doneAt;
+		}
+	}
+	simHal_schedule(SIM_IRQ_OTG_FS, at);
+}
+
+// put a URB on the bus from start on, it ends at doneAt
+static void simUsb_finish(simUsb_pipe_t *p, USBH_URBStateTypeDef result, uint64_t doneAt,
+		uint32_t count, uint32_t packets, simUsb_action_t action)
+{
+	p->result = result;
+	p->doneAt = doneAt;
+	p->count = count;
+	p->packets = packets;
+	p->action = action;
+	if(doneAt != SIM_NEVER && doneAt > busFreeAt)
+	{
+		busFreeAt = doneAt;
+	}
+}
+
+// the device side of a device reset
+static void simUsb_deviceReset(void)
+{
+	memset(&bot, 0, sizeof(bot));
+	haltIn = false;
+	haltOut = false;
+	ctrlLen = 0;
+	ctrlStall = false;
+	lastCswAt = SIM_NEVER;
+}
+
+static void simUsb_getDescriptor(uint16_t value, uint16_t length)
+{
+	uint8_t type = value >> 8;
+	uint8_t idx = value & 0xFF;
+
+	if(type == USB_DESC_TYPE_DEVICE)
+	{
+		ctrlData = devDesc;
+		ctrlLen = sizeof(devDesc);
+	}
+	else if(type == USB_DESC_TYPE_CONFIGURATION)
+	{
+		ctrlData = cfgDesc;
+		ctrlLen = sizeof(cfgDesc);
+	}
+	else if(type == USB_DESC_TYPE_STRING && idx == 0)
+	{
+		ctrlBuf[0] = 4;
+		ctrlBuf[1] = USB_DESC_TYPE_STRING;
+		ctrlBuf[2] = 0x09;		/* LANGID English (US) */
+		ctrlBuf[3] = 0x04;
+		ctrlData = ctrlBuf;
+		ctrlLen = 4;
+	}
+	else if(type == USB_DESC_TYPE_STRING && idx < sizeof(strDesc) / sizeof(strDesc[0]))
+	{
+		uint32_t n = strlen(strDesc[idx]);
+		ctrlBuf[0] = 2 + 2 * n;
+		ctrlBuf[1] = USB_DESC_TYPE_STRING;
+		for(uint32_t i = 0; i < n; i++)
+		{
+			ctrlBuf[2 + 2 * i] = strDesc[idx][i];
+			ctrlBuf[3 + 2 * i] = 0;
+		}
+		ctrlData = ctrlBuf;
+		ctrlLen = ctrlBuf[0];
+	}
+	else
+	{
+		ctrlStall = true;
+		return;
+	}
+	if(length < ctrlLen)
+	{
+		ctrlLen = length;
+	}
+}
+
+// a SETUP packet, the requests of enumeration and of the MSC class
+static void simUsb_setup(const uint8_t *req)
+{
+	uint8_t type = req[0];
+	uint8_t request = req[1];
+	uint16_t value = req[2] | (req[3] << 8);
+	uint16_t index = req[4] | (req[5] << 8);
+	uint16_t length = req[6] | (req[7] << 8);
+
+	stats.ctrlRequests++;
+	ctrlLen = 0;
+	ctrlStall = false;
+
+	if(type == SIM_USB_REQ_GET && request == USB_REQ_GET_DESCRIPTOR)
+	{
+		simUsb_getDescriptor(value, length);
+	}
+	else if(type == SIM_USB_REQ_STANDARD
+		&& (request == USB_REQ_SET_ADDRESS || request == USB_REQ_SET_CONFIGURATION))
+	{
+		/* nothing to remember, the pipes carry the address */
+	}
+	else if(type == SIM_USB_REQ_ENDPOINT && request == USB_REQ_CLEAR_FEATURE
+		&& value == FEATURE_SELECTOR_ENDPOINT)
+	{
+		stats.clearHalts++;
+		if(index == SIM_USB_EP_IN)
+		{
+			haltIn = false;
+		}
+		else if(index == SIM_USB_EP_OUT)
+		{
+			haltOut = false;
+		}
+	}
+	else if(type == SIM_USB_REQ_CLASS_IN && request == USB_REQ_GET_MAX_LUN)
+	{
+		ctrlBuf[0] = 0;
+		ctrlData = ctrlBuf;
+		ctrlLen = simUsb_min(1, length);
+	}
+	else if(type == SIM_USB_REQ_CLASS_OUT && request == USB_REQ_BOT_RESET)
+	{
+		stats.botResets++;
+		memset(&bot, 0, sizeof(bot));
+	}
+	else
+	{
+		ctrlStall = true;
+	}
+}
+
+// fail the command of the CBW with a sense code
+static void simUsb_fail(uint8_t key, uint8_t asc, uint8_t ascq)
+{
+	bot.failed = true;
+	bot.devLen = 0;
+	simUsb_setSense(key, asc, ascq);
+}
+
+// a CBW came in at time at, decode the command and plan the data stage
+static void simUsb_cbw(const uint8_t *cbw, uint32_t len, uint64_t at)
+{
+	const uint8_t *cb = &cbw[15];
+	uint32_t sectors = simDisk_sectors();
+	uint16_t ss = simDisk_sectorSize();
+
+	if(len != BOT_CBW_LENGTH || simUsb_le32(cbw) != BOT_CBW_SIGNATURE)
+	{
+		/* not a CBW: halt both ends until a reset recovery */
+		haltIn = true;
+		haltOut = true;
+		return;
+	}
+
+	stats.cbws++;
+	if(lastCswAt != SIM_NEVER)
+	{
+		uint64_t gap = at - lastCswAt;
+		stats.gaps++;
+		stats.gapNs += gap;
+		if(gap > stats.maxGapNs)
+		{
+			stats.maxGapNs = gap;
+		}
+	}
+
+	memset(&bot, 0, sizeof(bot));
+	bot.tag = simUsb_le32(&cbw[4]);
+	bot.hostLen = simUsb_le32(&cbw[8]);
+	bot.opcode = cb[0];
+	bot.cmdAt = at;
+	bot.mediaNs = SIM_USB_SCSI_NS;
+
+	switch(bot.opcode)
+	{
+	case OPCODE_TEST_UNIT_READY:
+		if(notReadyLeft != 0)
+		{
+			notReadyLeft--;
+			simUsb_fail(SCSI_SENSE_KEY_UNIT_ATTENTION, SCSI_ASC_NOT_READY_TO_READY_CHANGE, 0);
+		}
+		break;
+
+	case OPCODE_REQUEST_SENSE:
+		memset(bot.resp, 0, SIM_USB_SENSE_LEN);
+		bot.resp[0] = 0x70;			/* current error, fixed format */
+		bot.resp[2] = senseKey;
+		bot.resp[7] = SIM_USB_SENSE_LEN - 8;
+		bot.resp[12] = senseAsc;
+		bot.resp[13] = senseAscq;
+		bot.devLen = simUsb_min(SIM_USB_SENSE_LEN, cb[4]);
+		simUsb_setSense(SCSI_SENSE_KEY_NO_SENSE, 0, 0);
+		break;
+
+	case OPCODE_INQUIRY:
+		memset(bot.resp, 0, 36);
+		bot.resp[1] = 0x80;			/* removable */
+		bot.resp[2] = 0x02;
+		bot.resp[3] = 0x02;
+		bot.resp[4] = 36 - 5;
+		memcpy(&bot.resp[8], "Sim     ", 8);
+		memcpy(&bot.resp[16], "USB Flash Disk  ", 16);
+		memcpy(&bot.resp[32], "1.00", 4);
+		bot.devLen = simUsb_min(36, cb[4]);
+		break;
+
+	case OPCODE_READ_CAPACITY10:
+		simUsb_putBe32(&bot.resp[0], sectors - 1);
+		simUsb_putBe32(&bot.resp[4], ss);
+		bot.devLen = 8;
+		break;
+
+	case OPCODE_READ10:
+	case OPCODE_WRITE10:
+		bot.lba = simUsb_be32(&cb[2]);
+		bot.blocks = (cb[7] << 8) | cb[8];
+		if(bot.lba >= sectors || bot.blocks > sectors - bot.lba)
+		{
+			simUsb_fail(SCSI_SENSE_KEY_ILLEGAL_REQUEST, 0x21, 0);	/* LBA out of range */
+			break;
+		}
+		bot.devLen = bot.blocks * ss;
+		if(bot.opcode == OPCODE_READ10)
+		{
+			stats.read10++;
+			bot.mediaNs = simDisk_access(false, bot.lba, bot.blocks);
+			if(config.errorEvery != 0 && simUsb_random() % config.errorEvery == 0)
+			{
+				simUsb_fail(SCSI_SENSE_KEY_MEDIUM_ERROR, 0x11, 0);	/* unrecovered read error */
+			}
+		}
+		else
+		{
+			stats.write10++;
+			bot.mediaNs = simDisk_access(true, bot.lba, bot.blocks);
+			if(!simUsb_dataBuf(bot.devLen))
+			{
+				simUsb_fail(SCSI_SENSE_KEY_HARDWARE_ERROR, 0, 0);
+			}
+		}
+		break;
+
+	default:
+		simUsb_fail(SCSI_SENSE_KEY_ILLEGAL_REQUEST, SCSI_ASC_INVALID_COMMAND_OPERATION_CODE, 0);
+		break;
+	}
+
+	if(bot.devLen > bot.hostLen)
+	{
+		bot.devLen = bot.hostLen;
+	}
+	if(bot.hostLen == 0)
+	{
+		bot.state = SIM_BOT_CSW;
+		bot.cswAt = at + bot.mediaNs;
+	}
+	else if(cbw[12] & USB_EP_DIR_MSK)
+	{
+		bot.state = SIM_BOT_DATA_IN;
+	}
+	else
+	{
+		/* a failed command STALLs the data, the host clears it and reads the CSW */
+		bot.state = bot.failed ? SIM_BOT_CSW : SIM_BOT_DATA_OUT;
+		haltOut = bot.failed;
+		bot.cswAt = at + bot.mediaNs;
+	}
+}
+
+// the time the stick has the data up to byte end of the data stage
+static uint64_t simUsb_dataReady(uint32_t end)
+{
+	uint64_t lead;
+
+	if(bot.opcode != OPCODE_READ10)
+	{
+		return bot.cmdAt + bot.mediaNs;
+	}
+	lead = simDisk_transferNs(bot.devLen - end);
+	return lead < bot.mediaNs ? bot.cmdAt + bot.mediaNs - lead : bot.cmdAt;
+}
+
+// copy bytes of the data stage into an IN URB
+static void simUsb_copyIn(uint8_t *dst, uint32_t offset, uint32_t n)
+{
+	uint16_t ss = simDisk_sectorSize();
+
+	if(bot.opcode != OPCODE_READ10)
+	{
+		memcpy(dst, &bot.resp[offset], n);
+		return;
+	}
+	while(n != 0)
+	{
+		DWORD sector = bot.lba + offset / ss;
+		uint32_t in = offset % ss;
+		uint32_t chunk;
+
+		if(in == 0 && n >= ss)
+		{
+			chunk = n / ss * ss;
+			simDisk_readRaw(sector, chunk / ss, dst);
+		}
+		else
+		{
+			chunk = simUsb_min(ss - in, n);
+			if(simUsb_dataBuf(ss) && simDisk_readRaw(sector, 1, dataBuf))
+			{
+				memcpy(dst, &dataBuf[in], chunk);
+			}
+		}
+		dst += chunk;
+		offset += chunk;
+		n -= chunk;
+	}
+}
+
+static void simUsb_submitCtrl(simUsb_pipe_t *p, uint8_t direction, uint8_t token, uint16_t length)
+{
+	uint64_t start = simUsb_max(simHal_now(), busFreeAt);
+	uint32_t packets;
+	uint64_t ns;
+
+	if(token == 0)
+	{
+		simUsb_setup(p->buf);
+		simUsb_finish(p, USBH_URB_DONE, start + simUsb_pktNs(8), 8, 1, SIM_ACT_NONE);
+	}
+	else if(direction && ctrlStall)
+	{
+		simUsb_finish(p, USBH_URB_STALL, start + simUsb_pktNs(0), 0, 0, SIM_ACT_NONE);
+	}
+	else if(direction)
+	{
+		uint32_t n = simUsb_min(length, ctrlLen);
+		ns = simUsb_xferNs(n, &packets);
+		simUsb_finish(p, USBH_URB_DONE, start + ns, n, packets, SIM_ACT_CTRL_IN);
+		stats.busNs += ns;
+		stats.packets += packets;
+	}
+	else
+	{
+		/* status stage or the data of a request without one */
+		ns = simUsb_xferNs(length, &packets);
+		simUsb_finish(p, USBH_URB_DONE, start + ns, length, packets, SIM_ACT_NONE);
+		stats.busNs += ns;
+		stats.packets += packets;
+	}
+}
+
+static void simUsb_submitOut(simUsb_pipe_t *p, uint16_t length)
+{
+	uint64_t now = simHal_now();
+	uint64_t start = simUsb_max(now, busFreeAt);
+	uint32_t packets;
+	uint64_t ns;
+
+	simUsb_nakRoll(now);
+	if(haltOut)
+	{
+		simUsb_finish(p, USBH_URB_STALL, start + simUsb_pktNs(0), 0, 0, SIM_ACT_NONE);
+		return;
+	}
+	if(start < nakUntil || bot.state == SIM_BOT_DATA_IN || bot.state == SIM_BOT_CSW)
+	{
+		stats.naks++;
+		simUsb_finish(p, USBH_URB_NOTREADY, start + simUsb_pktNs(0), 0, 0, SIM_ACT_NONE);
+		return;
+	}
+	ns = simUsb_xferNs(length, &packets);
+	stats.busNs += ns;
+	stats.packets += packets;
+	simUsb_finish(p, USBH_URB_DONE, start + ns, length, packets,
+			bot.state == SIM_BOT_CBW ? SIM_ACT_CBW : SIM_ACT_DATA_OUT);
+}
+
+static void simUsb_submitIn(simUsb_pipe_t *p, uint16_t length)
+{
+	uint64_t now = simHal_now();
+	uint64_t start;
+	uint64_t ready;
+	uint64_t done;
+	uint32_t packets;
+	uint64_t ns;
+	uint32_t n;
+
+	simUsb_nakRoll(now);
+	start = simUsb_max(simUsb_max(now, busFreeAt), nakUntil);
+	if(haltIn)
+	{
+		simUsb_finish(p, USBH_URB_STALL, start + simUsb_pktNs(0), 0, 0, SIM_ACT_NONE);
+		return;
+	}
+
+	switch(bot.state)
+	{
+	case SIM_BOT_DATA_IN:
+		if(bot.failed)
+		{
+			/* no data for a failed command, STALL the data stage */
+			done = simUsb_max(start, bot.cmdAt + bot.mediaNs) + simUsb_pktNs(0);
+			haltIn = true;
+			bot.state = SIM_BOT_CSW;
+			bot.cswAt = done;
+			simUsb_finish(p, USBH_URB_STALL, done, 0, 0, SIM_ACT_NONE);
+			break;
+		}
+		n = simUsb_min(length, bot.devLen - bot.offset);
+		ns = simUsb_xferNs(n, &packets);
+		ready = simUsb_dataReady(bot.offset + n);
+		done = simUsb_max(start + ns, ready + simUsb_pktNs(simUsb_min(n, SIM_USB_MPS)));
+		if(ready > start)
+		{
+			stats.naks += (ready - start) / SIM_USB_NAK_NS + 1;
+		}
+		stats.busNs += ns;
+		stats.packets += packets;
+		simUsb_finish(p, USBH_URB_DONE, done, n, packets, SIM_ACT_DATA_IN);
+		break;
+
+	case SIM_BOT_CSW:
+		done = simUsb_max(start, bot.cswAt) + simUsb_pktNs(BOT_CSW_LENGTH);
+		stats.busNs += simUsb_pktNs(BOT_CSW_LENGTH);
+		stats.packets++;
+		simUsb_finish(p, USBH_URB_DONE, done, BOT_CSW_LENGTH, 1, SIM_ACT_CSW);
+		break;
+
+	default:
+		/* nothing to send, the stick NAKs until the URB is taken back */
+		stats.naks++;
+		simUsb_finish(p, USBH_URB_IDLE, SIM_NEVER, 0, 0, SIM_ACT_NONE);
+		break;
+	}
+}
+
+// the device side effects of a URB that made it through
+static void simUsb_apply(simUsb_pipe_t *p)
+{
+	uint32_t residue;
+
+	switch(p->action)
+	{
+	case SIM_ACT_CTRL_IN:
+		memcpy(p->buf, ctrlData, p->count);
+		break;
+
+	case SIM_ACT_CBW:
+		simUsb_cbw(p->buf, p->count, p->doneAt);
+		break;
+
+	case SIM_ACT_DATA_IN:
+		simUsb_copyIn(p->buf, bot.offset, p->count);
+		bot.offset += p->count;
+		if(bot.offset >= bot.devLen)
+		{
+			bot.state = SIM_BOT_CSW;
+			bot.cswAt = p->doneAt;
+		}
+		break;
+
+	case SIM_ACT_DATA_OUT:
+		if(bot.offset + p->count <= bot.devLen)
+		{
+			memcpy(&dataBuf[bot.offset], p->buf, p->count);
+		}
+		bot.offset += p->count;
+		if(bot.offset >= bot.hostLen)
+		{
+			if(bot.opcode == OPCODE_WRITE10 && !bot.failed)
+			{
+				simDisk_writeRaw(bot.lba, bot.blocks, dataBuf);
+			}
+			bot.state = SIM_BOT_CSW;
+			bot.cswAt = simUsb_max(p->doneAt, bot.cmdAt + bot.mediaNs);
+		}
+		break;
+
+	case SIM_ACT_CSW:
+		residue = bot.hostLen - simUsb_min(bot.offset, bot.hostLen);
+		memset(p->buf, 0, BOT_CSW_LENGTH);
+		p->buf[0] = BOT_CSW_SIGNATURE & 0xFF;
+		p->buf[1] = (BOT_CSW_SIGNATURE >> 8) & 0xFF;
+		p->buf[2] = (BOT_CSW_SIGNATURE >> 16) & 0xFF;
+		p->buf[3] = BOT_CSW_SIGNATURE >> 24;
+		p->buf[4] = bot.tag & 0xFF;
+		p->buf[5] = (bot.tag >> 8) & 0xFF;
+		p->buf[6] = (bot.tag >> 16) & 0xFF;
+		p->buf[7] = bot.tag >> 24;
+		p->buf[8] = residue & 0xFF;
+		p->buf[9] = (residue >> 8) & 0xFF;
+		p->buf[10] = (residue >> 16) & 0xFF;
+		p->buf[11] = residue >> 24;
+		p->buf[12] = bot.failed ? 1 : 0;
+		if(bot.failed)
+		{
+			stats.failedCmds++;
+		}
+		bot.state = SIM_BOT_CBW;
+		lastCswAt = p->doneAt;
+		break;
+
+	default:
+		break;
+	}
+}
+
+// hand a URB that ended over to the host
+static void simUsb_complete(simUsb_pipe_t *p)
+{
+	uint64_t cpuNs = (uint64_t)p->packets * SIM_USB_FIFO_NS;
+
+	p->busy = false;
+	if(p->result == USBH_URB_DONE)
+	{
+		simUsb_apply(p);
+	}
+	else if(p->result == USBH_URB_STALL)
+	{
+		stats.stalls++;
+	}
+	p->urb = p->result;
+	TRACE(TRACE_EV_URB, (uint8_t)(p - pipes), p->urb);
+	p->xferCount = p->count;
+	p->doneAt = SIM_NEVER;
+	stats.irqNs += cpuNs;
+	simHal_advance(cpuNs);
+	MX_USB_HOST_Kick();
+}
+
+/***************************************
+* Public function implementation
+****************************************/
+void simUsb_configure(const simUsb_config_t *cfg)
+{
+	config = *cfg;
+	randState = cfg->seed != 0 ? cfg->seed : 1;
+	memset(&stats, 0, sizeof(stats));
+}
+
+void simUsb_attach(void)
+{
+	attached = true;
+	notReadyLeft = config.notReadyTurs;
+	if(started && !connected)
+	{
+		connectAt = simHal_now() + SIM_USB_ATTACH_NS;
+		simUsb_reschedule();
+	}
+}
+
+void simUsb_IRQHandler(void)
+{
+	uint64_t now = simHal_now();
+
+	if(connectAt <= now)
+	{
+		connectAt = SIM_NEVER;
+		connected = true;
+		USBH_LL_Connect(host);
+		MX_USB_HOST_Kick();
+	}
+	if(enableAt <= now)
+	{
+		enableAt = SIM_NEVER;
+		sofAt = now + SIM_USB_SOF_NS;
+		USBH_LL_PortEnabled(host);
+		MX_USB_HOST_Kick();
+	}
+	if(sofAt <= now)
+	{
+		sofAt += SIM_USB_SOF_NS;
+		stats.sofs++;
+		USBH_LL_IncTimer(host);
+		MX_USB_HOST_Kick();
+	}
+	for(uint32_t i = 0; i < USBH_MAX_PIPES_NBR; i++)
+	{
+		if(pipes[i].busy && pipes[i].doneAt <= simHal_now())
+		{
+			simUsb_complete(&pipes[i]);
+		}
+	}
+	simUsb_reschedule();
+}
+
+void simUsb_getStats(simUsb_stats_t *out)
+{
+	*out = stats;
+}
+
+void simUsb_clearStats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	lastCswAt = SIM_NEVER;
+}
+
+/***************************************
+* USB host library low level interface
+****************************************/
+USBH_StatusTypeDef USBH_LL_Init(USBH_HandleTypeDef *phost)
+{
+	host = phost;
+	phost->pData = pipes;
+	memset(pipes, 0, sizeof(pipes));
+	USBH_LL_SetTimer(phost, 0);
+	return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_DeInit(USBH_HandleTypeDef *phost)
+{
+	return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_Start(USBH_HandleTypeDef *phost)
+{
+	started = true;
+	if(attached && !connected)
+	{
+		connectAt = simHal_now() + SIM_USB_ATTACH_NS;
+		simUsb_reschedule();
+	}
+	return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_Stop(USBH_HandleTypeDef *phost)
+{
+	started = false;
+	connected = false;
+	connectAt = SIM_NEVER;
+	enableAt = SIM_NEVER;
+	sofAt = SIM_NEVER;
+	for(uint32_t i = 0; i < USBH_MAX_PIPES_NBR; i++)
+	{
+		pipes[i].busy = false;
+	}
+	simUsb_reschedule();
+	return USBH_OK;
+}
+
+USBH_SpeedTypeDef USBH_LL_GetSpeed(USBH_HandleTypeDef *phost)
+{
+	return USBH_SPEED_FULL;
+}
+
+USBH_StatusTypeDef USBH_LL_ResetPort(USBH_HandleTypeDef *phost)
+{
+	simUsb_deviceReset();
+	sofAt = SIM_NEVER;
+	enableAt = simHal_now() + SIM_USB_RESET_NS;
+	simUsb_reschedule();
+	return USBH_OK;
+}
+
+uint32_t USBH_LL_GetLastXferSize(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+	return pipes[pipe].xferCount;
+}
+
+USBH_StatusTypeDef USBH_LL_OpenPipe(USBH_HandleTypeDef *phost, uint8_t pipe_num, uint8_t epnum,
+		uint8_t dev_address, uint8_t speed, uint8_t ep_type, uint16_t mps)
+{
+	simUsb_pipe_t *p = &pipes[pipe_num];
+
+	memset(p, 0, sizeof(*p));
+	p->epAddr = epnum;
+	p->doneAt = SIM_NEVER;
+	return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_ClosePipe(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+	pipes[pipe].busy = false;
+	pipes[pipe].doneAt = SIM_NEVER;
+	return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_SubmitURB(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t direction,
+		uint8_t ep_type, uint8_t token, uint8_t *pbuff, uint16_t length, uint8_t do_ping)
+{
+	simUsb_pipe_t *p = &pipes[pipe];
+
+	stats.urbs++;
+	p->urb = USBH_URB_IDLE;
+	p->busy = true;
+	p->buf = pbuff;
+	if(!connected)
+	{
+		/* no device: the transaction times out */
+		simUsb_finish(p, USBH_URB_ERROR, simHal_now() + simUsb_pktNs(0), 0, 0, SIM_ACT_NONE);
+	}
+	else if(ep_type == USBH_EP_CONTROL)
+	{
+		simUsb_submitCtrl(p, direction, token, length);
+	}
+	else if(direction)
+	{
+		simUsb_submitIn(p, length);
+	}
+	else
+	{
+		simUsb_submitOut(p, length);
+	}
+	simUsb_reschedule();
+	return USBH_OK;
+}
+
+USBH_URBStateTypeDef USBH_LL_GetURBState(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+	simHal_advance(SIM_POLL_NS);
+	return pipes[pipe].urb;
+}
+
+USBH_StatusTypeDef USBH_LL_DriverVBUS(USBH_HandleTypeDef *phost, uint8_t state)
+{
+	HAL_Delay(200);
+	return USBH_OK;
+}
+
+USBH_StatusTypeDef USBH_LL_SetToggle(USBH_HandleTypeDef *phost, uint8_t pipe, uint8_t toggle)
+{
+	if(pipes[pipe].epAddr & USB_EP_DIR_MSK)
+	{
+		pipes[pipe].toggleIn = toggle;
+	}
+	else
+	{
+		pipes[pipe].toggleOut = toggle;
+	}
+	return USBH_OK;
+}
+
+uint8_t USBH_LL_GetToggle(USBH_HandleTypeDef *phost, uint8_t pipe)
+{
+	return (pipes[pipe].epAddr & USB_EP_DIR_MSK) ? pipes[pipe].toggleIn : pipes[pipe].toggleOut;
+}
+
+void USBH_Delay(uint32_t Delay)
+{
+	HAL_Delay(Delay);
+}
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#
+# trace_decode.py
+#
+# @description: Turns the event trace of the player into a timeline. It
+# reads either a binary dump of the traceLog variable (see Core/Inc/trace.h),
+# e.g. from gdb with
+#
+#   dump binary value trace.bin traceLog
+#
+# or from the host simulation with --trace-dump, or a raw SWO capture of a
+# TRACE_ITM build, and prints one line per event with its time, the time
+# since the event before and the decoded arguments, followed by a summary
+# of the refill times and underruns.
+#
+#   Tools/trace_decode.py trace.bin
+#   Tools/trace_decode.py --itm swo.bin --clock 168000000
+#
+# @Author: Shuran Xu
+#
+# @Revision: 1.0
+#
+# @Date 2026-10-18
+#
+
+import argparse
+import signal
+import struct
+import sys
+
+TRACE_MAGIC = 0x52544157
+TRACE_ITM_PORT = 1
+HEADER = struct.Struct('<6I')
+RECORD = struct.Struct('<IBBH')
+
+EVENTS = ['none', 'mark', 'dma', 'refill_start', 'refill_end', 'underrun',
+          'urb', 'bot', 'button', 'codec_write', 'codec_read']
+PAUSE = ['playing', 'fading', 'muted', 'powered_down']
+URB = ['IDLE', 'DONE', 'NOTREADY', 'NYET', 'ERROR', 'STALL']
+BOT = ['?', 'SEND_CBW', 'SEND_CBW_WAIT', 'DATA_IN', 'DATA_IN_WAIT', 'DATA_OUT',
+       'DATA_OUT_WAIT', 'RECEIVE_CSW', 'RECEIVE_CSW_WAIT', 'ERROR_IN', 'ERROR_OUT',
+       'UNRECOVERED_ERROR']
+SCSI = {0x00: 'TEST_UNIT_READY', 0x03: 'REQUEST_SENSE', 0x12: 'INQUIRY',
+        0x25: 'READ_CAPACITY10', 0x28: 'READ10', 0x2A: 'WRITE10'}
+
+
+def name(table, index):
+    return table[index] if index < len(table) else str(index)
+
+
+def describe(event, a, b):
+    """The arguments of an event in words"""
+    if event == 2:
+        return 'half %d handed over, %s' % (a, name(PAUSE, b))
+    if event == 3:
+        return 'half %d' % a
+    if event == 4:
+        return 'half %d, %d bytes' % (a, b)
+    if event == 5:
+        return 'half %d not refilled in time' % a
+    if event == 6:
+        return 'channel %d %s' % (a, name(URB, b))
+    if event == 7:
+        return '%s (%s)' % (name(BOT, a), SCSI.get(b, '0x%02X' % b))
+    if event == 8:
+        return 'pin 0x%04X %s' % (b, 'pressed' if a else 'released')
+    if event == 9:
+        return 'reg 0x%02X x%d = 0x%02X' % (a, b >> 8, b & 0xFF)
+    if event == 10:
+        return 'reg 0x%02X x%d' % (a, b)
+    return 'a=%d b=%d' % (a, b)
+
+
+def read_dump(data):
+    """The records of a traceLog dump, oldest first, and the core clock"""
+    if len(data) < HEADER.size:
+        raise ValueError('the dump is shorter than the trace header')
+    magic, length, clock, head, stop_at, dropped = HEADER.unpack_from(data)
+    if magic != TRACE_MAGIC:
+        raise ValueError('no trace in the dump, magic 0x%08X' % magic)
+    if len(data) < HEADER.size + length * RECORD.size:
+        raise ValueError('the dump holds less than %d records' % length)
+    count = min(head, length)
+    first = head - count
+    records = []
+    for i in range(first, head):
+        records.append(RECORD.unpack_from(data, HEADER.size + (i % length) * RECORD.size))
+    info = '%d records logged, %d kept' % (head, count)
+    if stop_at != 0 and head == stop_at:
+        info += ', stopped by a trigger'
+    if dropped:
+        info += ', %d not streamed over SWO' % dropped
+    return records, clock, info
+
+
+def read_itm(data, port):
+    """The records in a raw SWO capture of ITM stimulus packets"""
+    words = []
+    i = 0
+    while i < len(data):
+        header = data[i]
+        i += 1
+        if header & 0x03:
+            size = {1: 1, 2: 2, 3: 4}[header & 0x03]
+            payload = data[i:i + size]
+            i += size
+            # software source packets only, hardware (DWT) ones are skipped
+            if not (header & 0x04) and (header >> 3) == port and size == 4 and len(payload) == 4:
+                words.append(struct.unpack('<I', payload)[0])
+        elif header in (0x00, 0x70, 0x80):
+            continue    # synchronization or overflow
+        elif header & 0x80:
+            while i < len(data) and (data[i] & 0x80):
+                i += 1  # timestamp continuation bytes
+            i += 1
+    records = []
+    for j in range(0, len(words) - 1, 2):
+        cycles = words[j]
+        event = words[j + 1] & 0xFF
+        a = (words[j + 1] >> 8) & 0xFF
+        b = words[j + 1] >> 16
+        records.append((cycles, event, a, b))
+    return records, '%d records streamed' % len(records)
+
+
+def timeline(records, clock, out):
+    """Print the events with their time and return them with unwrapped cycles"""
+    events = []
+    base = None
+    last = 0
+    wrap = 0
+    prev = None
+    for cycles, event, a, b in records:
+        if prev is not None and cycles < prev:
+            wrap += 1 << 32
+        prev = cycles
+        t = cycles + wrap
+        if base is None:
+            base = t
+            last = t
+        us = (t - base) * 1e6 / clock
+        delta = (t - last) * 1e6 / clock
+        last = t
+        events.append((t, event, a, b))
+        if out:
+            print('%14.3f us %+12.3f  %-12s %s' % (us, delta, name(EVENTS, event),
+                                                  describe(event, a, b)))
+    return events
+
+
+def summary(events, clock):
+    """Print the counts of the events and the refill times"""
+    counts = {}
+    started = {}
+    refills = []
+    underruns = []
+    for t, event, a, b in events:
+        counts[event] = counts.get(event, 0) + 1
+        if event == 3:
+            started[a] = t
+        elif event == 4 and a in started:
+            refills.append((t - started.pop(a)) * 1e6 / clock)
+        elif event == 5:
+            underruns.append((t - events[0][0]) * 1e6 / clock)
+    print('events     : ' + ', '.join('%s %d' % (name(EVENTS, e), n)
+                                      for e, n in sorted(counts.items())))
+    if events:
+        print('span       : %.3f ms' % ((events[-1][0] - events[0][0]) * 1e3 / clock))
+    if refills:
+        print('refill time: min %.1f avg %.1f max %.1f us' %
+              (min(refills), sum(refills) / len(refills), max(refills)))
+    if underruns:
+        print('underruns  : %d, at ' % len(underruns) +
+              ', '.join('%.3f ms' % (u / 1e3) for u in underruns[:8]) +
+              (' ...' if len(underruns) > 8 else ''))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the event trace of the player')
+    parser.add_argument('file', help='traceLog dump or, with --itm, a raw SWO capture')
+    parser.add_argument('--itm', action='store_true', help='the file is a raw SWO capture')
+    parser.add_argument('--port', type=int, default=TRACE_ITM_PORT, help='ITM stimulus port')
+    parser.add_argument('--clock', type=int, default=0,
+                        help='core clock in Hz, taken from the dump if not given')
+    parser.add_argument('--summary', action='store_true', help='print the summary only')
+    args = parser.parse_args()
+    signal.signal(signal.SIGPIPE, signal.SIG_DFL)   # quiet when piped into head
+
+    with open(args.file, 'rb') as f:
+        data = f.read()
+    try:
+        if args.itm:
+            records, info = read_itm(data, args.port)
+            clock = args.clock or 168000000
+        else:
+            records, clock, info = read_dump(data)
+            clock = args.clock or clock
+    except ValueError as err:
+        print('trace_decode: %s' % err, file=sys.stderr)
+        return 1
+    if clock == 0:
+        print('trace_decode: unknown core clock, give --clock', file=sys.stderr)
+        return 1
+
+    print('trace      : %s, %.1f MHz' % (info, clock / 1e6))
+    events = timeline(records, clock, not args.summary)
+    summary(events, clock)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -46,7 +46,15 @@ ApplicationTypeDef Appli_state = APPLICATION_IDLE;
  * -- Insert your variables declaration here --
  */
 /* USER CODE BEGIN 0 */
-
+#ifdef WAV_PLAYER_RTOS
+/* Held by a foreground transfer or by the host thread during a pass */
+static osMutexId hostMutex;
+#else
+/* Nesting depth of foreground USB transfers and a PendSV pass that was
+ * skipped because of one */
+static volatile uint8_t hostLock;
+static volatile uint8_t hostDeferred;
+#endif
 /* USER CODE END 0 */
 
 /*
@@ -58,7 +66,94 @@ static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id);
  * -- Insert your external function declaration here --
  */
 /* USER CODE BEGIN 1 */
+#ifdef WAV_PLAYER_RTOS
+/**
+  * Request a pass of the host state machine from the host thread
+  * @note The kernel owns PendSV in this build, an event on the queue of
+  * the USB host library wakes its thread instead. Events before the
+  * kernel runs are left to the library, the thread starts with a pass.
+  */
+void MX_USB_HOST_Kick(void)
+{
+  if (osKernelRunning())
+  {
+    (void)osMessagePut(hUsbHostFS.os_event, USBH_URB_EVENT, 0U);
+  }
+}
+
+/**
+  * Keep the host thread off while a foreground transfer runs
+  * @note A recursive mutex, the thread takes it around every pass
+  * (USBH_OS_LOCK in usbh_conf.h) and waits for the transfer to end.
+  */
+void MX_USB_HOST_Lock(void)
+{
+  if (osKernelRunning())
+  {
+    (void)osRecursiveMutexWait(hostMutex, osWaitForever);
+  }
+}
 
+/**
+  * Release the host thread
+  */
+void MX_USB_HOST_Unlock(void)
+{
+  if (osKernelRunning())
+  {
+    (void)osRecursiveMutexRelease(hostMutex);
+  }
+}
+#else
+/**
+  * Request a pass of the host state machine from the PendSV handler
+  * @note Called from the HCD callbacks, the SOF one requests a pass every
+  * millisecond while a device is attached.
+  */
+void MX_USB_HOST_Kick(void)
+{
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/**
+  * Keep the host state machine off while a foreground transfer runs
+  * @note The disk layer brackets every MSC call with Lock/Unlock, so a
+  * disconnect handled by PendSV never tears the class down mid-transfer.
+  */
+void MX_USB_HOST_Lock(void)
+{
+  hostLock++;
+}
+
+/**
+  * Release the host state machine, runs a pass skipped meanwhile
+  */
+void MX_USB_HOST_Unlock(void)
+{
+  if ((--hostLock == 0U) && hostDeferred)
+  {
+    hostDeferred = 0U;
+    MX_USB_HOST_Kick();
+  }
+}
+
+/**
+  * The PendSV side of the host: one pass of the state machine
+  * @note PendSV has the lowest priority, so SysTick (needed by the delays
+  * inside USBH_Process), the audio DMA and the OTG interrupt preempt it.
+  */
+void MX_USB_HOST_PendSV(void)
+{
+  if (hostLock != 0U)
+  {
+    hostDeferred = 1U;
+  }
+  else
+  {
+    MX_USB_HOST_Process();
+  }
+}
+#endif
 /* USER CODE END 1 */
 
 /**
@@ -68,7 +163,10 @@ static void USBH_UserProcess(USBH_HandleTypeDef *phost, uint8_t id);
 void MX_USB_HOST_Init(void)
 {
   /* USER CODE BEGIN USB_HOST_Init_PreTreatment */
-
+#ifdef WAV_PLAYER_RTOS
+  osMutexDef(usbHost);
+  hostMutex = osRecursiveMutexCreate(osMutex(usbHost));
+#endif
   /* USER CODE END USB_HOST_Init_PreTreatment */
 
   /* Init host Library, add supported class and start the library. */
@@ -85,7 +183,7 @@ void MX_USB_HOST_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN USB_HOST_Init_PostTreatment */
-
+  MX_USB_HOST_Kick();
   /* USER CODE END USB_HOST_Init_PostTreatment */
 }
 
@@ -72,6 +72,22 @@ void MX_USB_HOST_Init(void);
 
 void MX_USB_HOST_Process(void);
 
+/* USER CODE BEGIN FunctionsPrototype */
+/** @brief Pend one pass of the host state machine in PendSV, or in the host thread. */
+void MX_USB_HOST_Kick(void);
+
+/** @brief Hold the host state machine off during a foreground transfer. */
+void MX_USB_HOST_Lock(void);
+
+/** @brief Release the host state machine. */
+void MX_USB_HOST_Unlock(void);
+
+#ifndef WAV_PLAYER_RTOS
+/** @brief Body of the PendSV handler. */
+void MX_USB_HOST_PendSV(void);
+#endif
+/* USER CODE END FunctionsPrototype */
+
 /**
   * @}
   */
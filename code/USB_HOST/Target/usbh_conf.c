@@ -22,7 +22,8 @@
 #include "usbh_core.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "usb_host.h"
+#include "trace.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -89,7 +90,7 @@ void HAL_HCD_MspInit(HCD_HandleTypeDef* hcdHandle)
     __HAL_RCC_USB_OTG_FS_CLK_ENABLE();
 
     /* Peripheral interrupt init */
-    HAL_NVIC_SetPriority(OTG_FS_IRQn, 0, 0);
+    HAL_NVIC_SetPriority(OTG_FS_IRQn, 6, 0);
     HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
   /* USER CODE BEGIN USB_OTG_FS_MspInit 1 */
 
@@ -131,6 +132,7 @@ void HAL_HCD_MspDeInit(HCD_HandleTypeDef* hcdHandle)
 void HAL_HCD_SOF_Callback(HCD_HandleTypeDef *hhcd)
 {
   USBH_LL_IncTimer(hhcd->pData);
+  MX_USB_HOST_Kick();
 }
 
 /**
@@ -141,6 +143,7 @@ void HAL_HCD_SOF_Callback(HCD_HandleTypeDef *hhcd)
 void HAL_HCD_Connect_Callback(HCD_HandleTypeDef *hhcd)
 {
   USBH_LL_Connect(hhcd->pData);
+  MX_USB_HOST_Kick();
 }
 
 /**
@@ -151,6 +154,7 @@ void HAL_HCD_Connect_Callback(HCD_HandleTypeDef *hhcd)
 void HAL_HCD_Disconnect_Callback(HCD_HandleTypeDef *hhcd)
 {
   USBH_LL_Disconnect(hhcd->pData);
+  MX_USB_HOST_Kick();
 }
 
 /**
@@ -162,10 +166,12 @@ void HAL_HCD_Disconnect_Callback(HCD_HandleTypeDef *hhcd)
   */
 void HAL_HCD_HC_NotifyURBChange_Callback(HCD_HandleTypeDef *hhcd, uint8_t chnum, HCD_URBStateTypeDef urb_state)
 {
+  TRACE(TRACE_EV_URB, chnum, urb_state);
   /* To be used with OS to sync URB state with the global state machine */
 #if (USBH_USE_OS == 1)
   USBH_LL_NotifyURBChange(hhcd->pData);
 #endif
+  MX_USB_HOST_Kick();
 }
 /**
 * @brief  Port Port Enabled callback.
@@ -175,6 +181,7 @@ void HAL_HCD_HC_NotifyURBChange_Callback(HCD_HandleTypeDef *hhcd, uint8_t chnum,
 void HAL_HCD_PortEnabled_Callback(HCD_HandleTypeDef *hhcd)
 {
   USBH_LL_PortEnabled(hhcd->pData);
+  MX_USB_HOST_Kick();
 }
 
 /**
@@ -185,6 +192,7 @@ void HAL_HCD_PortEnabled_Callback(HCD_HandleTypeDef *hhcd)
 void HAL_HCD_PortDisabled_Callback(HCD_HandleTypeDef *hhcd)
 {
   USBH_LL_PortDisabled(hhcd->pData);
+  MX_USB_HOST_Kick();
 }
 
 /*******************************************************************************
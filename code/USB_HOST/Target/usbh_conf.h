@@ -86,7 +86,14 @@
 #define USBH_DEBUG_LEVEL      0U
 
 /*----------   -----------*/
+/* USER CODE BEGIN USE_OS */
+/* The FreeRTOS build runs the host state machine in the library's thread */
+#ifdef WAV_PLAYER_RTOS
+#define USBH_USE_OS      1U
+#else
 #define USBH_USE_OS      0U
+#endif
+/* USER CODE END USE_OS */
 
 /****************************************/
 /* #define for FS and HS identification */
@@ -95,8 +102,13 @@
 
 #if (USBH_USE_OS == 1)
   #include "cmsis_os.h"
-  #define USBH_PROCESS_PRIO          osPriorityNormal
-  #define USBH_PROCESS_STACK_SIZE    ((uint16_t)0)
+  #define USBH_PROCESS_PRIO          osPriorityHigh
+  #define USBH_PROCESS_STACK_SIZE    ((uint16_t)512)
+  /* A pass of the host thread waits for the foreground transfer in flight */
+  void MX_USB_HOST_Lock(void);
+  void MX_USB_HOST_Unlock(void);
+  #define USBH_OS_LOCK()             MX_USB_HOST_Lock()
+  #define USBH_OS_UNLOCK()           MX_USB_HOST_Unlock()
 #endif /* (USBH_USE_OS == 1) */
 
 /**